@@ -15,6 +15,12 @@
 #include <math.h>
 #include <string.h>
 #include "../libs/gmsh/gmsh-4.13.1-Linux64-sdk/include/gmshc.h"
+#include "femProfile.h"
+#include "femMemory.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 
 #define ErrorScan(a)   femErrorScan(a,__LINE__,__FILE__)
@@ -28,6 +34,9 @@
 typedef enum {FEM_TRIANGLE,FEM_QUAD,FEM_EDGE} femElementType;
 typedef enum {DIRICHLET_X,DIRICHLET_Y,NEUMANN_X,NEUMANN_Y} femBoundaryType;
 typedef enum {PLANAR_STRESS,PLANAR_STRAIN,AXISYM} femElasticCase;
+typedef enum {FEM_FULL,FEM_BAND,FEM_MULTIGRID} femSolverType;
+typedef enum {FEM_NO,FEM_XNUM,FEM_YNUM} femRenumType;
+typedef enum {FEM_DOUBLE,FEM_MIXED} femPrecision;
 
 
 typedef struct {
@@ -36,11 +45,14 @@ typedef struct {
     double *Y;
 } femNodes;
 
+typedef struct femTopology femTopology;
+
 typedef struct {
     int nLocalNode;
     int nElem;
     int *elem;
     femNodes *nodes;
+    femTopology *topology;          // adjacency graphs, built on demand by femMeshTopology
 } femMesh;
 
 typedef struct {
@@ -60,6 +72,8 @@ typedef struct {
     femMesh  *theEdges;
     int nDomains;
     femDomain **theDomains;
+    femArena *arena;
+    int nRefinements;
 } femGeo;
 
 typedef struct {
@@ -86,6 +100,34 @@ typedef struct {
     int size;
 } femFullSystem;
 
+typedef struct {
+    double *B;
+    double **A;
+    int size;
+    int band;
+} femBandSystem;
+
+typedef struct {
+    float *B;
+    float **A;                      // upper band of the factor in single precision, same layout as femBandSystem
+    int size;
+    int band;
+    double norm;                    // infinity norm of the double precision operator
+} femMixedSystem;
+
+typedef struct {
+    double *B;
+    double *A;                      // nonzero values row by row (CSR), columns sorted in each row
+    int *rowStart;
+    int *col;
+    int *diag;                      // position of the diagonal in each row
+    int size;
+} femSparseSystem;
+
+typedef struct femMultigrid femMultigrid;
+typedef struct femMonitor femMonitor;
+typedef struct femFactors femFactors;
+
 
 typedef struct {
     femDomain* domain;
@@ -99,7 +141,9 @@ typedef struct {
     double A,B,C;
     int planarStrainStress;
     int nBoundaryConditions;
+    int maxBoundaryConditions;
     femBoundaryCondition **conditions;  
+    femArena *arena;
     int *constrainedNodes; 
     double *soluce;
     double *residuals;
@@ -108,7 +152,21 @@ typedef struct {
     femIntegration *rule;
     femDiscrete *spaceEdge;
     femIntegration *ruleEdge;
+    femSolverType solverType;
     femFullSystem *system;
+    femBandSystem *bandSystem;
+    femSparseSystem *sparseSystem;
+    femSparseSystem *massSystem;    // consistent mass matrix, assembled with the stiffness when set
+    double shift;                   // K - shift M is factorized, see femElasticitySetShift
+    femMultigrid *multigrid;
+    femPrecision precision;
+    femMixedSystem *mixedSystem;
+    femMonitor *monitor;
+    femFactors *factors;            // jacobians and gradients at the integration points, see femFactors.h
+    int cacheFactors;
+    int *number;
+    double *lift;
+    int factorized;
 } femProblem;
 
 
@@ -118,6 +176,7 @@ double              geoSize(double x, double y);
 double              geoSizeDefault(double x, double y);
 void                geoSetSizeCallback(double (*geoSize)(double x, double y));
 void                geoMeshGenerateClosed();
+void                geoMeshGenerateHalf();
 void                geoMeshGenerateOpen();
 void                geoMeshImport();
 void                geoMeshPrint();
@@ -125,20 +184,55 @@ void                geoMeshWrite(const char *filename);
 void                geoMeshRead(const char *filename);
 void                geoSetDomainName(int iDomain, char *name);
 int                 geoGetDomain(char *name);
+void                geoMeshReset();
 void                geoFinalize();
 
+femGeo*             geoCreate();
+void                geoFree(femGeo *theGeometry);
+femArena*           geoArena(femGeo *theGeometry);
+void                geoMeshGenerateClosedGeo(femGeo *theGeometry);
+void                geoMeshGenerateHalfGeo(femGeo *theGeometry);
+void                geoMeshGenerateOpenGeo(femGeo *theGeometry);
+void                geoMeshImportGeo(femGeo *theGeometry);
+void                geoMeshWriteGeo(femGeo *theGeometry, const char *filename);
+void                geoMeshReadGeo(femGeo *theGeometry, const char *filename);
+void                geoSetDomainNameGeo(femGeo *theGeometry, int iDomain, char *name);
+int                 geoGetDomainGeo(femGeo *theGeometry, char *name);
+void                geoFinalizeGeo(femGeo *theGeometry);
+size_t              geoMeshMemory(femGeo *theGeometry);
+
 void                femProblemWrite(femProblem *theProblem, const char* filename);
 void                femSolutionWrite(int nNodes, int nfields, double *data, const char *filename);
 
 femProblem*         femElasticityCreate(femGeo* theGeometry, 
                                       double E, double nu, double rho, double g, femElasticCase iCase);
+femProblem*         femElasticityCreateSolver(femGeo* theGeometry, double E, double nu, double rho, double g,
+                                      femElasticCase iCase, femSolverType solverType, femRenumType renumType);
 void                femElasticityFree(femProblem *theProblem);
 void                femElasticityPrint(femProblem *theProblem);
 void                femElasticityAddBoundaryCondition(femProblem *theProblem, char *nameDomain, femBoundaryType type, double value);
 void                femElasticityAssembleElements(femProblem *theProblem);
 void                femElasticityAssembleNeumann(femProblem *theProblem);
+void                femElasticityElementMatrix(femProblem *theProblem, int iElem, double *Aloc, double *Bloc, int *map);
+double              femElasticityElementFlops(femProblem *theProblem);
+void                femElasticityElementMass(femProblem *theProblem, int iElem, double *Mloc);
+void                femElasticitySetMass(femProblem *theProblem, int mass);
+void                femElasticityMassMultiply(femProblem *theProblem, const double *x, double *y);
+void                femElasticitySetShift(femProblem *theProblem, double shift);
+double              femElasticityElementGradients(femProblem *theProblem, int iElem, double xsi, double eta,
+                                      double *dphidx, double *dphidy, int *map);
+double              femElasticityElementFactors(femProblem *theProblem, int iElem, int iInteg,
+                                      double *dphidx, double *dphidy);
+void                femElasticitySetFactorCache(femProblem *theProblem, int cache);
+void                femElasticityInvalidateFactors(femProblem *theProblem);
+femFactors*         femElasticityFactors(femProblem *theProblem);
+void                femElasticitySetPrecision(femProblem *theProblem, femPrecision precision);
+void                femElasticityFactorize(femProblem *theProblem);
+double*             femElasticitySolveFactorized(femProblem *theProblem);
+void                femElasticitySolveIncrements(femProblem *theProblem, int nRhs, const double *loads, double *soluces);
 double*             femElasticitySolve(femProblem *theProblem);
 double*             femElasticityForces(femProblem *theProblem);
+void                femElasticityTractionLoads(femProblem *theProblem, femDomain *theDomain, femBoundaryType type, double value, double *B);
 double              femElasticityIntegrate(femProblem *theProblem, double (*f)(double x, double y));
 
 
@@ -162,6 +256,35 @@ void                femFullSystemInit(femFullSystem* mySystem);
 void                femFullSystemAlloc(femFullSystem* mySystem, int size);
 double*             femFullSystemEliminate(femFullSystem* mySystem);
 void                femFullSystemConstrain(femFullSystem* mySystem, int myNode, double value);
+void                femFullSystemFactor(femFullSystem* mySystem);
+double*             femFullSystemSolve(femFullSystem* mySystem);
+void                femFullSystemMultiply(femFullSystem* mySystem, const double *x, double *y);
+
+femBandSystem*      femBandSystemCreate(int size, int band);
+void                femBandSystemFree(femBandSystem* myBandSystem);
+void                femBandSystemInit(femBandSystem* myBandSystem);
+void                femBandSystemAlloc(femBandSystem* myBandSystem, int size, int band);
+double*             femBandSystemEliminate(femBandSystem* myBandSystem);
+void                femBandSystemConstrain(femBandSystem* myBandSystem, int myNode, double value);
+void                femBandSystemFactor(femBandSystem* myBandSystem);
+double*             femBandSystemSolve(femBandSystem* myBandSystem);
+void                femBandSystemSolveMultiple(femBandSystem* myBandSystem, double *X, int nRhs);
+void                femBandSystemMultiply(femBandSystem* myBandSystem, const double *x, double *y);
+
+femMixedSystem*     femMixedSystemCreateFull(femFullSystem* mySystem);
+femMixedSystem*     femMixedSystemCreateBand(femBandSystem* myBandSystem);
+void                femMixedSystemFree(femMixedSystem* mySystem);
+int                 femMixedSystemFactor(femMixedSystem* mySystem);
+void                femMixedSystemSolve(femMixedSystem* mySystem, double *x);
+
+femSparseSystem*    femSparseSystemCreate(femMesh *theMesh, int *number);
+void                femSparseSystemFree(femSparseSystem* mySystem);
+void                femSparseSystemInit(femSparseSystem* mySystem);
+int                 femSparseSystemFind(femSparseSystem* mySystem, int row, int col);
+void                femSparseSystemConstrain(femSparseSystem* mySystem, int myNode, double value);
+void                femSparseSystemMultiply(femSparseSystem* mySystem, const double *x, double *y);
+size_t              femSystemMemory(femSolverType solverType, int size, int band);
+int                 femMeshRenumber(femMesh *theMesh, femRenumType renumType, int *number);
 
 double              femMin(double *x, int n);
 double              femMax(double *x, int n);
@@ -173,4 +296,8 @@ void                trim(char *str);
 double              fun(double x, double y);
 
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,45 @@
+/*
+ *  femAdapt.h
+ *  Zienkiewicz-Zhu error estimator and mesh size field for adaptive remeshing
+ *
+ */
+
+#ifndef _FEM_ADAPT_H_
+#define _FEM_ADAPT_H_
+
+#include "fem.h"
+#include "femStress.h"
+#include "femTransfer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femStress *stress;
+    int nElem;
+    double *error;                  // squared energy norm of sigma* - sigma_h on each element
+    double errorNorm;               // energy norm of the error over the mesh
+    double energyNorm;              // energy norm of the solution
+    double eta;                     // relative error errorNorm / sqrt(energyNorm^2 + errorNorm^2)
+} femEstimator;
+
+typedef struct {
+    femTransfer *sizes;             // requested size at each node of a copy of the mesh
+} femSizeField;
+
+
+femEstimator*       femEstimatorCreate(femStress *theStress);
+void                femEstimatorFree(femEstimator *theEstimator);
+int                 femEstimatorMark(femEstimator *theEstimator, double theta, int *marked);
+
+femSizeField*       femSizeFieldCreate(femEstimator *theEstimator, double eta, double hMin, double hMax);
+void                femSizeFieldFree(femSizeField *theField);
+double              femSizeFieldEvaluate(femSizeField *theField, double x, double y);
+void                femSizeFieldUse(femSizeField *theField);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
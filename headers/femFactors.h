@@ -0,0 +1,34 @@
+/*
+ *  femFactors.h
+ *  Jacobians and shape function gradients of the elements, computed once per problem
+ *
+ */
+
+#ifndef _FEM_FACTORS_H_
+#define _FEM_FACTORS_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// one entry per element and integration point, k = iElem * nInteg + iInteg
+// the entries are those of the coordinates at creation : whoever moves the nodes of a problem
+// calls femElasticityInvalidateFactors, and the next pass rebuilds them (femElasticityFactors)
+struct femFactors {
+    int nElem, nInteg, n;
+    double *jac;                    // jacobian of the mapping at each point
+    double *dphidx, *dphidy;        // gradients of the n shape functions at each point, n per point
+};
+
+
+femFactors*         femFactorsCreate(femProblem *theProblem, int nThreads);
+void                femFactorsFree(femFactors *theFactors);
+size_t              femFactorsMemory(femProblem *theProblem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ *  femIntegrals.h
+ *  Integrals of several fields in one threaded pass, the integrand called on batches of points
+ *
+ */
+
+#ifndef _FEM_INTEGRALS_H_
+#define _FEM_INTEGRALS_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// integration points of a batch of elements, with the solution of the problem interpolated there
+typedef struct {
+    int n;
+    const int *elem;                            // element of each point
+    const double *x, *y;                        // physical coordinates
+    const double *u, *v;                        // displacements
+    const double *exx, *eyy, *exy;              // strains
+} femIntegrationPoints;
+
+// fills values[k * points->n + i] with the field k at the point i
+typedef void (*femIntegrand)(const femIntegrationPoints *points, int nFields, double *values, void *data);
+
+
+void                femIntegrals(femProblem *theProblem, femIntegrand integrand, void *data, int nFields,
+                                 double *integrals, int nThreads);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
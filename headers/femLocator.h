@@ -0,0 +1,52 @@
+/*
+ *  femLocator.h
+ *  Spatial index over the elements, point location and probes of the solution
+ *
+ */
+
+#ifndef _FEM_LOCATOR_H_
+#define _FEM_LOCATOR_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femMesh *mesh;                  // not copied : the index holds as long as the mesh does not change
+    double xMin, yMin, cell;
+    int nx, ny;
+    int *cellStart, *cellElem;      // elements overlapping each cell of a uniform grid
+} femLocator;
+
+typedef struct {
+    femProblem *problem;
+    int n;
+    double *x, *y;
+    int *elem;                      // element holding each point, -1 outside of the mesh
+    double *xsi, *eta;              // reference coordinates of the points in their element
+    double *U, *V;                  // displacements of the last evaluation
+    double *exx, *eyy, *exy;        // strains
+    double *sxx, *syy, *sxy;        // stresses
+} femProbe;
+
+
+femLocator*         femLocatorCreate(femMesh *theMesh);
+void                femLocatorFree(femLocator *theLocator);
+int                 femLocatorFind(femLocator *theLocator, double x, double y, double *xsi, double *eta);
+void                femLocatorFindPoints(femLocator *theLocator, int n, const double *x, const double *y,
+                                      int *elem, double *xsi, double *eta, int nThreads);
+void                femLocatorWeights(femLocator *theLocator, double xsi, double eta, double *phi);
+int                 femLocatorNearest(femLocator *theLocator, double x, double y);
+
+femProbe*           femProbeCreate(femProblem *theProblem, femLocator *theLocator, int n, const double *x, const double *y);
+void                femProbeFree(femProbe *theProbe);
+void                femProbeEvaluate(femProbe *theProbe);
+void                femProbeWrite(femProbe *theProbe, const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
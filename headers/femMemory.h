@@ -0,0 +1,69 @@
+/*
+ *  femMemory.h
+ *  Tracked allocations by subsystem, memory budget and high-water mark
+ *
+ */
+
+#ifndef _FEM_MEMORY_H_
+#define _FEM_MEMORY_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    FEM_MEM_MESH,
+    FEM_MEM_SYSTEM,
+    FEM_MEM_SOLVER,
+    FEM_MEM_POST,
+    FEM_MEM_RENDER,
+    FEM_MEM_COUNT
+} femMemoryType;
+
+typedef struct {
+    size_t current;
+    size_t peak;
+    long   allocations;
+} femMemoryStats;
+
+// a list of blocks carved sequentially, released all at once
+typedef struct femArenaBlock {
+    struct femArenaBlock *next;
+    size_t size, used;
+} femArenaBlock;
+
+typedef struct {
+    femMemoryType type;
+    size_t nextSize;
+    femArenaBlock *blocks;
+} femArena;
+
+
+void*               femMalloc(femMemoryType type, size_t bytes);
+void*               femRealloc(femMemoryType type, void *ptr, size_t bytes);
+void                femFree(void *ptr);
+
+size_t              femMemoryCurrent();
+size_t              femMemoryPeak();
+void                femMemoryResetPeak();
+femMemoryStats      femMemoryStatsOf(femMemoryType type);
+const char*         femMemoryName(femMemoryType type);
+void                femMemorySetBudget(size_t bytes);
+size_t              femMemoryBudget();
+int                 femMemoryFits(size_t bytes);
+void                femMemoryReport(FILE *file);
+
+femArena*           femArenaCreate(femMemoryType type);
+void*               femArenaAlloc(femArena *theArena, size_t bytes);
+void                femArenaReset(femArena *theArena);
+void                femArenaFree(femArena *theArena);
+size_t              femArenaMemory(femArena *theArena);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
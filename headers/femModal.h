@@ -0,0 +1,38 @@
+/*
+ *  femModal.h
+ *  Natural frequencies and mode shapes by shift-invert Lanczos on the factorized stiffness
+ *
+ */
+
+#ifndef _FEM_MODAL_H_
+#define _FEM_MODAL_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femProblem *problem;
+    int nModes;
+    int size;                       // 2*nNodes
+    int steps;                      // lanczos steps
+    int converged;                  // modes within the tolerance
+    int nRigid;                     // rigid body modes found (K singular), dropped from the modes
+    double shift;                   // of the factorization K - shift M
+    double *eigenvalues;            // squared circular frequencies [rad2/s2], increasing
+    double *frequencies;            // natural frequencies [Hz]
+    double *residuals;              // relative residual estimates of the modes
+    double *modes;                  // mode k at modes[k*size], natural ordering, unit modal mass
+} femModal;
+
+
+femModal*           femModalCreate(femProblem *theProblem, int nModes, double tol, double shift);
+void                femModalFree(femModal *theModal);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ *  femMonitor.h
+ *  Telemetry of the iterative solvers and stopping on quantities of interest
+ *
+ */
+
+#ifndef _FEM_MONITOR_H_
+#define _FEM_MONITOR_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int iteration;
+    double residual;                // relative to the right-hand side
+    double energy;                  // energy norm of the last correction relative to the one of the solution
+    double displacement;            // largest displacement on the monitored domain
+    double reaction;                // resultant of the nodal forces on the reaction domain
+} femIterationReport;
+
+typedef void (*femIterationCallback)(const femIterationReport *theReport, void *data);
+
+struct femMonitor {
+    femProblem *problem;
+    int nNodes, *nodes;             // nodes of the monitored domain
+    int nReaction;                  // nodes of the reaction domain
+    int nElem, nLoc;                // elements touching the reaction domain and their matrices
+    int *map;
+    double *A, *B;                  // rows and loads of the other nodes are zeroed
+    double load[2];                 // resultant of the neumann loads on the reaction nodes
+    femIterationCallback callback;
+    void *data;
+    FILE *log;
+    double tolerance;               // on the changes of both quantities, 0 to iterate to the solver tolerance
+    int stable;                     // consecutive iterations within the tolerance
+    femIterationReport last;
+};
+
+
+femMonitor*         femMonitorCreate(femProblem *theProblem, char *nameDomain, char *nameReaction);
+void                femMonitorFree(femMonitor *theMonitor);
+void                femMonitorSetCallback(femMonitor *theMonitor, femIterationCallback callback, void *data);
+void                femMonitorSetLog(femMonitor *theMonitor, FILE *log);
+void                femMonitorSetTolerance(femMonitor *theMonitor, double tolerance);
+int                 femMonitorReport(femMonitor *theMonitor, int iteration, double residual, double energy, const double *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
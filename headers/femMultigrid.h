@@ -0,0 +1,64 @@
+/*
+ *  femMultigrid.h
+ *  Geometric and algebraic multigrid, as a preconditioner of the conjugate gradients
+ *
+ */
+
+#ifndef _FEM_MULTIGRID_H_
+#define _FEM_MULTIGRID_H_
+
+#include "fem.h"
+#include "femRefine.h"
+#include "femMonitor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FEM_MULTIGRID_MAXLEVELS 16
+
+typedef enum {FEM_GAUSS_SEIDEL,FEM_CHEBYSHEV} femSmootherType;
+
+typedef struct {
+    femSparseSystem *system;        // the finest one belongs to the problem
+    int size;
+    int *fixed;                     // constrained dofs, their rows are the identity
+    int *pStart, *pCol;             // prolongation from the next coarser level, row by row
+    double *pValue;
+    double *x, *b, *r, *d;
+    double lambda;                  // largest eigenvalue of D^-1 A
+} femMultigridLevel;
+
+struct femMultigrid {
+    int nLevels;                    // level 0 is the finest one
+    femRefinement **refinements;    // refinements[l] goes from level nLevels-1-l to nLevels-2-l, NULL for the algebraic one
+    int *coarseNumber;              // renumbering of the coarsest mesh for its band factor
+    int *coarseOrder;               // position of each dof of the coarsest level in its band system
+    femBandSystem *coarse;
+    femMultigridLevel *levels;
+    double *work;                   // residual, preconditioned residual, direction and its product in the CG
+    femSmootherType smoother;
+    int nSmooth;                    // sweeps (or chebyshev degree) before and after the coarse correction
+    int gamma;                      // 1 for V-cycles, 2 for W-cycles
+    double strength;                // threshold of the strong couplings of the aggregation
+    int coarseSize;                 // the aggregation stops below this number of dofs
+    double tolerance;               // on the residual relative to the right-hand side
+    int maxIterations;
+    int iterations;                 // of the last solve
+    double flops;                   // for one preconditioned iteration
+    femMonitor *monitor;            // reports of the solve in progress, NULL for none
+};
+
+
+femMultigrid*       femMultigridCreate(femGeo *theGeometry, int nRefinements);
+femMultigrid*       femMultigridCreateAlgebraic();
+void                femMultigridFree(femMultigrid *theMultigrid);
+void                femMultigridAttach(femMultigrid *theMultigrid, femProblem *theProblem);
+void                femMultigridSetup(femMultigrid *theMultigrid, femProblem *theProblem);
+int                 femMultigridSolve(femMultigrid *theMultigrid, const double *B, double *x);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ *  femProfile.h
+ *  Phase level timers and counters for the solver pipeline
+ *
+ */
+
+#ifndef _FEM_PROFILE_H_
+#define _FEM_PROFILE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    FEM_PHASE_IMPORT,
+    FEM_PHASE_READ,
+    FEM_PHASE_SETUP,
+    FEM_PHASE_ASSEMBLY,
+    FEM_PHASE_NEUMANN,
+    FEM_PHASE_CONSTRAIN,
+    FEM_PHASE_FACTOR,
+    FEM_PHASE_SOLVE,
+    FEM_PHASE_FORCES,
+    FEM_PHASE_STRESS,
+    FEM_PHASE_MODAL,
+    FEM_PHASE_OUTPUT,
+    FEM_PHASE_RENDER,
+    FEM_PHASE_COUNT
+} femPhase;
+
+typedef struct {
+    int calls;
+    double seconds;
+    size_t bytes;
+    double flops;
+} femPhaseStats;
+
+
+void                femProfileEnable(int enabled, int trace);
+int                 femProfileEnabled();
+void                femProfileReset();
+double              femProfileTime();
+void                femProfileBegin(femPhase phase);
+void                femProfileEnd(femPhase phase);
+void                femProfileCount(size_t bytes, double flops);
+const char*         femProfileName(femPhase phase);
+femPhaseStats       femProfileStats(femPhase phase);
+void                femProfileReport(FILE *file);
+void                femProfileWriteTrace(const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
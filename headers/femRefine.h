@@ -0,0 +1,31 @@
+/*
+ *  femRefine.h
+ *  Local refinement of triangle meshes by newest vertex bisection
+ *
+ */
+
+#ifndef _FEM_REFINE_H_
+#define _FEM_REFINE_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    int nNodesCoarse, nNodes;
+    int nElemCoarse, nElem;
+    int *parents;                   // the two ends of the edge split by each new node
+} femRefinement;
+
+
+femRefinement*      geoMeshRefineGeo(femGeo *theGeometry, const int *marked);
+void                femRefinementProlongate(femRefinement *theRefinement, int nFields, const double *coarse, double *fine);
+void                femRefinementFree(femRefinement *theRefinement);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ *  femRunner.h
+ *  Parallel scenario runner : many independent elasticity problems on one mesh
+ *
+ */
+
+#ifndef _FEM_RUNNER_H_
+#define _FEM_RUNNER_H_
+
+#include <pthread.h>
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MAXSCENARIOBC 16
+
+typedef struct {
+    char domain[MAXNAME];
+    femBoundaryType type;
+    double value;
+} femScenarioCondition;
+
+typedef struct {
+    char name[MAXNAME];
+    femGeo *geometry;                               // shared between scenarios, never modified (see femRunner.c)
+    double E,nu,rho,g;
+    femElasticCase iCase;
+    femSolverType solverType;                       // FEM_FULL unless femScenarioSetSolver
+    femRenumType renumType;
+    int nConditions;
+    femScenarioCondition conditions[MAXSCENARIOBC];
+    int status;                                     // 0 pending, 1 solved, -1 skipped
+    double *soluce;                                 // 2*nNodes displacements, owned by the scenario
+    double uMax;
+} femScenario;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *tasks;
+    int head, tail;
+} femRunnerQueue;
+
+typedef struct {
+    femScenario *scenarios;
+    int nWorkers;
+    femRunnerQueue *queues;
+    size_t budget, used;
+    pthread_mutex_t memoryLock;
+    pthread_cond_t  memoryFreed;
+} femRunner;
+
+
+void                femScenarioInit(femScenario *theScenario, femGeo *theGeometry,
+                                    double E, double nu, double rho, double g, femElasticCase iCase);
+void                femScenarioSetSolver(femScenario *theScenario, femSolverType solverType, femRenumType renumType);
+void                femScenarioAddCondition(femScenario *theScenario, char *nameDomain, femBoundaryType type, double value);
+size_t              femScenarioMemory(femScenario *theScenario);
+void                femScenarioSolve(femScenario *theScenario);
+void                femScenarioFree(femScenario *theScenario);
+
+void                femRunnerRun(femScenario *theScenarios, int nScenarios, int nWorkers, size_t budget);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
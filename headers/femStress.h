@@ -0,0 +1,40 @@
+/*
+ *  femStress.h
+ *  Strains, stresses, von Mises and principal stresses recovered from the displacements
+ *
+ */
+
+#ifndef _FEM_STRESS_H_
+#define _FEM_STRESS_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femProblem *problem;
+    int nElem, nNodes;
+    int nThreads;
+    double *exx, *eyy, *exy;                        // strains at the center of each element
+    double *sxx, *syy, *sxy;                        // stresses at the center of each element
+    double *vonMises, *s1, *s2;                     // von Mises and in-plane principal stresses
+    double *area;
+    double *nodeSxx, *nodeSyy, *nodeSxy;            // nodal averages weighted by the element areas
+    double *nodeVonMises, *nodeS1, *nodeS2;         // derived from the averaged stresses
+} femStress;
+
+
+femStress*          femStressCreate(femProblem *theProblem, int nThreads);
+void                femStressFree(femStress *theStress);
+void                femStressUpdate(femStress *theStress);
+double              femStressMaxVonMises(femStress *theStress);
+void                femStressNodal(femStress *theStress, double *data);
+void                femStressWrite(femStress *theStress, const char *filename);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+/*
+ *  femSuperelement.h
+ *  Static condensation of a problem onto the dofs of selected domains
+ *
+ */
+
+#ifndef _FEM_SUPERELEMENT_H_
+#define _FEM_SUPERELEMENT_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femProblem *problem;
+    int size;                       // 2*nNodes
+    int nDofs;                      // retained dofs : the free dofs of the selected domains
+    int *dofs;                      // their index 2*node+shift in the natural ordering
+    double *flexibility;            // nDofs x nDofs, displacement of dof i for a unit force on dof j
+    double *base;                   // displacements under the loads of the problem itself
+    double *work;                   // 2*nNodes doubles
+} femSuperelement;
+
+
+femSuperelement*    femSuperelementCreate(femProblem *theProblem, int nDomains, char **nameDomains);
+void                femSuperelementFree(femSuperelement *theSuper);
+void                femSuperelementTraction(femSuperelement *theSuper, char *nameDomain, femBoundaryType type, double value, double *loads);
+void                femSuperelementSolve(femSuperelement *theSuper, const double *loads, double *displacements);
+void                femSuperelementRecover(femSuperelement *theSuper, const double *loads, double *soluce);
+void                femSuperelementStiffness(femSuperelement *theSuper, double *stiffness);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
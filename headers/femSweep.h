@@ -0,0 +1,37 @@
+/*
+ *  femSweep.h
+ *  Linear superposition of unit load cases for load and stiffness sweeps
+ *
+ */
+
+#ifndef _FEM_SWEEP_H_
+#define _FEM_SWEEP_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femProblem *problem;
+    double E;                       // Young's modulus of the unit cases
+    int size;                       // 2*nNodes
+    int nLoads;                     // one unit case per Neumann condition
+    int *conditions;                // index of each of them in problem->conditions
+    double **unit;                  // displacements for a unit value of each Neumann condition
+    double *gravity;                // displacements for rho*g = 1
+    double *dirichlet;              // displacements due to the imposed values alone (independent of E)
+} femSweep;
+
+
+femSweep*           femSweepCreate(femProblem *theProblem);
+void                femSweepFree(femSweep *theSweep);
+void                femSweepCombine(femSweep *theSweep, const double *loads, double rhoG, double E, double *soluce);
+double              femSweepMaxDisplacement(femSweep *theSweep, const double *loads, double rhoG, double E, double *work);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,35 @@
+/*
+ *  femSymmetry.h
+ *  Whole mesh and fields mirrored from a half model, symmetric about x = 0
+ *
+ */
+
+#ifndef _FEM_SYMMETRY_H_
+#define _FEM_SYMMETRY_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femGeo *half;
+    femGeo *geometry;               // the nodes of the half, then the images of those off the axis
+    int nHalf, nNodes;
+    int *source;                    // node of the half behind each node of the whole mesh
+    int *onAxis;                    // TRUE for the nodes of the half on x = 0
+} femSymmetry;
+
+
+femSymmetry*        femSymmetryCreate(femGeo *theHalf);
+void                femSymmetryFree(femSymmetry *theSymmetry);
+void                femSymmetryMirror(femSymmetry *theSymmetry, int nFields, const double *parity,
+                                      const double *half, double *whole);
+void                femSymmetryMirrorForces(femSymmetry *theSymmetry, const double *half, double *whole);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
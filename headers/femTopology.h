@@ -0,0 +1,33 @@
+/*
+ *  femTopology.h
+ *  Adjacency graphs of a mesh, built once and cached on the mesh
+ *
+ */
+
+#ifndef _FEM_TOPOLOGY_H_
+#define _FEM_TOPOLOGY_H_
+
+#include "fem.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct femTopology {
+    int nNodes, nElem, nLocalNode;
+    int *nodeStart, *nodeElem;      // elements around each node, in increasing order
+    int *nodeNodeStart, *nodeNode;  // nodes sharing an element with each node, itself included, in increasing order
+    int *elemElem;                  // neighbour across the edge (j,j+1) of each element, -1 on the boundary
+    int nEdges;
+    int *edgeElem;                  // the (at most two) elements holding each edge of theEdges, -1 for none
+};
+
+
+femTopology*        femMeshTopology(femMesh *theMesh, femMesh *theEdges);
+void                femMeshInvalidate(femMesh *theMesh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
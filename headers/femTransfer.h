@@ -0,0 +1,36 @@
+/*
+ *  femTransfer.h
+ *  Transfer of nodal fields from one mesh to another by point location
+ *
+ */
+
+#ifndef _FEM_TRANSFER_H_
+#define _FEM_TRANSFER_H_
+
+#include "fem.h"
+#include "femLocator.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    femNodes nodes;                 // copy of the source mesh
+    femMesh mesh;
+    femLocator *locator;
+    int nFields;
+    double *values;                 // nFields values per node
+} femTransfer;
+
+
+femTransfer*        femTransferCreate(femMesh *theMesh, int nFields, const double *values);
+void                femTransferFree(femTransfer *theTransfer);
+void                femTransferEvaluate(femTransfer *theTransfer, double x, double y, double *values);
+void                femTransferInterpolate(femTransfer *theTransfer, femNodes *theNodes, double *values);
+void                femTransferWarmStart(femTransfer *theTransfer, femProblem *theProblem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
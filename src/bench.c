@@ -0,0 +1,232 @@
+/*
+*
+*   BENCHMARK SUITE : HEADLESS PIPELINE OVER THE MESH PRESETS AND SOLVER BACKENDS
+*
+*   For the closed carabiner meshed with --rough, default, --medium, --fine and --tiny,
+*   and for the stored data/mesh.txt, every backend solves the same problem. Phase
+*   timings come from femProfile, the maximum displacement is checked against the
+*   reference file (data/bench_reference.txt) and everything is written as JSON.
+*   A mesh without a line in the reference file is reported as "no-reference" : its
+*   first backend is then the reference of the others, until --update-reference
+*   writes one for it. The geometric multigrid solves on the bisected mesh, which has
+*   a reference of its own (<mesh>-bisected).
+*
+*     ./monBench [--output bench_results.json] [--reference file] [--update-reference]
+*                [--only name] [--stored-only]
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../headers/fem.h"
+#include "../headers/femMultigrid.h"
+
+#define TRUE 1
+#define FALSE 0
+#define MAXCASES 16
+
+// the dense system is skipped above this number of unknowns (8 * size^2 bytes)
+#define BENCH_FULL_MAXSIZE 8000
+#define BENCH_TOLERANCE 1e-6
+
+typedef struct {
+    const char *name;
+    double h;                   // 0 for the stored mesh
+} benchMesh;
+
+static const benchMesh theBenchMeshes[] = {
+    {"rough", 1.0}, {"default", 0.5}, {"medium", 0.4}, {"fine", 0.2}, {"tiny", 0.15}, {"stored", 0.0} };
+static const int nBenchMeshes = sizeof(theBenchMeshes) / sizeof(benchMesh);
+
+typedef struct {
+    const char *name;
+    femSolverType solverType;
+    femPrecision precision;
+    int bisections;             // levels of the geometric multigrid, 0 for the other backends
+} benchSolver;
+
+// the geometric multigrid refines the mesh it is built on : it has to come last
+static const benchSolver theBenchSolvers[] = {
+    {"full", FEM_FULL, FEM_DOUBLE, 0}, {"band", FEM_BAND, FEM_DOUBLE, 0}, {"mixed", FEM_BAND, FEM_MIXED, 0},
+    {"amg", FEM_MULTIGRID, FEM_DOUBLE, 0}, {"mg", FEM_MULTIGRID, FEM_DOUBLE, 1} };
+static const int nBenchSolvers = sizeof(theBenchSolvers) / sizeof(benchSolver);
+
+typedef struct {
+    char name[MAXNAME];
+    double umax;
+} benchReference;
+
+static benchReference theReferences[MAXCASES];
+static int nReferences = 0;
+static int nStoredReferences = 0;           // read from the file, the others come from a first backend
+static int theUpdate = FALSE;
+static int nMissing = 0;                    // cases reported as no-reference
+
+
+static void benchReadReferences(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (!file) return;
+    while (nReferences < MAXCASES &&
+           fscanf(file, "%255s %le", theReferences[nReferences].name, &theReferences[nReferences].umax) == 2)
+        nReferences++;
+    nStoredReferences = nReferences;
+    fclose(file);
+}
+
+static benchReference *benchFindReference(const char *name) {
+    for (int i = 0; i < nReferences; i++)
+        if (strcmp(theReferences[i].name, name) == 0) return &theReferences[i];
+    return NULL;
+}
+
+// same preprocessing as run.c : gmsh mesh of the closed carabiner, cleaned by fixmesh.py
+static void benchMeshPreset(femGeo *theGeometry, double h) {
+    int ierr;
+    gmshClear(&ierr);                   ErrorGmsh(ierr);
+    gmshModelAdd("MyGeometry", &ierr);  ErrorGmsh(ierr);
+    theGeometry->h = h;
+    theGeometry->elementType = FEM_TRIANGLE;
+    geoMeshGenerateClosedGeo(theGeometry);
+    geoMeshImportGeo(theGeometry);
+    geoMeshWriteGeo(theGeometry, "data/mesh_raw.txt");
+    geoFinalizeGeo(theGeometry);
+    if (system(".venv/bin/python src/fixmesh.py data/mesh_raw.txt data/mesh_fixed.txt") != 0)
+        Error("fixmesh.py failed, is the .venv set up ?");
+    geoMeshReadGeo(theGeometry, "data/mesh_fixed.txt");
+    geoSetDomainNameGeo(theGeometry, 12, "Bottom Contact Surface");
+    geoSetDomainNameGeo(theGeometry, 13, "Top Contact Surface");
+}
+
+// one solve with the profiler running, the JSON record is appended to the output
+// returns FALSE on a regression
+static int benchCase(FILE *out, int first, const char *coarseName, femGeo *theGeometry, int iSolver) {
+    const benchSolver *theSolver = &theBenchSolvers[iSolver];
+    char meshName[MAXNAME];
+    snprintf(meshName, MAXNAME, theSolver->bisections > 0 ? "%s-bisected" : "%s", coarseName);
+    int size = 2*theGeometry->theNodes->nNodes;
+    if (theSolver->solverType == FEM_FULL && size > BENCH_FULL_MAXSIZE) {
+        fprintf(out, "%s    {\"mesh\": \"%s\", \"backend\": \"%s\", \"nodes\": %d, \"elements\": %d, \"status\": \"skipped\"}",
+                first ? "" : ",\n", meshName, theSolver->name, theGeometry->theNodes->nNodes, theGeometry->theElements->nElem);
+        printf("Bench   : %-16s %-5s skipped (%d unknowns)\n", meshName, theSolver->name, size);
+        return TRUE; }
+
+    femProfileReset();
+    femMemoryResetPeak();
+    double t0 = femProfileTime();
+    femMultigrid *theMultigrid = NULL;
+    if (theSolver->bisections > 0) theMultigrid = femMultigridCreate(theGeometry, theSolver->bisections);
+    femProblem *theProblem = femElasticityCreateSolver(theGeometry, 68e9, 0.32, 2.71e3, -9.81, PLANAR_STRESS,
+                                                       theSolver->solverType, FEM_YNUM);
+    if (theMultigrid) femMultigridAttach(theMultigrid, theProblem);
+    femElasticitySetPrecision(theProblem, theSolver->precision);
+    // x is also fixed on the bottom surface, otherwise the horizontal translation is free
+    femElasticityAddBoundaryCondition(theProblem, "Bottom Contact Surface", DIRICHLET_Y, 0.0);
+    femElasticityAddBoundaryCondition(theProblem, "Bottom Contact Surface", DIRICHLET_X, 0.0);
+    femElasticityAddBoundaryCondition(theProblem, "Top Contact Surface", NEUMANN_Y, 5e6);
+    double *theSoluce = femElasticitySolve(theProblem);
+    double *theForces = femElasticityForces(theProblem);
+    femSolutionWrite(theGeometry->theNodes->nNodes, 2, theSoluce, "data/bench_displacements.txt");
+    double total = femProfileTime() - t0;
+
+    double umax = 0.0, fy = 0.0;
+    for (int i = 0; i < theGeometry->theNodes->nNodes; i++) {
+        umax = fmax(umax, sqrt(theSoluce[2*i]*theSoluce[2*i] + theSoluce[2*i+1]*theSoluce[2*i+1]));
+        fy += theForces[2*i+1]; }
+    femElasticityFree(theProblem);
+
+    // without a stored reference the first backend becomes the one the others are checked against
+    benchReference *theReference = benchFindReference(meshName);
+    int missing = FALSE;
+    if (!theReference) {
+        if (nReferences == MAXCASES) Error("Too many bench meshes for the references");
+        snprintf(theReferences[nReferences].name, MAXNAME, "%s", meshName);
+        theReferences[nReferences].umax = umax;
+        theReference = &theReferences[nReferences++];
+        missing = !theUpdate;
+        if (missing) {
+            nMissing++;
+            printf("Bench   : no reference for the mesh %s, run with --update-reference\n", meshName); }}
+    int stored = (theReference - theReferences) < nStoredReferences;
+    double error = fabs(umax - theReference->umax) / fmax(fabs(theReference->umax), 1e-300);
+    int pass = (error <= BENCH_TOLERANCE);
+
+    fprintf(out, "%s    {\"mesh\": \"%s\", \"backend\": \"%s\", \"nodes\": %d, \"elements\": %d",
+            first ? "" : ",\n", meshName, theSolver->name, theGeometry->theNodes->nNodes, theGeometry->theElements->nElem);
+    fprintf(out, ", \"status\": \"%s\", \"umax\": %.15e, \"reaction_y\": %.15e", missing ? "no-reference" : "ok", umax, fy);
+    fprintf(out, ", \"reference\": %.15e, \"reference_stored\": %s, \"relative_error\": %.3e",
+            theReference->umax, stored ? "true" : "false", error);
+    fprintf(out, ", \"pass\": %s, \"total_ms\": %.3f, \"memory_peak\": %zu, \"phases\": {", pass ? "true" : "false",
+            1e3 * total, femMemoryPeak());
+    int firstPhase = TRUE;
+    for (int i = 0; i < FEM_PHASE_COUNT; i++) {
+        femPhaseStats theStat = femProfileStats(i);
+        if (theStat.calls == 0) continue;
+        fprintf(out, "%s\"%s\": {\"calls\": %d, \"ms\": %.3f, \"bytes\": %zu, \"flops\": %.6e}",
+                firstPhase ? "" : ", ", femProfileName(i), theStat.calls, 1e3 * theStat.seconds,
+                theStat.bytes, theStat.flops);
+        firstPhase = FALSE; }
+    fprintf(out, "}}");
+
+    printf("Bench   : %-16s %-5s %8d nodes %12.3f ms  umax = %14.7e  %s\n", meshName, theSolver->name,
+           theGeometry->theNodes->nNodes, 1e3 * total, umax, missing ? "no reference" : (pass ? "ok" : "REGRESSION"));
+    return pass;
+}
+
+int main(int argc, char* argv[]) {
+    const char *outputFilePath = "bench_results.json";
+    const char *referenceFilePath = "data/bench_reference.txt";
+    const char *only = NULL;
+    int update = FALSE, storedOnly = FALSE;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0 && i+1 < argc) outputFilePath = argv[++i];
+        if (strcmp(argv[i], "--reference") == 0 && i+1 < argc) referenceFilePath = argv[++i];
+        if (strcmp(argv[i], "--only") == 0 && i+1 < argc) only = argv[++i];
+        if (strcmp(argv[i], "--update-reference") == 0) update = theUpdate = TRUE;
+        if (strcmp(argv[i], "--stored-only") == 0) storedOnly = TRUE;
+    }
+    if (!update) benchReadReferences(referenceFilePath);
+
+    FILE *out = fopen(outputFilePath, "w");
+    if (!out) {
+        printf("Error! Unable to open file at %s\n", outputFilePath);
+        exit(-1); }
+    char host[MAXNAME] = "unknown";
+    gethostname(host, MAXNAME);
+    fprintf(out, "{\n  \"timestamp\": %ld,\n  \"host\": \"%s\",\n  \"tolerance\": %g,\n  \"cases\": [\n",
+            (long) time(NULL), host, BENCH_TOLERANCE);
+
+    femProfileEnable(TRUE, FALSE);
+    if (!storedOnly) geoInitialize();
+    femGeo *theGeometry = geoCreate();
+    int first = TRUE, failures = 0;
+    for (int iMesh = 0; iMesh < nBenchMeshes; iMesh++) {
+        const benchMesh *theMesh = &theBenchMeshes[iMesh];
+        if (only && strcmp(only, theMesh->name) != 0) continue;
+        if (theMesh->h == 0.0) geoMeshReadGeo(theGeometry, "data/mesh.txt");
+        else if (storedOnly) continue;
+        else benchMeshPreset(theGeometry, theMesh->h);
+        for (int iSolver = 0; iSolver < nBenchSolvers; iSolver++) {
+            failures += !benchCase(out, first, theMesh->name, theGeometry, iSolver);
+            first = FALSE; }
+        geoFinalizeGeo(theGeometry); }
+    fprintf(out, "\n  ]\n}\n");
+    fclose(out);
+    geoFree(theGeometry);
+    if (!storedOnly) geoFinalize();
+
+    if (update) {
+        FILE *file = fopen(referenceFilePath, "w");
+        if (!file) Error("Cannot write the reference file");
+        for (int i = 0; i < nReferences; i++)
+            fprintf(file, "%s %.15e\n", theReferences[i].name, theReferences[i].umax);
+        fclose(file);
+        printf("Bench   : references written to %s\n", referenceFilePath); }
+
+    printf("Bench   : results written to %s, %d regression(s), %d case(s) without a reference\n",
+           outputFilePath, failures, nMissing);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
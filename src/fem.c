@@ -8,66 +8,142 @@
  */
 
 #include "../headers/fem.h"
+#include "../headers/femMultigrid.h"
+#include "../headers/femMonitor.h"
+#include "../headers/femTopology.h"
+#include "../headers/femFactors.h"
+#include "../headers/femIntegrals.h"
 #include <ctype.h>
+#include <float.h>
 
+#define FEM_MIXED_STEPS 30
 
-femGeo theGeometry;
 
-femGeo *geoGetGeometry(void) { // return a pointer to the geometry structure
+static femGeo theGeometry;
+
+femGeo *geoGetGeometry(void) { // return a pointer to the default geometry structure
     return &theGeometry;
 }
 
 double geoSizeDefault(double x, double y) { // return the global mesh size
+    (void) x; (void) y;
     return theGeometry.h;
 }
 
 double geoGmshSize(int dim, int tag, double x, double y, double z, double lc, void *data) { // return size of the mesh
-    return theGeometry.geoSize(x, y);
+    (void) dim; (void) tag; (void) z; (void) lc;
+    femGeo *theGeometry = data;
+    if (theGeometry->geoSize == geoSizeDefault)
+        return theGeometry->h;
+    return theGeometry->geoSize(x, y);
+}
+
+void geoSetSizeCallback(double (*geoSize)(double x, double y)) {
+    theGeometry.geoSize = geoSize;
+}
+
+// reset a geometry structure to an empty one
+static void geoClear(femGeo *theGeometry) {
+    theGeometry->geoSize = geoSizeDefault;
+    theGeometry->theNodes = NULL;
+    theGeometry->theElements = NULL;
+    theGeometry->theEdges = NULL;
+    theGeometry->nDomains = 0;
+    theGeometry->theDomains = NULL;
+    theGeometry->nRefinements = 0;
+}
+
+// arena holding the mesh data, created on first use for the default geometry
+femArena *geoArena(femGeo *theGeometry) {
+    if (theGeometry->arena == NULL)
+        theGeometry->arena = femArenaCreate(FEM_MEM_MESH);
+    return theGeometry->arena;
+}
+
+// allocate an empty geometry, independent of the default one
+femGeo *geoCreate(void) {
+    femGeo *theGeometry = femMalloc(FEM_MEM_MESH, sizeof(femGeo));
+    theGeometry->arena = femArenaCreate(FEM_MEM_MESH);
+    theGeometry->LxPlate = 0.0;
+    theGeometry->LyPlate = 0.0;
+    theGeometry->h = 0.0;
+    theGeometry->elementType = FEM_TRIANGLE;
+    geoClear(theGeometry);
+    return theGeometry;
 }
 
 void geoInitialize(void) { // ititialize the an empty geometry structure
     int ierr;
-    theGeometry.geoSize = geoSizeDefault;
+    geoClear(&theGeometry);
     gmshInitialize(0, NULL, 1, 0, &ierr);
     ErrorGmsh(ierr);
     gmshModelAdd("MyGeometry", &ierr);
     ErrorGmsh(ierr);
-    gmshModelMeshSetSizeCallback(geoGmshSize, NULL, &ierr);
+    gmshModelMeshSetSizeCallback(geoGmshSize, &theGeometry, &ierr);
     ErrorGmsh(ierr);
-    theGeometry.theNodes = NULL;
-    theGeometry.theElements = NULL;
-    theGeometry.theEdges = NULL;
-    theGeometry.nDomains = 0;
-    theGeometry.theDomains = NULL;
 }
 
+// the graphs of the meshes of a geometry are dropped before the meshes are replaced
+static void geoMeshInvalidate(femGeo *theGeometry)
+{
+    if (theGeometry->theElements) femMeshInvalidate(theGeometry->theElements);
+    if (theGeometry->theEdges) femMeshInvalidate(theGeometry->theEdges);
+}
 
+// release the mesh data of a geometry, the structure itself can be filled again
+// all the mesh data lives in the arena of the geometry, dropped at once
+void geoFinalizeGeo(femGeo *theGeometry)
+{
+    geoMeshInvalidate(theGeometry);
+    if (theGeometry->arena) femArenaReset(theGeometry->arena);
+    geoClear(theGeometry);
+}
 
+// bytes held by the mesh data of a geometry
+size_t geoMeshMemory(femGeo *theGeometry)
+{
+    size_t bytes = 0;
+    if (theGeometry->theNodes)
+        bytes += sizeof(femNodes) + 2*sizeof(double) * theGeometry->theNodes->nNodes;
+    if (theGeometry->theElements)
+        bytes += sizeof(femMesh) + sizeof(int) * theGeometry->theElements->nLocalNode * theGeometry->theElements->nElem;
+    if (theGeometry->theEdges)
+        bytes += sizeof(femMesh) + sizeof(int) * 2 * theGeometry->theEdges->nElem;
+    for (int i=0; i < theGeometry->nDomains; i++)
+        bytes += sizeof(femDomain*) + sizeof(femDomain) + sizeof(int) * 2 * theGeometry->theDomains[i]->nElem;
+    return bytes;
+}
+
+// release a geometry obtained with geoCreate
+void geoFree(femGeo *theGeometry)
+{
+    geoFinalizeGeo(theGeometry);
+    femArenaFree(theGeometry->arena);
+    femFree(theGeometry);
+}
 
 void geoFinalize() 
 {
     int ierr;
-    
-    if (theGeometry.theNodes) {
-        free(theGeometry.theNodes->X);
-        free(theGeometry.theNodes->Y);
-        free(theGeometry.theNodes); }
-    if (theGeometry.theElements) {
-        free(theGeometry.theElements->elem);
-        free(theGeometry.theElements); }
-    if (theGeometry.theEdges) {
-        free(theGeometry.theEdges->elem);
-        free(theGeometry.theEdges); }
-    for (int i=0; i < theGeometry.nDomains; i++) {
-        free(theGeometry.theDomains[i]->elem);
-        free(theGeometry.theDomains[i]);  }
-    free(theGeometry.theDomains);
+    geoFinalizeGeo(&theGeometry);
+    femArenaFree(theGeometry.arena);
+    theGeometry.arena = NULL;
     gmshFinalize(&ierr); ErrorGmsh(ierr);
 }
 
+// drop the mesh and the gmsh model of the default geometry to generate a new mesh, the size callback is kept
+void geoMeshReset() 
+{
+    int ierr;
+    double (*geoSize)(double x, double y) = theGeometry.geoSize;
+    geoFinalizeGeo(&theGeometry);
+    theGeometry.geoSize = geoSize;
+    gmshClear(&ierr); ErrorGmsh(ierr);
+    gmshModelAdd("MyGeometry", &ierr); ErrorGmsh(ierr);
+}
+
 // carabiner open
-void geoMeshGenerateOpen() {
-    femGeo* theGeometry = geoGetGeometry();
+void geoMeshGenerateOpenGeo(femGeo *theGeometry) {
 
     // double w = theGeometry->LxPlate;
     // double h = theGeometry->LyPlate;
@@ -80,13 +156,10 @@ void geoMeshGenerateOpen() {
 
     double z = 0.0; // z component
     double pointMeshSize = 1.0;
-    
-    double radiusBO = 4.0; // big outer
-    double radiusSO = 2.0; // small outer
 
     // creating all the points
-    int idCenterS = gmshModelOccAddPoint(centerSx, centerSy, z, pointMeshSize, 1, &ierr); 
-    int idCenterB = gmshModelOccAddPoint(centerBx, centerBy, z, pointMeshSize, 2, &ierr);
+    gmshModelOccAddPoint(centerSx, centerSy, z, pointMeshSize, 1, &ierr); 
+    gmshModelOccAddPoint(centerBx, centerBy, z, pointMeshSize, 2, &ierr);
 
     gmshModelOccAddPoint(-1.2, 0.0, z, pointMeshSize, 3, &ierr);
     gmshModelOccAddPoint(-0.2, 0.0, z, pointMeshSize, 4, &ierr);
@@ -148,6 +221,9 @@ void geoMeshGenerateOpen() {
     
     gmshModelOccSynchronize(&ierr);
 
+    gmshModelMeshSetSizeCallback(geoGmshSize, theGeometry, &ierr);
+    ErrorGmsh(ierr);
+
     if (theGeometry->elementType == FEM_QUAD) {
         gmshOptionSetNumber("Mesh.SaveAll",1,&ierr);
         gmshOptionSetNumber("Mesh.RecombineAll",1,&ierr);
@@ -165,8 +241,7 @@ void geoMeshGenerateOpen() {
 }
 
 // carabiner closed
-void geoMeshGenerateClosed() {
-    femGeo* theGeometry = geoGetGeometry();
+void geoMeshGenerateClosedGeo(femGeo *theGeometry) {
 
     // double w = theGeometry->LxPlate;
     // double h = theGeometry->LyPlate;
@@ -179,13 +254,10 @@ void geoMeshGenerateClosed() {
 
     double z = 0.0; // z component
     double pointMeshSize = 1.0;
-    
-    double radiusBO = 4.0; // big outer
-    double radiusSO = 2.0; // small outer
 
     // creating all the points
-    int idCenterS = gmshModelOccAddPoint(centerSx, centerSy, z, pointMeshSize, 1, &ierr); 
-    int idCenterB = gmshModelOccAddPoint(centerBx, centerBy, z, pointMeshSize, 2, &ierr);
+    gmshModelOccAddPoint(centerSx, centerSy, z, pointMeshSize, 1, &ierr); 
+    gmshModelOccAddPoint(centerBx, centerBy, z, pointMeshSize, 2, &ierr);
 
     gmshModelOccAddPoint(-0.2, 0.0, z, pointMeshSize, 4, &ierr);
     gmshModelOccAddPoint(-1.2, 0.0, z, pointMeshSize, 3, &ierr);
@@ -232,10 +304,74 @@ void geoMeshGenerateClosed() {
 
     // creating the surface
     int surface_tags[] = {idLoopO, idLoopI};
-    int idSurface = gmshModelOccAddPlaneSurface(surface_tags, 2, 37, &ierr);
+    gmshModelOccAddPlaneSurface(surface_tags, 2, 37, &ierr);
 
     gmshModelOccSynchronize(&ierr);
 
+    gmshModelMeshSetSizeCallback(geoGmshSize, theGeometry, &ierr);
+    ErrorGmsh(ierr);
+
+    if (theGeometry->elementType == FEM_QUAD) {
+        gmshOptionSetNumber("Mesh.SaveAll",1,&ierr);
+        gmshOptionSetNumber("Mesh.RecombineAll",1,&ierr);
+        gmshOptionSetNumber("Mesh.Algorithm",11,&ierr);  
+        gmshOptionSetNumber("Mesh.SmoothRatio", 21.5, &ierr);  
+        gmshOptionSetNumber("Mesh.RecombinationAlgorithm",1.0,&ierr); 
+        gmshModelGeoMeshSetRecombine(2,1,45,&ierr);  
+        gmshModelMeshGenerate(2,&ierr);  }
+  
+    if (theGeometry->elementType == FEM_TRIANGLE) {
+        gmshOptionSetNumber("Mesh.SaveAll",1,&ierr);
+        gmshModelMeshGenerate(2,&ierr);}
+
+    return;
+}
+
+// right half (x >= 0) of the closed carabiner, which is symmetric about x = 0
+// the curves are numbered so that the entities are, in order : outer arc at the bottom, outer line,
+// outer arc at the top, cut at the top, half of the top contact, inner arc at the top, inner line,
+// inner arc at the bottom, half of the bottom contact, cut at the bottom
+void geoMeshGenerateHalfGeo(femGeo *theGeometry) {
+
+    int ierr;
+    double z = 0.0;
+    double pointMeshSize = 1.0;
+
+    gmshModelOccAddPoint(0.0, 0.0, z, pointMeshSize, 1, &ierr);
+    gmshModelOccAddPoint(0.0, 8.0, z, pointMeshSize, 2, &ierr);
+    gmshModelOccAddPoint(0.2, -1.0, z, pointMeshSize, 6, &ierr);
+    gmshModelOccAddPoint(0.2, 0.0, z, pointMeshSize, 7, &ierr);
+    gmshModelOccAddPoint(1.2, 0.0, z, pointMeshSize, 8, &ierr);
+    gmshModelOccAddPoint(0.0, -2.0, z, pointMeshSize, 9, &ierr);
+    gmshModelOccAddPoint(2.0, 0.0, z, pointMeshSize, 10, &ierr);
+    gmshModelOccAddPoint(0.2, 10.8, z, pointMeshSize, 15, &ierr);
+    gmshModelOccAddPoint(0.2, 8.0, z, pointMeshSize, 16, &ierr);
+    gmshModelOccAddPoint(3.0, 8.0, z, pointMeshSize, 17, &ierr);
+    gmshModelOccAddPoint(4.0, 8.0, z, pointMeshSize, 18, &ierr);
+    gmshModelOccAddPoint(0.0, 12.0, z, pointMeshSize, 19, &ierr);
+    gmshModelOccAddPoint(0.0, -1.0, z, pointMeshSize, 21, &ierr);
+    gmshModelOccAddPoint(0.0, 10.8, z, pointMeshSize, 22, &ierr);
+
+    int idArc1  = gmshModelOccAddCircleArc(9, 1, 10, 21, TRUE, &ierr);
+    int idLine2 = gmshModelOccAddLine(10, 18, 22, &ierr);
+    int idArc3  = gmshModelOccAddCircleArc(18, 2, 19, 23, TRUE, &ierr);
+    int idCut4  = gmshModelOccAddLine(19, 22, 24, &ierr);
+    int idLine5 = gmshModelOccAddLine(22, 15, 25, &ierr);
+    int idArc6  = gmshModelOccAddCircleArc(15, 16, 17, 26, TRUE, &ierr);
+    int idLine7 = gmshModelOccAddLine(17, 8, 27, &ierr);
+    int idArc8  = gmshModelOccAddCircleArc(6, 7, 8, 28, TRUE, &ierr);
+    int idLine9 = gmshModelOccAddLine(6, 21, 29, &ierr);
+    int idCut10 = gmshModelOccAddLine(21, 9, 30, &ierr);
+
+    int loop_tags[] = {idArc1, idLine2, idArc3, idCut4, idLine5, idArc6, idLine7, idArc8, idLine9, idCut10};
+    int idLoop = gmshModelOccAddCurveLoop(loop_tags, 10, 31, &ierr);
+    gmshModelOccAddPlaneSurface(&idLoop, 1, 32, &ierr);
+
+    gmshModelOccSynchronize(&ierr);
+
+    gmshModelMeshSetSizeCallback(geoGmshSize, theGeometry, &ierr);
+    ErrorGmsh(ierr);
+
     if (theGeometry->elementType == FEM_QUAD) {
         gmshOptionSetNumber("Mesh.SaveAll",1,&ierr);
         gmshOptionSetNumber("Mesh.RecombineAll",1,&ierr);
@@ -325,7 +461,7 @@ void geoMeshGenerateClosed() {
 //     return;
 // }
 
-void geoMeshImport(void) { // import the mesh into the geometry structure
+void geoMeshImportGeo(femGeo *theGeometry) { // import the gmsh mesh into the given geometry structure
     
     // HERE I COULD ADD SOME CODE TO CLEAN UP THE MESH BEFORE PUTTING IT INTO THE STRUCTURE
     // LIKE REMOVING UNUSED NODES AND EDGES 
@@ -333,6 +469,9 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
     // THIS WILL DO FOR NOW TO KEEP IT SIMPLE
     
     int ierr;
+    femArena *theArena = geoArena(theGeometry);
+    geoMeshInvalidate(theGeometry);
+    femProfileBegin(FEM_PHASE_IMPORT);
     
     /* Importing nodes */
     
@@ -340,18 +479,18 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
     double *xyz,*trash;
     gmshModelMeshGetNodes(&node,&nNode,&xyz,&n,
                          &trash,&m,-1,-1,0,0,&ierr);          ErrorGmsh(ierr);                         
-    femNodes *theNodes = malloc(sizeof(femNodes));
+    femNodes *theNodes = femArenaAlloc(theArena, sizeof(femNodes));
     theNodes->nNodes = nNode;
-    theNodes->X = malloc(sizeof(double)*(theNodes->nNodes));
-    theNodes->Y = malloc(sizeof(double)*(theNodes->nNodes));
+    theNodes->X = femArenaAlloc(theArena, sizeof(double)*(theNodes->nNodes));
+    theNodes->Y = femArenaAlloc(theArena, sizeof(double)*(theNodes->nNodes));
     for (int i = 0; i < theNodes->nNodes; i++){
         theNodes->X[i] = xyz[3*node[i]-3];
         theNodes->Y[i] = xyz[3*node[i]-2]; }
-    theGeometry.theNodes = theNodes;
+    theGeometry->theNodes = theNodes;
     gmshFree(node);
     gmshFree(xyz);
     gmshFree(trash);
-    printf("Geo     : Importing %d nodes \n",theGeometry.theNodes->nNodes);
+    printf("Geo     : Importing %d nodes \n",theGeometry->theNodes->nNodes);
        
     /* Importing elements */
     /* Pas super joli : a ameliorer pour eviter la triple copie */
@@ -359,15 +498,16 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
     size_t nElem, *elem;
     gmshModelMeshGetElementsByType(1,&elem,&nElem,
                                &node,&nNode,-1,0,1,&ierr);    ErrorGmsh(ierr);
-    femMesh *theEdges = malloc(sizeof(femMesh));
+    femMesh *theEdges = femArenaAlloc(theArena, sizeof(femMesh));
     theEdges->nLocalNode = 2;
     theEdges->nodes = theNodes;
+    theEdges->topology = NULL;
     theEdges->nElem = nElem;  
-    theEdges->elem = malloc(sizeof(int)*2*theEdges->nElem);
+    theEdges->elem = femArenaAlloc(theArena, sizeof(int)*2*theEdges->nElem);
     for (int i = 0; i < theEdges->nElem; i++)
         for (int j = 0; j < theEdges->nLocalNode; j++)
             theEdges->elem[2*i+j] = node[2*i+j]-1;  
-    theGeometry.theEdges = theEdges;
+    theGeometry->theEdges = theEdges;
     int shiftEdges = elem[0];
     gmshFree(node);
     gmshFree(elem);
@@ -376,15 +516,16 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
     gmshModelMeshGetElementsByType(2,&elem,&nElem,
                                &node,&nNode,-1,0,1,&ierr);    ErrorGmsh(ierr);
     if (nElem != 0) {
-      femMesh *theElements = malloc(sizeof(femMesh));
+      femMesh *theElements = femArenaAlloc(theArena, sizeof(femMesh));
       theElements->nLocalNode = 3;
       theElements->nodes = theNodes;
+      theElements->topology = NULL;
       theElements->nElem = nElem;  
-      theElements->elem = malloc(sizeof(int)*3*theElements->nElem);
+      theElements->elem = femArenaAlloc(theArena, sizeof(int)*3*theElements->nElem);
       for (int i = 0; i < theElements->nElem; i++)
           for (int j = 0; j < theElements->nLocalNode; j++)
               theElements->elem[3*i+j] = node[3*i+j]-1;  
-      theGeometry.theElements = theElements;
+      theGeometry->theElements = theElements;
       gmshFree(node);
       gmshFree(elem);
       printf("Geo     : Importing %d triangles \n",theElements->nElem); }
@@ -396,15 +537,16 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
       Error("Cannot consider hybrid geometry with triangles and quads :-(");                       
                                
     if (nElem != 0) {
-      femMesh *theElements = malloc(sizeof(femMesh));
+      femMesh *theElements = femArenaAlloc(theArena, sizeof(femMesh));
       theElements->nLocalNode = 4;
       theElements->nodes = theNodes;
+      theElements->topology = NULL;
       theElements->nElem = nElem;  
-      theElements->elem = malloc(sizeof(int)*4*theElements->nElem);
+      theElements->elem = femArenaAlloc(theArena, sizeof(int)*4*theElements->nElem);
       for (int i = 0; i < theElements->nElem; i++)
           for (int j = 0; j < theElements->nLocalNode; j++)
               theElements->elem[4*i+j] = node[4*i+j]-1;  
-      theGeometry.theElements = theElements;
+      theGeometry->theElements = theElements;
       gmshFree(node);
       gmshFree(elem);
       printf("Geo     : Importing %d quads \n",theElements->nElem); }
@@ -414,16 +556,16 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
   
     int *dimTags;
     gmshModelGetEntities(&dimTags,&n,1,&ierr);        ErrorGmsh(ierr);
-    theGeometry.nDomains = n/2;
-    theGeometry.theDomains = malloc(sizeof(femDomain*)*n/2);
-    printf("Geo     : Importing %d entities \n",theGeometry.nDomains);
-    printf("\nNumber of domains: %d\n", theGeometry.nDomains);
+    theGeometry->nDomains = n/2;
+    theGeometry->theDomains = femArenaAlloc(theArena, sizeof(femDomain*)*n/2);
+    printf("Geo     : Importing %d entities \n",theGeometry->nDomains);
+    printf("\nNumber of domains: %d\n", theGeometry->nDomains);
 
-    for (int i=0; i < n/2; i++) {
+    for (int i=0; i < (int) (n/2); i++) {
         int dim = dimTags[2*i+0];
         int tag = dimTags[2*i+1];
-        femDomain *theDomain = malloc(sizeof(femDomain)); 
-        theGeometry.theDomains[i] = theDomain;
+        femDomain *theDomain = femArenaAlloc(theArena, sizeof(femDomain)); 
+        theGeometry->theDomains[i] = theDomain;
         theDomain->mesh = theEdges;
         sprintf(theDomain->name, "Entity %d ",tag-1);
          
@@ -431,7 +573,7 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
         size_t nElementType, **elementTags, *nElementTags, nnElementTags, **nodesTags, *nNodesTags, nnNodesTags; 
         gmshModelMeshGetElements(&elementType, &nElementType, &elementTags, &nElementTags, &nnElementTags, &nodesTags, &nNodesTags, &nnNodesTags, dim, tag, &ierr);
         theDomain->nElem = nElementTags[0];
-        theDomain->elem = malloc(sizeof(int)*2*theDomain->nElem); 
+        theDomain->elem = femArenaAlloc(theArena, sizeof(int)*2*theDomain->nElem); 
         for (int j = 0; j < theDomain->nElem; j++) {
             theDomain->elem[j] = elementTags[0][j] - shiftEdges; }
         printf("Geo     : Entity %d : %d elements \n",i,theDomain->nElem);
@@ -443,6 +585,7 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
         printf(">> Done with domain n°%d\n",i);
     }
     gmshFree(dimTags);
+    femProfileEnd(FEM_PHASE_IMPORT);
  
     printf("\n>> geoMeshImport() finished importing raw mesh\n");
     return;
@@ -450,27 +593,28 @@ void geoMeshImport(void) { // import the mesh into the geometry structure
 }
 
 // write the geometry data into the provided file in human readable format
-void geoMeshWrite(const char *filename) {
+void geoMeshWriteGeo(femGeo *theGeometry, const char *filename) {
     FILE* file = fopen(filename,"w");
     if (!file) {
         printf("Error! Unable to open file at %s\n", filename);
         exit(-1);
     }
+    femProfileBegin(FEM_PHASE_OUTPUT);
 
-    femNodes *theNodes = theGeometry.theNodes;
+    femNodes *theNodes = theGeometry->theNodes;
     fprintf(file, "Number of nodes %d \n", theNodes->nNodes);
     for (int i = 0; i < theNodes->nNodes; i++) {
         fprintf(file,"%6d : %14.7e %14.7e \n",i,theNodes->X[i],theNodes->Y[i]);
     }
     
-    femMesh *theEdges = theGeometry.theEdges;
+    femMesh *theEdges = theGeometry->theEdges;
     fprintf(file,"Number of edges %d \n", theEdges->nElem);
     int *elem = theEdges->elem;
     for (int i = 0; i < theEdges->nElem; i++) {
         fprintf(file,"%6d : %6d %6d \n",i,elem[2*i],elem[2*i+1]);
     }
     
-    femMesh *theElements = theGeometry.theElements;
+    femMesh *theElements = theGeometry->theElements;
     if (theElements->nLocalNode == 3) {
         fprintf(file,"Number of triangles %d \n", theElements->nElem);
         elem = theElements->elem;
@@ -486,10 +630,10 @@ void geoMeshWrite(const char *filename) {
         }
     }
     
-    int nDomains = theGeometry.nDomains;
+    int nDomains = theGeometry->nDomains;
     fprintf(file,"Number of domains %d\n", nDomains);
     for (int iDomain = 0; iDomain < nDomains; iDomain++) {
-        femDomain *theDomain = theGeometry.theDomains[iDomain];
+        femDomain *theDomain = theGeometry->theDomains[iDomain];
         fprintf(file,"  Domain : %6d \n", iDomain);
         fprintf(file,"  Name : %s\n", theDomain->name);
         fprintf(file,"  Number of elements : %6d\n", theDomain->nElem);
@@ -501,89 +645,100 @@ void geoMeshWrite(const char *filename) {
     }
 
     fclose(file);
+    femProfileEnd(FEM_PHASE_OUTPUT);
 }
 
 // read a mesh file and save its contents into theGeometry structure
-void geoMeshRead(const char *filename)
+void geoMeshReadGeo(femGeo *theGeometry, const char *filename)
 {
    FILE* file = fopen(filename,"r");
+   if (!file) {
+       printf("Error! Unable to open file at %s\n", filename);
+       exit(-1);
+   }
+   femProfileBegin(FEM_PHASE_READ);
+   femArena *theArena = geoArena(theGeometry);
+   geoMeshInvalidate(theGeometry);
    
    int trash, *elem;
    
-   femNodes *theNodes = malloc(sizeof(femNodes));
-   theGeometry.theNodes = theNodes;
+   femNodes *theNodes = femArenaAlloc(theArena, sizeof(femNodes));
+   theGeometry->theNodes = theNodes;
    ErrorScan(fscanf(file, "Number of nodes %d \n", &theNodes->nNodes));
-   theNodes->X = malloc(sizeof(double)*(theNodes->nNodes));
-   theNodes->Y = malloc(sizeof(double)*(theNodes->nNodes));
+   theNodes->X = femArenaAlloc(theArena, sizeof(double)*(theNodes->nNodes));
+   theNodes->Y = femArenaAlloc(theArena, sizeof(double)*(theNodes->nNodes));
    for (int i = 0; i < theNodes->nNodes; i++) {
        ErrorScan(fscanf(file,"%d : %le %le \n",&trash,&theNodes->X[i],&theNodes->Y[i]));} 
 
-   femMesh *theEdges = malloc(sizeof(femMesh));
-   theGeometry.theEdges = theEdges;
+   femMesh *theEdges = femArenaAlloc(theArena, sizeof(femMesh));
+   theGeometry->theEdges = theEdges;
    theEdges->nLocalNode = 2;
    theEdges->nodes = theNodes;
+   theEdges->topology = NULL;
    ErrorScan(fscanf(file, "Number of edges %d \n", &theEdges->nElem));
-   theEdges->elem = malloc(sizeof(int)*theEdges->nLocalNode*theEdges->nElem);
+   theEdges->elem = femArenaAlloc(theArena, sizeof(int)*theEdges->nLocalNode*theEdges->nElem);
    for(int i=0; i < theEdges->nElem; ++i) {
         elem = theEdges->elem;
         ErrorScan(fscanf(file, "%6d : %6d %6d \n", &trash,&elem[2*i],&elem[2*i+1])); }
   
-   femMesh *theElements = malloc(sizeof(femMesh));
-   theGeometry.theElements = theElements;
+   femMesh *theElements = femArenaAlloc(theArena, sizeof(femMesh));
+   theGeometry->theElements = theElements;
    theElements->nLocalNode = 0;
    theElements->nodes = theNodes;
+   theElements->topology = NULL;
    char elementType[MAXNAME];  
    ErrorScan(fscanf(file, "Number of %s %d \n",elementType,&theElements->nElem));  
    if (strncasecmp(elementType,"triangles",MAXNAME) == 0) {
       theElements->nLocalNode = 3;
-      theElements->elem = malloc(sizeof(int)*theElements->nLocalNode*theElements->nElem);
+      theElements->elem = femArenaAlloc(theArena, sizeof(int)*theElements->nLocalNode*theElements->nElem);
       for(int i=0; i < theElements->nElem; ++i) {
           elem = theElements->elem;
           ErrorScan(fscanf(file, "%6d : %6d %6d %6d \n", 
                     &trash,&elem[3*i],&elem[3*i+1],&elem[3*i+2])); }}
    if (strncasecmp(elementType,"quads",MAXNAME) == 0) {
       theElements->nLocalNode = 4;
-      theElements->elem = malloc(sizeof(int)*theElements->nLocalNode*theElements->nElem);
+      theElements->elem = femArenaAlloc(theArena, sizeof(int)*theElements->nLocalNode*theElements->nElem);
       for(int i=0; i < theElements->nElem; ++i) {
           elem = theElements->elem;
           ErrorScan(fscanf(file, "%6d : %6d %6d %6d %6d \n", 
                     &trash,&elem[4*i],&elem[4*i+1],&elem[4*i+2],&elem[4*i+3])); }}
            
-   ErrorScan(fscanf(file, "Number of domains %d\n", &theGeometry.nDomains));
-   int nDomains = theGeometry.nDomains;
-   theGeometry.theDomains = malloc(sizeof(femDomain*)*nDomains);
+   ErrorScan(fscanf(file, "Number of domains %d\n", &theGeometry->nDomains));
+   int nDomains = theGeometry->nDomains;
+   theGeometry->theDomains = femArenaAlloc(theArena, sizeof(femDomain*)*nDomains);
    for (int iDomain = 0; iDomain < nDomains; iDomain++) {
-      femDomain *theDomain = malloc(sizeof(femDomain)); 
-      theGeometry.theDomains[iDomain] = theDomain;
+      femDomain *theDomain = femArenaAlloc(theArena, sizeof(femDomain)); 
+      theGeometry->theDomains[iDomain] = theDomain;
       theDomain->mesh = theEdges; 
       ErrorScan(fscanf(file,"  Domain : %6d \n", &trash));
       ErrorScan(fscanf(file,"  Name : %[^\n]s \n", (char*)&theDomain->name));
       ErrorScan(fscanf(file,"  Number of elements : %6d\n", &theDomain->nElem));
-      theDomain->elem = malloc(sizeof(int)*2*theDomain->nElem); 
+      theDomain->elem = femArenaAlloc(theArena, sizeof(int)*2*theDomain->nElem); 
       for (int i=0; i < theDomain->nElem; i++){
           ErrorScan(fscanf(file,"%6d",&theDomain->elem[i]));
           if ((i+1) != theDomain->nElem  && (i+1) % 10 == 0) ErrorScan(fscanf(file,"\n")); }}
     
    fclose(file);
+   femProfileEnd(FEM_PHASE_READ);
 }
 
 // set a domain name for given domain number
-void geoSetDomainName(int iDomain, char *name) {
-    if (iDomain >= theGeometry.nDomains){
+void geoSetDomainNameGeo(femGeo *theGeometry, int iDomain, char *name) {
+    if (iDomain >= theGeometry->nDomains){
         Error("Illegal domain number");
     }
-    if (geoGetDomain(name) != -1) {
+    if (geoGetDomainGeo(theGeometry, name) != -1) {
         Error("Cannot use the same name for two domains");
     }
-    sprintf(theGeometry.theDomains[iDomain]->name,"%s",name);
+    sprintf(theGeometry->theDomains[iDomain]->name,"%s",name);
 } 
 
 // retireve domain number from the name
-int geoGetDomain(char *name) {
+int geoGetDomainGeo(femGeo *theGeometry, char *name) {
     int theIndex = -1;
-    int nDomains = theGeometry.nDomains;
+    int nDomains = theGeometry->nDomains;
     for (int iDomain = 0; iDomain < nDomains; iDomain++) {
-        femDomain *theDomain = theGeometry.theDomains[iDomain];
+        femDomain *theDomain = theGeometry->theDomains[iDomain];
         if (strncasecmp(name,theDomain->name,MAXNAME) == 0) {
             theIndex = iDomain;
         }
@@ -592,6 +747,20 @@ int geoGetDomain(char *name) {
 }
 
 
+
+/*
+*   WRAPPERS ON THE DEFAULT GEOMETRY
+*/
+void geoMeshGenerateOpen()                      { geoMeshGenerateOpenGeo(&theGeometry); }
+void geoMeshGenerateClosed()                    { geoMeshGenerateClosedGeo(&theGeometry); }
+void geoMeshGenerateHalf()                      { geoMeshGenerateHalfGeo(&theGeometry); }
+void geoMeshImport()                            { geoMeshImportGeo(&theGeometry); }
+void geoMeshWrite(const char *filename)         { geoMeshWriteGeo(&theGeometry, filename); }
+void geoMeshRead(const char *filename)          { geoMeshReadGeo(&theGeometry, filename); }
+void geoSetDomainName(int iDomain, char *name)  { geoSetDomainNameGeo(&theGeometry, iDomain, name); }
+int  geoGetDomain(char *name)                   { return geoGetDomainGeo(&theGeometry, name); }
+
+
 /*
 *   HUMAN READABLE SUMMARY OF THE PROBLEM PARAMETERS
 */
@@ -655,6 +824,7 @@ void femSolutionWrite(int nNodes, int nfields, double *data, const char *filenam
       printf("Error at %s:%d\nUnable to open file %s\n", __FILE__, __LINE__, filename);
       exit(-1);
     }
+    femProfileBegin(FEM_PHASE_OUTPUT);
     fprintf(file, "Size %d,%d\n", nNodes, nfields);
     for (int i = 0; i < nNodes; i++) {
       for (int j = 0; j < nfields - 1; j++) {
@@ -664,6 +834,7 @@ void femSolutionWrite(int nNodes, int nfields, double *data, const char *filenam
       fprintf(file, "\n");
     }
     fclose(file);
+    femProfileEnd(FEM_PHASE_OUTPUT);
 }
 
 
@@ -675,12 +846,14 @@ void femSolutionWrite(int nNodes, int nfields, double *data, const char *filenam
 */
 
 // initializing and filling the femProblem structure with everything needed for the FE analysis (geometry, properties, integration rules, constraints)
-femProblem *femElasticityCreate(femGeo* theGeometry, double E, double nu, double rho, double g, femElasticCase iCase) {
+femProblem *femElasticityCreateSolver(femGeo* theGeometry, double E, double nu, double rho, double g,
+                                      femElasticCase iCase, femSolverType solverType, femRenumType renumType) {
 
     // NEEDS ADDITIONAL LINES IF WE WANT TO IMPLEMENT TANGENTIAL AND NORMAL CONSTRAINTS
     // ONLY WORKS FOR XY CONSTRAINTS FOR NOW
     
-    femProblem *theProblem = malloc(sizeof(femProblem));
+    femProfileBegin(FEM_PHASE_SETUP);
+    femProblem *theProblem = femMalloc(FEM_MEM_SOLVER, sizeof(femProblem));
     theProblem->E   = E;
     theProblem->nu  = nu;
     theProblem->g   = g;
@@ -699,13 +872,15 @@ femProblem *femElasticityCreate(femGeo* theGeometry, double E, double nu, double
 
     theProblem->planarStrainStress = iCase;
     theProblem->nBoundaryConditions = 0;
+    theProblem->maxBoundaryConditions = 0;
     theProblem->conditions = NULL;
+    theProblem->arena = femArenaCreate(FEM_MEM_SOLVER);
 
     // total number of DOF
     int size = 2*theGeometry->theNodes->nNodes;
-    theProblem->constrainedNodes = malloc(size*sizeof(int));
-    theProblem->soluce = malloc(size*sizeof(double));
-    theProblem->residuals = malloc(size*sizeof(double));
+    theProblem->constrainedNodes = femMalloc(FEM_MEM_SOLVER, size*sizeof(int));
+    theProblem->soluce = femMalloc(FEM_MEM_SOLVER, size*sizeof(double));
+    theProblem->residuals = femMalloc(FEM_MEM_SOLVER, size*sizeof(double));
     // initialize arrays containing constraint for each node, by default -1 meaning not constrained
     // as well as allocating and initializing the solution and residuals arrays to 0
     for (int i=0; i < size; i++) {
@@ -727,7 +902,58 @@ femProblem *femElasticityCreate(femGeo* theGeometry, double E, double nu, double
 
     theProblem->spaceEdge    = femDiscreteCreate(2,FEM_EDGE);
     theProblem->ruleEdge     = femIntegrationCreate(2,FEM_EDGE); 
-    theProblem->system       = femFullSystemCreate(size); 
+
+    // position of each node in the algebraic system, the band solver needs a renumbering
+    // that keeps neighbouring nodes close to each other, the multigrid levels use the natural one
+    theProblem->number = femMalloc(FEM_MEM_SOLVER, theGeometry->theNodes->nNodes*sizeof(int));
+    if (solverType == FEM_MULTIGRID) renumType = FEM_NO;
+    int bandNodes = femMeshRenumber(theGeometry->theElements, renumType, theProblem->number);
+    theProblem->lift = femMalloc(FEM_MEM_SOLVER, size*sizeof(double));
+
+    // predicted peak : what is allocated now, the system and the loads of femElasticityForces
+    size_t post = sizeof(double) * size;
+    size_t bytes = femSystemMemory(solverType, size, 2*(bandNodes+1));
+    if (!femMemoryFits(bytes + post) && solverType == FEM_FULL) {
+        // the band solver needs a renumbering, the best of the two directions is kept
+        if (renumType == FEM_NO) {
+            int bandX = femMeshRenumber(theGeometry->theElements, FEM_XNUM, theProblem->number);
+            bandNodes = femMeshRenumber(theGeometry->theElements, FEM_YNUM, theProblem->number);
+            if (bandX < bandNodes) bandNodes = femMeshRenumber(theGeometry->theElements, FEM_XNUM, theProblem->number); }
+        size_t bandBytes = femSystemMemory(FEM_BAND, size, 2*(bandNodes+1));
+        if (femMemoryFits(bandBytes + post)) {
+            printf("Memory  : the full system needs %.1f MB, falling back to the band solver (%.1f MB)\n",
+                   bytes / 1048576.0, bandBytes / 1048576.0);
+            solverType = FEM_BAND;
+            bytes = bandBytes; }}
+    printf("Memory  : predicted peak %.1f MB (system %.1f MB), budget %.1f MB\n",
+           (femMemoryCurrent() + bytes + post) / 1048576.0, bytes / 1048576.0, femMemoryBudget() / 1048576.0);
+    if (!femMemoryFits(bytes + post)) {
+        char message[MAXNAME];
+        snprintf(message, MAXNAME, "The system needs %.1f MB, more than the memory budget", bytes / 1048576.0);
+        Error(message); }
+
+    theProblem->solverType   = solverType;
+    theProblem->system       = NULL;
+    theProblem->bandSystem   = NULL;
+    theProblem->sparseSystem = NULL;
+    theProblem->massSystem   = NULL;
+    theProblem->shift        = 0.0;
+    theProblem->multigrid    = NULL;
+    theProblem->precision    = FEM_DOUBLE;
+    theProblem->mixedSystem  = NULL;
+    theProblem->monitor      = NULL;
+    theProblem->factors      = NULL;
+    theProblem->cacheFactors = TRUE;
+    if (solverType == FEM_FULL)
+        theProblem->system     = femFullSystemCreate(size); 
+    else if (solverType == FEM_BAND)
+        theProblem->bandSystem = femBandSystemCreate(size, 2*(bandNodes+1));
+    else if (solverType == FEM_MULTIGRID) {
+        theProblem->sparseSystem = femSparseSystemCreate(theGeometry->theElements, theProblem->number);
+        theProblem->multigrid = femMultigridCreateAlgebraic(); }
+    else Error("Unknown solver type");
+    theProblem->factorized = FALSE;
+    femProfileEnd(FEM_PHASE_SETUP);
 
     
     // femDiscretePrint(theProblem->space);   
@@ -737,18 +963,31 @@ femProblem *femElasticityCreate(femGeo* theGeometry, double E, double nu, double
     return theProblem;
 }
 
+femProblem *femElasticityCreate(femGeo* theGeometry, double E, double nu, double rho, double g, femElasticCase iCase) {
+    return femElasticityCreateSolver(theGeometry, E, nu, rho, g, iCase, FEM_FULL, FEM_NO);
+}
+
 // freeing the problem structure
 void femElasticityFree(femProblem *theProblem) {
-    femFullSystemFree(theProblem->system);
+    if (theProblem->system)     femFullSystemFree(theProblem->system);
+    if (theProblem->bandSystem) femBandSystemFree(theProblem->bandSystem);
+    if (theProblem->sparseSystem) femSparseSystemFree(theProblem->sparseSystem);
+    if (theProblem->massSystem) femSparseSystemFree(theProblem->massSystem);
+    if (theProblem->multigrid) femMultigridFree(theProblem->multigrid);
+    if (theProblem->mixedSystem) femMixedSystemFree(theProblem->mixedSystem);
+    if (theProblem->monitor) femMonitorFree(theProblem->monitor);
+    if (theProblem->factors) femFactorsFree(theProblem->factors);
+    femFree(theProblem->number);
+    femFree(theProblem->lift);
     femIntegrationFree(theProblem->rule);
     femDiscreteFree(theProblem->space);
     femIntegrationFree(theProblem->ruleEdge);
     femDiscreteFree(theProblem->spaceEdge);
-    free(theProblem->conditions);
-    free(theProblem->constrainedNodes);
-    free(theProblem->soluce);
-    free(theProblem->residuals);
-    free(theProblem);
+    femArenaFree(theProblem->arena);
+    femFree(theProblem->constrainedNodes);
+    femFree(theProblem->soluce);
+    femFree(theProblem->residuals);
+    femFree(theProblem);
 }
 
 void femElasticityPrint(femProblem *theProblem)  
@@ -782,25 +1021,31 @@ void femElasticityAddBoundaryCondition(femProblem *theProblem, char *nameDomain,
     // WOULD NEED TO UPDATE THIS FUNCTION IF WE WANT TO ALSO USE NORMAL OR TANGENTIAL DIRICHLET CONDITIONS
     // REMINDER: THIS FUNCTION DOES NOT DEAL WITH NEUMANN CONDITIONS YET, THEY COME LATER WHEN ASSEMBLING LOAD VECTOR
 
-    int iDomain = geoGetDomain(nameDomain);
+    // look the domain up in the problem's own geometry so that problems built on
+    // different meshes (or from different threads) never touch the default one
+    int iDomain = geoGetDomainGeo(theProblem->geometry, nameDomain);
     if (iDomain == -1) {
         Error("Undefined domain :-(");
     }
 
-    // create and store basic boundary information
-    femBoundaryCondition* theBoundary = malloc(sizeof(femBoundaryCondition));
+    // the slots double when full and come from the problem's arena : every slot below
+    // maxBoundaryConditions already holds a condition, reused when conditions are dropped
+    if (theProblem->nBoundaryConditions == theProblem->maxBoundaryConditions) {
+        int oldMax = theProblem->maxBoundaryConditions;
+        int newMax = (oldMax == 0) ? 8 : 2*oldMax;
+        femBoundaryCondition **conditions = femArenaAlloc(theProblem->arena, newMax*sizeof(femBoundaryCondition*));
+        femBoundaryCondition *slots = femArenaAlloc(theProblem->arena, (newMax-oldMax)*sizeof(femBoundaryCondition));
+        for (int i = 0; i < oldMax; i++) conditions[i] = theProblem->conditions[i];
+        for (int i = oldMax; i < newMax; i++) conditions[i] = &slots[i-oldMax];
+        theProblem->conditions = conditions;
+        theProblem->maxBoundaryConditions = newMax; }
+
+    // increase boundary condition count and store the basic boundary information
+    femBoundaryCondition* theBoundary = theProblem->conditions[theProblem->nBoundaryConditions++];
+    int size = theProblem->nBoundaryConditions;
     theBoundary->domain = theProblem->geometry->theDomains[iDomain];
     theBoundary->value = value;
     theBoundary->type = type;
-
-    // increase boundary condition count and add the new condition
-    theProblem->nBoundaryConditions++;
-    int size = theProblem->nBoundaryConditions;
-    if (theProblem->conditions == NULL)
-        theProblem->conditions = malloc(size*sizeof(femBoundaryCondition*));
-    else 
-        theProblem->conditions = realloc(theProblem->conditions, size*sizeof(femBoundaryCondition*));
-    theProblem->conditions[size-1] = theBoundary;
     
     // for simple dirichlet determine which degree to constrain
     int shift=-1;
@@ -810,6 +1055,7 @@ void femElasticityAddBoundaryCondition(femProblem *theProblem, char *nameDomain,
         shift = 1;  
     if (shift == -1) // if the condition is not one of these do nothing
         return;
+    theProblem->factorized = FALSE;
     
     // update the constrainednodes array
     int *elem = theBoundary->domain->elem;
@@ -823,99 +1069,363 @@ void femElasticityAddBoundaryCondition(femProblem *theProblem, char *nameDomain,
     }    
 }
 
-void femElasticityAssembleElements(femProblem *theProblem){
-    femFullSystem  *theSystem = theProblem->system;
+// jacobian of the mapping at one point and the gradients of the shape functions in x and y
+static double femElasticityJacobian(int n, const double *x, const double *y, const double *dphidxsi,
+                                    const double *dphideta, double *dphidx, double *dphidy) {
+    double dxdxsi = 0.0;
+    double dxdeta = 0.0;
+    double dydxsi = 0.0; 
+    double dydeta = 0.0;
+    for (int i = 0; i < n; i++) {  
+        dxdxsi += x[i]*dphidxsi[i];       
+        dxdeta += x[i]*dphideta[i];   
+        dydxsi += y[i]*dphidxsi[i];   
+        dydeta += y[i]*dphideta[i];
+    }
+    double jac = fabs(dxdxsi * dydeta - dxdeta * dydxsi);
+    if (dphidx == NULL)
+        return jac;
+    for (int i = 0; i < n; i++) {    
+        dphidx[i] = (dphidxsi[i] * dydeta - dphideta[i] * dydxsi) / jac;       
+        dphidy[i] = (dphideta[i] * dxdxsi - dphidxsi[i] * dxdeta) / jac;
+    }
+    return jac;
+}
+
+// gradients of the shape functions of an element at (xsi,eta), same mapping as the stiffness matrix
+// map receives the global node numbers, the jacobian is returned
+double femElasticityElementGradients(femProblem *theProblem, int iElem, double xsi, double eta,
+                                     double *dphidx, double *dphidy, int *map) {
+    femDiscrete    *theSpace = theProblem->space;
+    femNodes       *theNodes = theProblem->geometry->theNodes;
+    femMesh        *theMesh = theProblem->geometry->theElements;
+    double x[4],y[4],dphidxsi[4],dphideta[4];
+    int nLocal = theMesh->nLocalNode;
+    for (int j = 0; j < nLocal; j++) {
+        map[j] = theMesh->elem[iElem*nLocal+j];
+        x[j]   = theNodes->X[map[j]];
+        y[j]   = theNodes->Y[map[j]];
+    }
+    femDiscreteDphi2(theSpace,xsi,eta,dphidxsi,dphideta);
+    return femElasticityJacobian(theSpace->n,x,y,dphidxsi,dphideta,dphidx,dphidy);
+}
+
+// jacobian and gradients at the integration point iInteg of an element, read from the cache
+// when there is one and computed otherwise, dphidx can be NULL when only the jacobian is needed
+double femElasticityElementFactors(femProblem *theProblem, int iElem, int iInteg, double *dphidx, double *dphidy) {
+    femFactors *theFactors = theProblem->factors;
+    if (theFactors == NULL) {
+        femIntegration *theRule = theProblem->rule;
+        femDiscrete    *theSpace = theProblem->space;
+        femNodes       *theNodes = theProblem->geometry->theNodes;
+        femMesh        *theMesh = theProblem->geometry->theElements;
+        double x[4],y[4],dphidxsi[4],dphideta[4];
+        int nLocal = theMesh->nLocalNode;
+        for (int j = 0; j < nLocal; j++) {
+            x[j] = theNodes->X[theMesh->elem[iElem*nLocal+j]];
+            y[j] = theNodes->Y[theMesh->elem[iElem*nLocal+j]];
+        }
+        femDiscreteDphi2(theSpace,theRule->xsi[iInteg],theRule->eta[iInteg],dphidxsi,dphideta);
+        return femElasticityJacobian(theSpace->n,x,y,dphidxsi,dphideta,dphidx,dphidy);
+    }
+    int n = theFactors->n, k = iElem*theFactors->nInteg + iInteg;
+    if (dphidx != NULL)
+        for (int i = 0; i < n; i++) {
+            dphidx[i] = theFactors->dphidx[k*n+i];
+            dphidy[i] = theFactors->dphidy[k*n+i];
+        }
+    return theFactors->jac[k];
+}
+
+// with cache FALSE, the factors are recomputed in each pass instead of being kept
+void femElasticitySetFactorCache(femProblem *theProblem, int cache) {
+    theProblem->cacheFactors = cache;
+    if (!cache) femElasticityInvalidateFactors(theProblem);
+}
+
+// the cached factors are dropped, to be called whenever the nodes of the problem move,
+// the next femElasticityFactors builds them again on the new coordinates
+void femElasticityInvalidateFactors(femProblem *theProblem) {
+    if (theProblem->factors == NULL) return;
+    femFactorsFree(theProblem->factors);
+    theProblem->factors = NULL;
+}
+
+// the cache of the factors, built on the first call, NULL when it is off or does not fit in the budget
+femFactors *femElasticityFactors(femProblem *theProblem) {
+    if (theProblem->factors != NULL || !theProblem->cacheFactors)
+        return theProblem->factors;
+    size_t bytes = femFactorsMemory(theProblem);
+    if (!femMemoryFits(bytes)) {
+        printf("Memory  : the element factors need %.1f MB, recomputed in each pass\n", bytes / 1048576.0);
+        theProblem->cacheFactors = FALSE;
+        return NULL;
+    }
+    theProblem->factors = femFactorsCreate(theProblem, 0);
+    return theProblem->factors;
+}
+
+// local stiffness matrix (2n x 2n, dofs ordered x0,y0,x1,y1,...) and gravity load of one element
+// map receives the global node numbers, Aloc can be NULL when only the load is needed
+void femElasticityElementMatrix(femProblem *theProblem, int iElem, double *Aloc, double *Bloc, int *map) {
     femIntegration *theRule = theProblem->rule;
     femDiscrete    *theSpace = theProblem->space;
-    femGeo         *theGeometry = theProblem->geometry;
-    femNodes       *theNodes = theGeometry->theNodes;
-    femMesh        *theMesh = theGeometry->theElements;
-    femMesh        *theEdges = theGeometry->theEdges;
-    double x[4],y[4],phi[4],dphidxsi[4],dphideta[4],dphidx[4],dphidy[4]; // temp arrays used to store the values for the nodes of a single element
-    int iElem,iInteg,iEdge,i,j,d,map[4],mapX[4],mapY[4]; // same, temporary storage
+    femMesh        *theMesh = theProblem->geometry->theElements;
+    double phi[4],dphidx[4],dphidy[4];
+    int iInteg,i,j;
     int nLocal = theMesh->nLocalNode;
+    int nLoc = 2*nLocal;
     double a   = theProblem->A;
     double b   = theProblem->B;
     double c   = theProblem->C;      
     double rho = theProblem->rho;
     double g   = theProblem->g;
-    double **A = theSystem->A;
-    double *B  = theSystem->B;
+
+    for (j=0; j < nLocal; j++) 
+        map[j] = theMesh->elem[iElem*nLocal+j];
+    if (Aloc != NULL)
+        for (i = 0; i < nLoc*nLoc; i++) Aloc[i] = 0.0;
+    for (i = 0; i < nLoc; i++) Bloc[i] = 0.0;
     
+    for (iInteg=0; iInteg < theRule->n; iInteg++) {    
+        double xsi    = theRule->xsi[iInteg];
+        double eta    = theRule->eta[iInteg];
+        double weight = theRule->weight[iInteg];  
+        femDiscretePhi2(theSpace,xsi,eta,phi);
+        double jac = femElasticityElementFactors(theProblem,iElem,iInteg,
+                                                 (Aloc != NULL) ? dphidx : NULL,dphidy);
+
+        for (i = 0; i < theSpace->n; i++) {
+            Bloc[2*i+1] -= phi[i] * g * rho * jac * weight;
+        }
+        if (Aloc == NULL)
+            continue;
+        
+        for (i = 0; i < theSpace->n; i++) { 
+            for(j = 0; j < theSpace->n; j++) {
+                Aloc[(2*i  )*nLoc+2*j  ] += (dphidx[i] * a * dphidx[j] + 
+                                             dphidy[i] * c * dphidy[j]) * jac * weight;                                                                                            
+                Aloc[(2*i  )*nLoc+2*j+1] += (dphidx[i] * b * dphidy[j] + 
+                                             dphidy[i] * c * dphidx[j]) * jac * weight;                                                                                           
+                Aloc[(2*i+1)*nLoc+2*j  ] += (dphidy[i] * b * dphidx[j] + 
+                                             dphidx[i] * c * dphidy[j]) * jac * weight;                                                                                            
+                Aloc[(2*i+1)*nLoc+2*j+1] += (dphidy[i] * a * dphidy[j] + 
+                                             dphidx[i] * c * dphidx[j]) * jac * weight;
+            }
+        }
+    }
+}
+
+// flop estimate of femElasticityElementMatrix for one element
+double femElasticityElementFlops(femProblem *theProblem) {
+    int n = theProblem->space->n;
+    if (theProblem->factors != NULL) return theProblem->rule->n * (4.0*n + 40.0*n*n);
+    return theProblem->rule->n * (12.0*n + 10.0 + 4.0*n + 40.0*n*n);
+}
+
+// consistent mass matrix of one element (n x n), the same for both displacement components
+void femElasticityElementMass(femProblem *theProblem, int iElem, double *Mloc) {
+    femIntegration *theRule = theProblem->rule;
+    femDiscrete    *theSpace = theProblem->space;
+    double phi[4];
+    int iInteg,i,j,n = theSpace->n;
+    double rho = theProblem->rho;
+
+    for (i = 0; i < n*n; i++) Mloc[i] = 0.0;
+    for (iInteg=0; iInteg < theRule->n; iInteg++) {
+        femDiscretePhi2(theSpace,theRule->xsi[iInteg],theRule->eta[iInteg],phi);
+        double jac = femElasticityElementFactors(theProblem,iElem,iInteg,NULL,NULL);
+        for (i = 0; i < n; i++)
+            for (j = 0; j < n; j++)
+                Mloc[i*n+j] += phi[i] * rho * phi[j] * jac * theRule->weight[iInteg];
+    }
+}
+
+// with mass TRUE, the next factorization also assembles the consistent mass matrix,
+// stored row by row in the ordering of the system
+void femElasticitySetMass(femProblem *theProblem, int mass) {
+    if (mass && theProblem->massSystem == NULL) {
+        theProblem->massSystem = femSparseSystemCreate(theProblem->geometry->theElements, theProblem->number);
+        theProblem->factorized = FALSE; }
+    if (!mass && theProblem->massSystem != NULL) {
+        femSparseSystemFree(theProblem->massSystem);
+        theProblem->massSystem = NULL; }
+}
+
+// y = M x, both in the natural ordering
+void femElasticityMassMultiply(femProblem *theProblem, const double *x, double *y) {
+    femSparseSystem *theMass = theProblem->massSystem;
+    if (theMass == NULL)
+        Error("The mass matrix is not assembled, see femElasticitySetMass");
+    int i, size = theMass->size;
+    double *work = femMalloc(FEM_MEM_SOLVER, sizeof(double) * size);
+    // the right-hand side of the mass system is not used otherwise, it holds x in the system ordering
+    for (i = 0; i < size; i++) theMass->B[2*theProblem->number[i/2] + i%2] = x[i];
+    femSparseSystemMultiply(theMass, theMass->B, work);
+    for (i = 0; i < size; i++) y[i] = work[2*theProblem->number[i/2] + i%2];
+    femFree(work);
+}
+
+// the next factorizations are those of K - shift M (the mass matrix is needed), for the modal analysis
+// of a model K alone cannot hold : the static loads are only right again with a shift at zero
+void femElasticitySetShift(femProblem *theProblem, double shift) {
+    if (shift != 0.0 && theProblem->massSystem == NULL)
+        Error("The mass matrix is not assembled, see femElasticitySetMass");
+    if (shift != theProblem->shift) theProblem->factorized = FALSE;
+    theProblem->shift = shift;
+}
+
+// position of a dof in the algebraic system
+static inline int femElasticityDof(femProblem *theProblem, int node, int shift) {
+    return 2*theProblem->number[node] + shift;
+}
+
+static double *femElasticitySystemB(femProblem *theProblem) {
+    if (theProblem->solverType == FEM_BAND) return theProblem->bandSystem->B;
+    if (theProblem->solverType == FEM_MULTIGRID) return theProblem->sparseSystem->B;
+    return theProblem->system->B;
+}
+
+static int femElasticitySystemSize(femProblem *theProblem) {
+    if (theProblem->solverType == FEM_BAND) return theProblem->bandSystem->size;
+    if (theProblem->solverType == FEM_MULTIGRID) return theProblem->sparseSystem->size;
+    return theProblem->system->size;
+}
+
+static void femElasticitySystemInit(femProblem *theProblem) {
+    if (theProblem->solverType == FEM_BAND) femBandSystemInit(theProblem->bandSystem);
+    else if (theProblem->solverType == FEM_MULTIGRID) femSparseSystemInit(theProblem->sparseSystem);
+    else femFullSystemInit(theProblem->system);
+    theProblem->factorized = FALSE;
+}
+
+static void femElasticitySystemConstrain(femProblem *theProblem, int myNode, double value) {
+    if (theProblem->solverType == FEM_BAND) femBandSystemConstrain(theProblem->bandSystem,myNode,value);
+    else if (theProblem->solverType == FEM_MULTIGRID) femSparseSystemConstrain(theProblem->sparseSystem,myNode,value);
+    else femFullSystemConstrain(theProblem->system,myNode,value);
+}
+
+// add an elementary contribution to the system, the band system only stores its upper part
+static void femElasticitySystemAssemble(femProblem *theProblem, double *Aloc, double *Bloc, int *mapU, int nLoc) {
+    double *B  = femElasticitySystemB(theProblem);
+    int i,j;
+    if (theProblem->solverType == FEM_MULTIGRID) {
+        femSparseSystem *theSystem = theProblem->sparseSystem;
+        for (i = 0; i < nLoc; i++) {
+            for (j = 0; j < nLoc; j++)
+                theSystem->A[femSparseSystemFind(theSystem,mapU[i],mapU[j])] += Aloc[i*nLoc+j];
+            B[mapU[i]] += Bloc[i]; }
+        return; }
+    double **A = (theProblem->solverType == FEM_BAND) ? theProblem->bandSystem->A : theProblem->system->A;
+    if (theProblem->solverType == FEM_BAND) {
+        for (i = 0; i < nLoc; i++) {
+            for (j = 0; j < nLoc; j++)
+                if (mapU[j] >= mapU[i]) A[mapU[i]][mapU[j]] += Aloc[i*nLoc+j];
+            B[mapU[i]] += Bloc[i]; }}
+    else {
+        for (i = 0; i < nLoc; i++) {
+            for (j = 0; j < nLoc; j++)
+                A[mapU[i]][mapU[j]] += Aloc[i*nLoc+j];
+            B[mapU[i]] += Bloc[i]; }}
+}
+
+// subtracts shift M from the assembled stiffness, both in the ordering of the system
+static void femElasticitySystemShift(femProblem *theProblem) {
+    femSparseSystem *theMass = theProblem->massSystem;
+    double shift = theProblem->shift;
+    for (int i = 0; i < theMass->size; i++)
+        for (int k = theMass->rowStart[i]; k < theMass->rowStart[i+1]; k++) {
+            int j = theMass->col[k];
+            if (theProblem->solverType == FEM_MULTIGRID)
+                theProblem->sparseSystem->A[femSparseSystemFind(theProblem->sparseSystem,i,j)] -= shift * theMass->A[k];
+            else if (theProblem->solverType == FEM_BAND) {
+                if (j >= i) theProblem->bandSystem->A[i][j] -= shift * theMass->A[k]; }
+            else theProblem->system->A[i][j] -= shift * theMass->A[k]; }
+}
+
+void femElasticityAssembleElements(femProblem *theProblem){
+    femMesh *theMesh = theProblem->geometry->theElements;
+    femSparseSystem *theMass = theProblem->massSystem;
+    double Aloc[64],Bloc[8],Mloc[16];
+    int iElem,i,j,map[4],mapU[8];
+    int nLocal = theMesh->nLocalNode;
+    femProfileBegin(FEM_PHASE_ASSEMBLY);
+    femElasticityFactors(theProblem);
+    if (theMass != NULL) femSparseSystemInit(theMass);
     
     for (iElem = 0; iElem < theMesh->nElem; iElem++) { // for each element in mesh
-        
+        femElasticityElementMatrix(theProblem,iElem,Aloc,Bloc,map);
         for (j=0; j < nLocal; j++) {
-            map[j]  = theMesh->elem[iElem*nLocal+j];
-            mapX[j] = 2*map[j];
-            mapY[j] = 2*map[j] + 1;
+            mapU[2*j]   = femElasticityDof(theProblem,map[j],0);
+            mapU[2*j+1] = femElasticityDof(theProblem,map[j],1);
+        }
+        femElasticitySystemAssemble(theProblem,Aloc,Bloc,mapU,2*nLocal);
+        if (theMass == NULL)
+            continue;
+        // the mass only couples the same component of two nodes
+        femElasticityElementMass(theProblem,iElem,Mloc);
+        for (i = 0; i < nLocal; i++)
+            for (j = 0; j < nLocal; j++) {
+                theMass->A[femSparseSystemFind(theMass,mapU[2*i],  mapU[2*j]  )] += Mloc[i*nLocal+j];
+                theMass->A[femSparseSystemFind(theMass,mapU[2*i+1],mapU[2*j+1])] += Mloc[i*nLocal+j]; }
+    } 
+    femProfileCount(0, (double) theMesh->nElem * femElasticityElementFlops(theProblem));
+    if (theMass != NULL)
+        femProfileCount(0, (double) theMesh->nElem * theProblem->rule->n * 4.0 * nLocal * nLocal);
+    femProfileEnd(FEM_PHASE_ASSEMBLY);
+}
+
+// integrates a uniform traction along the edges of a domain into B (dof 2*number[node]+shift)
+static void femElasticityEdgeLoads(femProblem *theProblem, femDomain *theDomain, int shift, double value,
+                                   double *B, int *number){
+    femIntegration *theRule = theProblem->ruleEdge;
+    femDiscrete    *theSpace = theProblem->spaceEdge;
+    femGeo         *theGeometry = theProblem->geometry;
+    femNodes       *theNodes = theGeometry->theNodes;
+    femMesh        *theEdges = theGeometry->theEdges;
+    double x[2],y[2],phi[2];
+    int iElem,iInteg,iEdge,i,j,map[2],mapU[2];
+    int nLocal = 2;
+
+    // loop over every boundary element (edge) for this boundary
+    for(iEdge=0; iEdge < theDomain->nElem; iEdge++){
+        iElem = theDomain->elem[iEdge];
+        for (j=0; j < nLocal; j++) { // loop over edges of the boundary element
+            map[j]  = theEdges->elem[iElem*nLocal+j]; // get nodes forming edge
+            mapU[j] = 2*(number ? number[map[j]] : map[j]) + shift; // similar to what happened in previous function, setting values in right place in the vector
+            // get coordinates of the edge's nodes (later used to calculate edge length)
             x[j]    = theNodes->X[map[j]];
             y[j]    = theNodes->Y[map[j]];
         } 
+
+        // jacobian is just the length of the edge / 2
+        double dx = x[1] - x[0];
+        double dy = y[1] - y[0];
+        double jac = sqrt(dx*dx + dy*dy)/2.0;
         
+        // integrating over the edge
         for (iInteg=0; iInteg < theRule->n; iInteg++) {    
             double xsi    = theRule->xsi[iInteg];
-            double eta    = theRule->eta[iInteg];
             double weight = theRule->weight[iInteg];  
-            femDiscretePhi2(theSpace,xsi,eta,phi);
-            femDiscreteDphi2(theSpace,xsi,eta,dphidxsi,dphideta);
-            
-            double dxdxsi = 0.0;
-            double dxdeta = 0.0;
-            double dydxsi = 0.0; 
-            double dydeta = 0.0;
-            for (i = 0; i < theSpace->n; i++) {  
-                dxdxsi += x[i]*dphidxsi[i];       
-                dxdeta += x[i]*dphideta[i];   
-                dydxsi += y[i]*dphidxsi[i];   
-                dydeta += y[i]*dphideta[i];
-            }
-            double jac = fabs(dxdxsi * dydeta - dxdeta * dydxsi);
-            
+            femDiscretePhi(theSpace,xsi,phi);
+            // contribution of condition is added to load vector
             for (i = 0; i < theSpace->n; i++) {    
-                dphidx[i] = (dphidxsi[i] * dydeta - dphideta[i] * dydxsi) / jac;       
-                dphidy[i] = (dphideta[i] * dxdxsi - dphidxsi[i] * dxdeta) / jac;
-            }            
-            for (i = 0; i < theSpace->n; i++) { 
-                for(j = 0; j < theSpace->n; j++) {
-                    A[mapX[i]][mapX[j]] += (dphidx[i] * a * dphidx[j] + 
-                                            dphidy[i] * c * dphidy[j]) * jac * weight;                                                                                            
-                    A[mapX[i]][mapY[j]] += (dphidx[i] * b * dphidy[j] + 
-                                            dphidy[i] * c * dphidx[j]) * jac * weight;                                                                                           
-                    A[mapY[i]][mapX[j]] += (dphidy[i] * b * dphidx[j] + 
-                                            dphidx[i] * c * dphidy[j]) * jac * weight;                                                                                            
-                    A[mapY[i]][mapY[j]] += (dphidy[i] * a * dphidy[j] + 
-                                            dphidx[i] * c * dphidx[j]) *
-                                             jac * weight;
-                }
-            }
-            for (i = 0; i < theSpace->n; i++) {
-                B[mapY[i]] -= phi[i] * g * rho * jac * weight;
+                B[mapU[i]] += jac * weight * phi[i] * value; 
             }
         }
-    } 
+    }
 }
 
-void femElasticityAssembleNeumann(femProblem *theProblem){
-    femFullSystem  *theSystem = theProblem->system;
-    femIntegration *theRule = theProblem->ruleEdge;
-    femDiscrete    *theSpace = theProblem->spaceEdge;
-    femGeo         *theGeometry = theProblem->geometry;
-    femNodes       *theNodes = theGeometry->theNodes;
-    femMesh        *theEdges = theGeometry->theEdges;
-    double x[2],y[2],phi[2];
-    int iBnd,iElem,iInteg,iEdge,i,j,d,map[2],mapU[2];
-    int nLocal = 2;
-    double *B  = theSystem->B;
+// adds the Neumann loads into B, number gives the position of the nodes (NULL for the natural ordering)
+static void femElasticityNeumannLoads(femProblem *theProblem, double *B, int *number){
+    int iBnd;
+    int nEdges = 0;
+    femProfileBegin(FEM_PHASE_NEUMANN);
 
     for(iBnd=0; iBnd < theProblem->nBoundaryConditions; iBnd++){
         femBoundaryCondition *theCondition = theProblem->conditions[iBnd];
         femBoundaryType type = theCondition->type;
-        double value = theCondition->value;
 
-        //
-        // A completer :-)   
-        //
         int shift=-1;
         if (type == NEUMANN_X)
             shift = 0;      
@@ -924,123 +1434,306 @@ void femElasticityAssembleNeumann(femProblem *theProblem){
         if (shift == -1)
             continue; // if the boundary condition is not of type neumann skip this boundary altogether
 
-        // loop over every boundary element (edge) for this boundary
-        for(iEdge=0; iEdge < theCondition->domain->nElem; iEdge++){
-            iElem = theCondition->domain->elem[iEdge];
-            for (j=0; j < nLocal; j++) { // loop over edges of the boundary element
-                map[j]  = theEdges->elem[iElem*nLocal+j]; // get nodes forming edge
-                mapU[j] = 2*map[j] + shift; // similar to what happened in previous function, setting values in right place in the vector
-                // get coordinates of the edge's nodes (later used to calculate edge length)
-                x[j]    = theNodes->X[map[j]];
-                y[j]    = theNodes->Y[map[j]];
-            } 
- 
-            // jacobian is just the length of the edge / 2
-            double dx = x[1] - x[0];
-            double dy = y[1] - y[0];
-            double jac = sqrt(dx*dx + dy*dy)/2.0;
-            
-            // integrating over the edge
-            for (iInteg=0; iInteg < theRule->n; iInteg++) {    
-                double xsi    = theRule->xsi[iInteg];
-                double weight = theRule->weight[iInteg];  
-                femDiscretePhi(theSpace,xsi,phi);
-                // contribution of condition is added to load vector
-                for (i = 0; i < theSpace->n; i++) {    
-                    B[mapU[i]] += jac * weight * phi[i] * value; 
-                }
-            }
-        }
+        nEdges += theCondition->domain->nElem;
+        femElasticityEdgeLoads(theProblem, theCondition->domain, shift, theCondition->value, B, number);
     }
+    femProfileCount(0, nEdges * (8.0 + theProblem->ruleEdge->n * 10.0));
+    femProfileEnd(FEM_PHASE_NEUMANN);
 }
 
-double* femElasticitySolve(femProblem *theProblem){
+// nodal loads (natural ordering) of a uniform traction NEUMANN_X or NEUMANN_Y on a domain, added to B
+void femElasticityTractionLoads(femProblem *theProblem, femDomain *theDomain, femBoundaryType type, double value, double *B){
+    if (type != NEUMANN_X && type != NEUMANN_Y)
+        Error("A traction is a NEUMANN_X or NEUMANN_Y condition");
+    femElasticityEdgeLoads(theProblem, theDomain, (type == NEUMANN_X) ? 0 : 1, value, B, NULL);
+}
 
+void femElasticityAssembleNeumann(femProblem *theProblem){
+    femElasticityNeumannLoads(theProblem, femElasticitySystemB(theProblem), theProblem->number);
+}
+
+// assembles the stiffness matrix, applies the dirichlet conditions and factorizes the system
+// the right-hand side of the constrained system without loads is kept as the lift
+void femElasticityFactorize(femProblem *theProblem){
+    int size = femElasticitySystemSize(theProblem);
+    femElasticitySystemInit(theProblem); // start with fresh system
+    femElasticityAssembleElements(theProblem); // bulk of the stiffness matrix
+    if (theProblem->shift != 0.0) femElasticitySystemShift(theProblem);
 
-    femFullSystem  *theSystem = theProblem->system; // retrieve system structure (containing stiffness matrix A and load vector B)
-    femFullSystemInit(theSystem); // resets and reallocates memory so we start with fresh system, just keeping the end results from previous steps
-    // calls two previous functions
-    // printf("INITIALIZED SYSTEM\n");
-    femElasticityAssembleElements(theProblem); // assembles contributions from all elements (bulk of stiffness matrix and body forces)
-    // printf("ASSEMBLED ELEMENTS\n");
-    femElasticityAssembleNeumann(theProblem); // adds contributions form Neumann conditions to load vector
-    // printf("ASSEMBLED NEUMANN\n");
+    double *B = femElasticitySystemB(theProblem);
+    for (int i=0; i < size; i++) B[i] = 0.0;
 
     // applying dirichlet boundary conditions
+    femProfileBegin(FEM_PHASE_CONSTRAIN);
     int *theConstrainedNodes = theProblem->constrainedNodes;
-    for (int i=0; i < theSystem->size; i++) {
+    for (int i=0; i < size; i++) {
         if (theConstrainedNodes[i] != -1) { // if condition exists and has prescribed value (would have been set to -1 if it didn't)
             double value = theProblem->conditions[theConstrainedNodes[i]]->value;
-            femFullSystemConstrain(theSystem,i,value); // for each constrained dof, modify system so that displacement is fixes here
+            femElasticitySystemConstrain(theProblem,femElasticityDof(theProblem,i/2,i%2),value);
         }
     }
-    // printf("APPLIED DIRICHLET\n");
-    // solving system by gaussian elimination
-    femFullSystemEliminate(theSystem);
-    // printf("PERFORMED GAUSSIAN ELIMINATION\n");
-    // storing the solution in the system for further processing
-    memcpy(theProblem->soluce, theSystem->B, sizeof(double) * theSystem->size);
+    memcpy(theProblem->lift, B, sizeof(double) * size);
+    femProfileEnd(FEM_PHASE_CONSTRAIN);
+
+    femProfileBegin(FEM_PHASE_FACTOR);
+    if (theProblem->mixedSystem) femMixedSystemFree(theProblem->mixedSystem);
+    theProblem->mixedSystem = NULL;
+    if (theProblem->precision == FEM_MIXED && theProblem->solverType != FEM_MULTIGRID) {
+        // the single precision factor comes on top of the double system, kept for the residuals
+        int band = (theProblem->solverType == FEM_BAND) ? theProblem->bandSystem->band : size;
+        if (!femMemoryFits(sizeof(float) * size * (size_t) (band+1))) {
+            printf("Solver  : no room for the single precision factor, factorizing in double\n");
+            theProblem->precision = FEM_DOUBLE; }
+        else {
+            femMixedSystem *theMixed = (theProblem->solverType == FEM_BAND) ?
+                femMixedSystemCreateBand(theProblem->bandSystem) : femMixedSystemCreateFull(theProblem->system);
+            femProfileCount(0, (double) size * band * band);
+            if (femMixedSystemFactor(theMixed)) theProblem->mixedSystem = theMixed;
+            else {
+                printf("Solver  : the single precision factorization failed, factorizing in double\n");
+                femMixedSystemFree(theMixed);
+                theProblem->precision = FEM_DOUBLE; }}}
+    if (theProblem->mixedSystem == NULL) {
+        if (theProblem->solverType == FEM_BAND) {
+            femBandSystemFactor(theProblem->bandSystem);
+            femProfileCount(0, (double) size * theProblem->bandSystem->band * theProblem->bandSystem->band); }
+        else if (theProblem->solverType == FEM_MULTIGRID)
+            femMultigridSetup(theProblem->multigrid, theProblem);
+        else {
+            femFullSystemFactor(theProblem->system);
+            femProfileCount(0, 2.0/3.0 * (double) size * size * size); }}
+    femProfileEnd(FEM_PHASE_FACTOR);
+    theProblem->factorized = TRUE;
+}
+
+// FEM_MIXED factorizes in single precision and refines the solutions against the double system
+void femElasticitySetPrecision(femProblem *theProblem, femPrecision precision) {
+    theProblem->precision = precision;
+    theProblem->factorized = FALSE;
+}
+
+static void femElasticitySystemMultiply(femProblem *theProblem, const double *x, double *y) {
+    if (theProblem->solverType == FEM_BAND) femBandSystemMultiply(theProblem->bandSystem, x, y);
+    else femFullSystemMultiply(theProblem->system, x, y);
+}
+
+// solves in place for b (system ordering) : single precision corrections until the residual in
+// double is at the level of a double factorization, which replaces them when they stall
+static int femElasticitySolveMixed(femProblem *theProblem, double *b) {
+    femMixedSystem *theMixed = theProblem->mixedSystem;
+    int i, step, size = femElasticitySystemSize(theProblem);
+    double *x = femMalloc(FEM_MEM_SOLVER, sizeof(double) * 3 * size), *r = x + size, *d = r + size;
+    double limit = sqrt((double) size) * DBL_EPSILON * theMixed->norm;
+    double residual = 0.0, previous = INFINITY, xMax = 0.0;
+    for (i = 0; i < size; i++) { x[i] = 0.0; r[i] = b[i]; }
+    for (step = 1; step <= FEM_MIXED_STEPS; step++) {
+        memcpy(d, r, sizeof(double) * size);
+        femMixedSystemSolve(theMixed, d);
+        for (i = 0; i < size; i++) x[i] += d[i];
+        femElasticitySystemMultiply(theProblem, x, r);
+        residual = 0.0; xMax = 0.0;
+        for (i = 0; i < size; i++) {
+            r[i] = b[i] - r[i];
+            residual = fmax(residual, fabs(r[i]));
+            xMax = fmax(xMax, fabs(x[i])); }
+        if (residual <= limit * xMax) {
+            memcpy(b, x, sizeof(double) * size);
+            femFree(x);
+            return step; }
+        if (residual > 0.5 * previous) break;
+        previous = residual; }
+
+    printf("Solver  : iterative refinement stalled at a residual %.2e, factorizing in double\n",
+           residual / (theMixed->norm * fmax(xMax, DBL_MIN)));
+    femMixedSystemFree(theMixed);
+    theProblem->mixedSystem = NULL;
+    theProblem->precision = FEM_DOUBLE;
+    double *B = femElasticitySystemB(theProblem);
+    if (B != b) memcpy(B, b, sizeof(double) * size);
+    if (theProblem->solverType == FEM_BAND) {
+        femBandSystemFactor(theProblem->bandSystem);
+        femBandSystemSolve(theProblem->bandSystem); }
+    else {
+        femFullSystemFactor(theProblem->system);
+        femFullSystemSolve(theProblem->system); }
+    if (B != b) memcpy(b, B, sizeof(double) * size);
+    femFree(x);
+    return -1;
+}
+
+// solves for the current loads (gravity and neumann conditions) with the stored factorization
+double* femElasticitySolveFactorized(femProblem *theProblem){
+    if (!theProblem->factorized)
+        femElasticityFactorize(theProblem);
+
+    femMesh *theMesh = theProblem->geometry->theElements;
+    double Bloc[8];
+    int iElem,i,j,map[4];
+    int nLocal = theMesh->nLocalNode;
+    int size = femElasticitySystemSize(theProblem);
+    double *B = femElasticitySystemB(theProblem);
+
+    femProfileBegin(FEM_PHASE_ASSEMBLY);
+    for (i=0; i < size; i++) B[i] = 0.0;
+    for (iElem = 0; iElem < theMesh->nElem; iElem++) {
+        femElasticityElementMatrix(theProblem,iElem,NULL,Bloc,map);
+        for (j=0; j < nLocal; j++) {
+            B[femElasticityDof(theProblem,map[j],0)] += Bloc[2*j];
+            B[femElasticityDof(theProblem,map[j],1)] += Bloc[2*j+1]; }}
+    femProfileEnd(FEM_PHASE_ASSEMBLY);
+    femElasticityNeumannLoads(theProblem, B, theProblem->number);
+
+    // constrained dofs take the imposed value, the others are shifted by the lift
+    for (i=0; i < size; i++) {
+        int dof = femElasticityDof(theProblem,i/2,i%2);
+        if (theProblem->constrainedNodes[i] != -1) B[dof] = theProblem->lift[dof];
+        else B[dof] += theProblem->lift[dof]; }
+
+    femProfileBegin(FEM_PHASE_SOLVE);
+    if (theProblem->mixedSystem != NULL) {
+        int band = theProblem->mixedSystem->band;
+        int steps = femElasticitySolveMixed(theProblem, B);
+        if (steps > 0) printf("Solver  : mixed precision, %d refinement steps \n", steps);
+        femProfileCount(0, 8.0 * size * band * abs(steps)); }
+    else if (theProblem->solverType == FEM_BAND) {
+        femBandSystemSolve(theProblem->bandSystem);
+        femProfileCount(0, 4.0 * size * theProblem->bandSystem->band); }
+    else if (theProblem->solverType == FEM_MULTIGRID) {
+        // the current solution is the starting point of the iterations
+        theProblem->multigrid->monitor = theProblem->monitor;
+        int iterations = femMultigridSolve(theProblem->multigrid, B, theProblem->soluce);
+        printf("Solver  : multigrid CG in %d iterations \n", iterations);
+        memcpy(B, theProblem->soluce, sizeof(double) * size); }
+    else {
+        femFullSystemSolve(theProblem->system);
+        femProfileCount(0, 2.0 * size * size); }
+    femProfileEnd(FEM_PHASE_SOLVE);
+
+    // storing the solution in the natural ordering for further processing
+    for (i=0; i < size; i++)
+        theProblem->soluce[i] = B[femElasticityDof(theProblem,i/2,i%2)];
     return theProblem->soluce;
 }
 
+// displacements due to extra loads alone (natural ordering, homogeneous dirichlet conditions) for
+// nRhs load vectors stored one after the other, the band factor is read once for all of them
+void femElasticitySolveIncrements(femProblem *theProblem, int nRhs, const double *loads, double *soluces){
+    if (!theProblem->factorized)
+        femElasticityFactorize(theProblem);
+    int i,r;
+    int size = femElasticitySystemSize(theProblem);
+
+    femProfileBegin(FEM_PHASE_SOLVE);
+    if (theProblem->mixedSystem != NULL) {
+        double *B = femMalloc(FEM_MEM_SOLVER, sizeof(double) * size);
+        for (r=0; r < nRhs; r++) {
+            for (i=0; i < size; i++)
+                B[femElasticityDof(theProblem,i/2,i%2)] = (theProblem->constrainedNodes[i] != -1) ? 0.0 : loads[r*size+i];
+            // after a fallback the double factor takes the remaining loads
+            if (theProblem->mixedSystem != NULL) femElasticitySolveMixed(theProblem, B);
+            else if (theProblem->solverType == FEM_BAND) femBandSystemSolveMultiple(theProblem->bandSystem, B, 1);
+            else {
+                memcpy(theProblem->system->B, B, sizeof(double) * size);
+                memcpy(B, femFullSystemSolve(theProblem->system), sizeof(double) * size); }
+            for (i=0; i < size; i++)
+                soluces[r*size+i] = B[femElasticityDof(theProblem,i/2,i%2)]; }
+        femFree(B); }
+    else if (theProblem->solverType == FEM_BAND) {
+        double *X = femMalloc(FEM_MEM_SOLVER, sizeof(double) * size * nRhs);
+        for (i=0; i < size; i++) {
+            int dof = femElasticityDof(theProblem,i/2,i%2);
+            for (r=0; r < nRhs; r++)
+                X[dof*nRhs+r] = (theProblem->constrainedNodes[i] != -1) ? 0.0 : loads[r*size+i]; }
+        femBandSystemSolveMultiple(theProblem->bandSystem, X, nRhs);
+        for (i=0; i < size; i++) {
+            int dof = femElasticityDof(theProblem,i/2,i%2);
+            for (r=0; r < nRhs; r++)
+                soluces[r*size+i] = X[dof*nRhs+r]; }
+        femFree(X);
+        femProfileCount(0, 4.0 * size * theProblem->bandSystem->band * nRhs); }
+    else if (theProblem->solverType == FEM_MULTIGRID) {
+        // the monitored quantities are those of the full loading, not of the increments
+        double *B = femMalloc(FEM_MEM_SOLVER, sizeof(double) * size);
+        theProblem->multigrid->monitor = NULL;
+        for (r=0; r < nRhs; r++) {
+            for (i=0; i < size; i++) {
+                B[i] = (theProblem->constrainedNodes[i] != -1) ? 0.0 : loads[r*size+i];
+                soluces[r*size+i] = 0.0; }
+            femMultigridSolve(theProblem->multigrid, B, &soluces[r*size]); }
+        femFree(B); }
+    else {
+        double *B = theProblem->system->B;
+        for (r=0; r < nRhs; r++) {
+            for (i=0; i < size; i++)
+                B[femElasticityDof(theProblem,i/2,i%2)] = (theProblem->constrainedNodes[i] != -1) ? 0.0 : loads[r*size+i];
+            femFullSystemSolve(theProblem->system);
+            for (i=0; i < size; i++)
+                soluces[r*size+i] = B[femElasticityDof(theProblem,i/2,i%2)]; }
+        femProfileCount(0, 2.0 * size * size * nRhs); }
+    femProfileEnd(FEM_PHASE_SOLVE);
+}
+
+double* femElasticitySolve(femProblem *theProblem){
+    femElasticityFactorize(theProblem);
+    return femElasticitySolveFactorized(theProblem);
+}
+
 // compute the residual forces after a solution has been obtained (difference between internal stresses and external loads)
+// computed element by element so that the factorized system is left untouched
 double* femElasticityForces(femProblem *theProblem){        
-           
-
-    // reload and reinitialise the system for a fresh slate but with saved results so we're up to date
-    femFullSystem  *theSystem = theProblem->system;
-    femFullSystemInit(theSystem);
-    femElasticityAssembleElements(theProblem);
-    femElasticityAssembleNeumann(theProblem);      
-    // initializing residuals vector to zero
+    femMesh *theMesh = theProblem->geometry->theElements;
+    double Aloc[64],Bloc[8],Uloc[8];
+    int iElem,i,j,map[4];
+    int nLocal = theMesh->nLocalNode;
+    int nLoc = 2*nLocal;
+    int size = 2*theProblem->geometry->theNodes->nNodes;
     double *theResidual = theProblem->residuals;
-    // matrix vector multiplication A cross u
-    for(int i=0; i < theSystem->size; i++){
-        for(int j=0; j < theSystem->size; j++){
-            theResidual[i] += theSystem->A[i][j] * theProblem->soluce[j];
-        }
-        theResidual[i] -= theSystem->B[i]; // load is subtracted to get residue
-    }
+    double *theSoluce = theProblem->soluce;
+
+    femProfileBegin(FEM_PHASE_FORCES);
+    femElasticityFactors(theProblem);
+    for (i=0; i < size; i++) theResidual[i] = 0.0;
+    for (iElem = 0; iElem < theMesh->nElem; iElem++) {
+        femElasticityElementMatrix(theProblem,iElem,Aloc,Bloc,map);
+        for (j=0; j < nLocal; j++) {
+            Uloc[2*j]   = theSoluce[2*map[j]];
+            Uloc[2*j+1] = theSoluce[2*map[j]+1]; }
+        // elementary A cross u minus the load
+        for (i=0; i < nLoc; i++) {
+            double r = -Bloc[i];
+            for (j=0; j < nLoc; j++)
+                r += Aloc[i*nLoc+j] * Uloc[j];
+            theResidual[2*map[i/2]+i%2] += r; }}
+    
+    // load is subtracted to get residue
+    double *theLoads = femMalloc(FEM_MEM_POST, sizeof(double) * size);
+    for (i=0; i < size; i++) theLoads[i] = 0.0;
+    femElasticityNeumannLoads(theProblem, theLoads, NULL);
+    for (i=0; i < size; i++) theResidual[i] -= theLoads[i];
+    femFree(theLoads);
+    femProfileCount(0, (double) theMesh->nElem * (femElasticityElementFlops(theProblem) + 2.0*nLoc*nLoc));
+    femProfileEnd(FEM_PHASE_FORCES);
 
     return theProblem->residuals;
 }
 
-double femElasticityIntegrate(femProblem *theProblem, double (*f)(double x, double y)){
-    femIntegration *theRule = theProblem->rule;
-    femGeo         *theGeometry = theProblem->geometry;
-    femNodes       *theNodes = theGeometry->theNodes;
-    femMesh        *theMesh = theGeometry->theElements;
-    femDiscrete    *theSpace = theProblem->space;
+typedef struct {
+    double (*f)(double x, double y);
+} femElasticityIntegrand;
 
-    double x[4],y[4],phi[4],dphidxsi[4],dphideta[4],dphidx[4],dphidy[4];
-    int iElem,iInteg,i,map[4];
-    int nLocal = theMesh->nLocalNode;
-    double value = 0.0;
-    for (iElem = 0; iElem < theMesh->nElem; iElem++) {
-        for (i=0; i < nLocal; i++) {
-            map[i]  = theMesh->elem[iElem*nLocal+i];
-            x[i]    = theNodes->X[map[i]];
-            y[i]    = theNodes->Y[map[i]];} 
-        for (iInteg=0; iInteg < theRule->n; iInteg++) {    
-            double xsi    = theRule->xsi[iInteg];
-            double eta    = theRule->eta[iInteg];
-            double weight = theRule->weight[iInteg];  
-            femDiscretePhi2(theProblem->space,xsi,eta,phi);
-            femDiscreteDphi2(theSpace,xsi,eta,dphidxsi,dphideta);
-            double dxdxsi = 0.0;
-            double dxdeta = 0.0;
-            double dydxsi = 0.0; 
-            double dydeta = 0.0;
-            for (i = 0; i < theSpace->n; i++) {  
-                dxdxsi += x[i]*dphidxsi[i];       
-                dxdeta += x[i]*dphideta[i];   
-                dydxsi += y[i]*dphidxsi[i];   
-                dydeta += y[i]*dphideta[i]; }
-            double jac = fabs(dxdxsi * dydeta - dxdeta * dydxsi);
-            for (i = 0; i < theProblem->space->n; i++) {    
-                value += phi[i] * f(x[i],y[i]) * jac * weight; }}}
-    return value;
+static void femElasticityIntegratePoints(const femIntegrationPoints *points, int nFields, double *values, void *data) {
+    femElasticityIntegrand *theIntegrand = data;
+    (void) nFields;                 // always one
+    for (int i = 0; i < points->n; i++)
+        values[i] = theIntegrand->f(points->x[i], points->y[i]);
+}
 
+// integral of f over the mesh, a single field of femIntegrals
+double femElasticityIntegrate(femProblem *theProblem, double (*f)(double x, double y)){
+    femElasticityIntegrand theIntegrand = { f };
+    double value;
+    femIntegrals(theProblem, femElasticityIntegratePoints, &theIntegrand, 1, &value, 0);
+    return value;
 }
 
 
@@ -1064,7 +1757,7 @@ static const double _gaussEdge2Weight[2] = { 1.000000000000000, 1.00000000000000
 // sets up the integration method using gauss quadrature, depending on element type.
 femIntegration *femIntegrationCreate(int n, femElementType type) {
     
-    femIntegration *theRule = malloc(sizeof(femIntegration));
+    femIntegration *theRule = femMalloc(FEM_MEM_SOLVER, sizeof(femIntegration));
 
     if (type == FEM_QUAD && n == 4) {
         theRule->n      = 4;
@@ -1090,7 +1783,7 @@ femIntegration *femIntegrationCreate(int n, femElementType type) {
 }
 
 void femIntegrationFree(femIntegration *theRule) {
-    free(theRule);
+    femFree(theRule);
 }
 
 
@@ -1140,6 +1833,7 @@ void _p1c0_phi(double xsi, double eta, double *phi) {
     phi[2] = eta;
 }
 void _p1c0_dphidx(double xsi, double eta, double *dphidxsi, double *dphideta) {
+    (void) xsi; (void) eta;
     dphidxsi[0] = -1.0;  
     dphidxsi[1] =  1.0;
     dphidxsi[2] =  0.0;
@@ -1156,6 +1850,7 @@ void _e1c0_phi(double xsi,  double *phi) {
     phi[1] = (1 + xsi) / 2.0;
 }
 void _e1c0_dphidx(double xsi, double *dphidxsi) {
+    (void) xsi;
     dphidxsi[0] = -0.5;  
     dphidxsi[1] =  0.5;
 }
@@ -1165,7 +1860,7 @@ void _e1c0_dphidx(double xsi, double *dphidxsi) {
 // creates the space once, then it's reused to solve each element in the mesh
 femDiscrete *femDiscreteCreate(int n, femElementType type) {
     
-    femDiscrete *theSpace = malloc(sizeof(femDiscrete));
+    femDiscrete *theSpace = femMalloc(FEM_MEM_SOLVER, sizeof(femDiscrete));
     // EN SOIT ON POURRAIT ENLEVER LES LIGNES QUI SUIVENT ET INITIALISER DIRECTEMENT QUAND ON LES UTILISE
     // MAIS PLUS SAFE COMME CA DU PDV DE MEMOIRE
     theSpace->type = type;
@@ -1201,7 +1896,7 @@ femDiscrete *femDiscreteCreate(int n, femElementType type) {
 }
 
 void femDiscreteFree(femDiscrete *theSpace) {
-    free(theSpace);
+    femFree(theSpace);
 }
 
 void femDiscretePrint(femDiscrete *mySpace) {
@@ -1267,7 +1962,7 @@ void femDiscreteDphi(femDiscrete* mySpace, double xsi, double *dphidxsi) {
 // allocates full algebraic system and initializes it
 femFullSystem *femFullSystemCreate(int size) {
     
-    femFullSystem *theSystem = malloc(sizeof(femFullSystem));
+    femFullSystem *theSystem = femMalloc(FEM_MEM_SYSTEM, sizeof(femFullSystem));
     
     femFullSystemAlloc(theSystem, size);
     femFullSystemInit(theSystem);
@@ -1278,9 +1973,9 @@ femFullSystem *femFullSystemCreate(int size) {
 
 // this one too foo
 void femFullSystemFree(femFullSystem *theSystem) {
-    free(theSystem->A);
-    free(theSystem->B);
-    free(theSystem);
+    femFree(theSystem->A);
+    femFree(theSystem->B);
+    femFree(theSystem);
 }
 
 // pretty self explainatory eh
@@ -1317,8 +2012,8 @@ void femFullSystemInit(femFullSystem *mySystem) {
 void femFullSystemAlloc(femFullSystem *mySystem, int size)
 {
     int i;  
-    double *elem = malloc(sizeof(double) * size * (size+1)); 
-    mySystem->A = malloc(sizeof(double*) * size); 
+    double *elem = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * size * (size+1)); 
+    mySystem->A = femMalloc(FEM_MEM_SYSTEM, sizeof(double*) * size); 
     mySystem->B = elem;
     mySystem->A[0] = elem + size;  
     mySystem->size = size;
@@ -1387,6 +2082,489 @@ void  femFullSystemConstrain(femFullSystem *mySystem, int myNode, double myValue
 
 
 
+// LU factorization in place without pivoting, the multipliers are stored in the lower part
+void femFullSystemFactor(femFullSystem *mySystem)
+{
+    double  **A, factor;
+    int     i, j, k, size;
+    
+    A    = mySystem->A;
+    size = mySystem->size;
+    
+    for (k=0; k < size; k++) {
+        if ( fabs(A[k][k]) <= 1e-16 ) {
+            printf("Pivot index %d  ",k);
+            printf("Pivot value %e  ",A[k][k]);
+            Error("Cannot eliminate with such a pivot"); }
+        for (i = k+1 ; i <  size; i++) {
+            factor = A[i][k] / A[k][k];
+            A[i][k] = factor;
+            for (j = k+1 ; j < size; j++) 
+                A[i][j] = A[i][j] - A[k][j] * factor; }}
+}
+
+// forward and backward substitution on a factorized system, B is replaced by the solution
+double* femFullSystemSolve(femFullSystem *mySystem)
+{
+    double  **A, *B, factor;
+    int     i, j, size;
+    
+    A    = mySystem->A;
+    B    = mySystem->B;
+    size = mySystem->size;
+
+    for (i = 1; i < size; i++) {
+        factor = 0;
+        for (j = 0; j < i; j++)
+            factor += A[i][j] * B[j];
+        B[i] -= factor; }
+    
+    for (i = size-1; i >= 0 ; i--) {
+        factor = 0;
+        for (j = i+1 ; j < size; j++)
+            factor += A[i][j] * B[j];
+        B[i] = ( B[i] - factor)/A[i][i]; }
+    
+    return(mySystem->B);    
+}
+
+// y = A x, only meaningful before the factorization overwrites A
+void femFullSystemMultiply(femFullSystem *mySystem, const double *x, double *y)
+{
+    double **A = mySystem->A;
+    int i, j, size = mySystem->size;
+    for (i = 0; i < size; i++) {
+        double sum = 0.0;
+        for (j = 0; j < size; j++)
+            sum += A[i][j] * x[j];
+        y[i] = sum; }
+}
+
+
+
+/*
+*
+* BAND SYSTEM FUNCTIONS
+*
+*/
+
+// bytes allocated by femFullSystemCreate or femBandSystemCreate for a system of this size,
+// for the multigrid solver about 18 nonzeros per row, the coarse levels and the vectors of the cycles
+size_t femSystemMemory(femSolverType solverType, int size, int band)
+{
+    if (solverType == FEM_MULTIGRID)
+        return 2 * (sizeof(femSparseSystem) + (18 * (sizeof(double) + sizeof(int)) + 3 * sizeof(int)
+                                               + 8 * sizeof(double)) * (size_t) size);
+    if (solverType == FEM_BAND) {
+        if (band > size) band = size;
+        return sizeof(femBandSystem) + (sizeof(double) * (band+1) + sizeof(double*)) * (size_t) size; }
+    return sizeof(femFullSystem) + (sizeof(double) * (size+1) + sizeof(double*)) * (size_t) size;
+}
+
+// symmetric band system : only the upper band A[i][j] with i <= j < i+band is stored
+femBandSystem *femBandSystemCreate(int size, int band)
+{
+    femBandSystem *myBandSystem = femMalloc(FEM_MEM_SYSTEM, sizeof(femBandSystem));
+    femBandSystemAlloc(myBandSystem, size, band);
+    femBandSystemInit(myBandSystem);
+    return myBandSystem;
+}
+
+void femBandSystemFree(femBandSystem *myBandSystem)
+{
+    femFree(myBandSystem->B);
+    femFree(myBandSystem->A); 
+    femFree(myBandSystem);
+}
+
+// each row pointer is shifted so that A[i][j] addresses the band with the global column index
+void femBandSystemAlloc(femBandSystem *myBandSystem, int size, int band)
+{
+    int i;
+    if (band > size) band = size;
+    double *elem = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * size * (band+1)); 
+    myBandSystem->A = femMalloc(FEM_MEM_SYSTEM, sizeof(double*) * size); 
+    myBandSystem->B = elem;
+    myBandSystem->A[0] = elem + size;  
+    myBandSystem->size = size;  
+    myBandSystem->band = band;        
+    for (i=1 ; i < size ; i++) 
+        myBandSystem->A[i] = myBandSystem->A[i-1] + band - 1;
+}
+
+void femBandSystemInit(femBandSystem *myBandSystem)
+{
+    int i;
+    int size = myBandSystem->size;
+    int band = myBandSystem->band;
+    for (i=0 ; i < size*(band+1) ; i++) 
+        myBandSystem->B[i] = 0;        
+}
+
+void femBandSystemConstrain(femBandSystem *myBandSystem, int myNode, double myValue)
+{
+    double  **A, *B;
+    int     i, size, band, ifirst, iend;
+    
+    A    = myBandSystem->A;
+    B    = myBandSystem->B;
+    size = myBandSystem->size;
+    band = myBandSystem->band;
+    
+    ifirst = fmax(0,myNode - band + 1);
+    iend   = myNode;
+    for (i=ifirst; i < iend; i++) {
+        B[i] -= myValue * A[i][myNode];
+        A[i][myNode] = 0; }
+    
+    ifirst = myNode+1;
+    iend   = fmin(myNode + band,size);
+    for (i=ifirst; i < iend; i++) {
+        B[i] -= myValue * A[myNode][i];
+        A[myNode][i] = 0; }
+    
+    A[myNode][myNode] = 1;
+    B[myNode] = myValue;
+}
+
+// symmetric gaussian elimination restricted to the band, the rows of U are kept
+void femBandSystemFactor(femBandSystem *myBand)
+{
+    double  **A, factor;
+    int     i, j, k, jend, size, band;
+    A    = myBand->A;
+    size = myBand->size;
+    band = myBand->band;
+    
+    for (k=0; k < size; k++) {
+        if ( fabs(A[k][k]) <= 1e-16 ) {
+            printf("Pivot index %d  ",k);
+            printf("Pivot value %e  ",A[k][k]);
+            Error("Cannot eliminate with such a pivot"); }
+        jend = fmin(k + band,size);
+        for (i = k+1 ; i <  jend; i++) {
+            factor = A[k][i] / A[k][k];
+            for (j = i ; j < jend; j++) 
+                A[i][j] = A[i][j] - A[k][j] * factor; }}
+}
+
+double *femBandSystemSolve(femBandSystem *myBand)
+{
+    double  **A, *B, factor;
+    int     i, j, k, jend, size, band;
+    A    = myBand->A;
+    B    = myBand->B;
+    size = myBand->size;
+    band = myBand->band;
+
+    for (k=0; k < size; k++) {
+        jend = fmin(k + band,size);
+        for (i = k+1 ; i < jend; i++)
+            B[i] -= B[k] * A[k][i] / A[k][k]; }
+
+    for (i = (size-1); i >= 0 ; i--) {
+        factor = 0;
+        jend = fmin(i + band,size);
+        for (j = i+1 ; j < jend; j++)
+            factor += A[i][j] * B[j];
+        B[i] = ( B[i] - factor)/A[i][i]; }
+
+    return(myBand->B);
+}
+
+// y = A x with the symmetric upper band, only meaningful before the factorization
+void femBandSystemMultiply(femBandSystem *myBand, const double *x, double *y)
+{
+    double **A = myBand->A;
+    int i, j, jend, size = myBand->size, band = myBand->band;
+    for (i = 0; i < size; i++) y[i] = 0.0;
+    for (i = 0; i < size; i++) {
+        double sum = A[i][i] * x[i];
+        jend = fmin(i + band,size);
+        for (j = i+1; j < jend; j++) {
+            sum  += A[i][j] * x[j];
+            y[j] += A[i][j] * x[i]; }
+        y[i] += sum; }
+}
+
+// substitutions for nRhs right-hand sides stored row by row (X[i*nRhs+r]) on a factorized system
+void femBandSystemSolveMultiple(femBandSystem *myBand, double *X, int nRhs)
+{
+    double  **A = myBand->A;
+    int     i, j, k, r, jend, size = myBand->size, band = myBand->band;
+
+    for (k=0; k < size; k++) {
+        double *Xk = &X[k*nRhs];
+        jend = fmin(k + band,size);
+        for (i = k+1 ; i < jend; i++) {
+            double factor = A[k][i] / A[k][k];
+            double *Xi = &X[i*nRhs];
+            for (r = 0; r < nRhs; r++) Xi[r] -= Xk[r] * factor; }}
+
+    for (i = (size-1); i >= 0 ; i--) {
+        double *Xi = &X[i*nRhs];
+        jend = fmin(i + band,size);
+        for (j = i+1 ; j < jend; j++) {
+            double *Xj = &X[j*nRhs];
+            for (r = 0; r < nRhs; r++) Xi[r] -= A[i][j] * Xj[r]; }
+        for (r = 0; r < nRhs; r++) Xi[r] /= A[i][i]; }
+}
+
+double *femBandSystemEliminate(femBandSystem *myBand)
+{
+    femBandSystemFactor(myBand);
+    return femBandSystemSolve(myBand);
+}
+
+
+
+/*
+*
+* MIXED PRECISION FUNCTIONS
+*
+*/
+
+// single precision copy of the upper band, the double precision system is left untouched
+static femMixedSystem *femMixedSystemAlloc(int size, int band)
+{
+    femMixedSystem *mySystem = femMalloc(FEM_MEM_SYSTEM, sizeof(femMixedSystem));
+    if (band > size) band = size;
+    float *elem = femMalloc(FEM_MEM_SYSTEM, sizeof(float) * size * (band+1));
+    mySystem->A = femMalloc(FEM_MEM_SYSTEM, sizeof(float*) * size);
+    mySystem->B = elem;
+    mySystem->A[0] = elem + size;
+    mySystem->size = size;
+    mySystem->band = band;
+    mySystem->norm = 0.0;
+    for (int i = 1; i < size; i++)
+        mySystem->A[i] = mySystem->A[i-1] + band - 1;
+    return mySystem;
+}
+
+// the full system is symmetric : its upper triangle is a band as wide as the system
+femMixedSystem *femMixedSystemCreateFull(femFullSystem *myFullSystem)
+{
+    int i, j, size = myFullSystem->size;
+    femMixedSystem *mySystem = femMixedSystemAlloc(size, size);
+    for (i = 0; i < size; i++) {
+        double sum = 0.0;
+        for (j = 0; j < size; j++) {
+            sum += fabs(myFullSystem->A[i][j]);
+            if (j >= i) mySystem->A[i][j] = (float) myFullSystem->A[i][j]; }
+        mySystem->norm = fmax(mySystem->norm, sum); }
+    return mySystem;
+}
+
+femMixedSystem *femMixedSystemCreateBand(femBandSystem *myBandSystem)
+{
+    int i, j, jend, size = myBandSystem->size, band = myBandSystem->band;
+    femMixedSystem *mySystem = femMixedSystemAlloc(size, band);
+    double *sum = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * size);
+    for (i = 0; i < size; i++) sum[i] = 0.0;
+    for (i = 0; i < size; i++) {
+        jend = fmin(i + band,size);
+        for (j = i; j < jend; j++) {
+            mySystem->A[i][j] = (float) myBandSystem->A[i][j];
+            sum[i] += fabs(myBandSystem->A[i][j]);
+            if (j > i) sum[j] += fabs(myBandSystem->A[i][j]); }}
+    mySystem->norm = femMax(sum, size);
+    femFree(sum);
+    return mySystem;
+}
+
+void femMixedSystemFree(femMixedSystem *mySystem)
+{
+    femFree(mySystem->A);
+    femFree(mySystem->B);
+    femFree(mySystem);
+}
+
+// same elimination as femBandSystemFactor, returns FALSE instead of stopping on a bad pivot
+int femMixedSystemFactor(femMixedSystem *mySystem)
+{
+    float   **A = mySystem->A, factor;
+    int     i, j, k, jend, size = mySystem->size, band = mySystem->band;
+
+    // distinct rows never overlap : the inner loop can use the full width of the vector units
+    for (k=0; k < size; k++) {
+        const float *restrict pivotRow = A[k];
+        if (!(fabsf(pivotRow[k]) > 0.0f) || isinf(pivotRow[k])) return FALSE;
+        jend = (k + band < size) ? k + band : size;
+        for (i = k+1 ; i <  jend; i++) {
+            float *restrict row = A[i];
+            factor = pivotRow[i] / pivotRow[k];
+            for (j = i ; j < jend; j++)
+                row[j] -= pivotRow[j] * factor; }}
+    return TRUE;
+}
+
+// substitutions in single precision, x is replaced by the solution
+void femMixedSystemSolve(femMixedSystem *mySystem, double *x)
+{
+    float   **A = mySystem->A, *B = mySystem->B, factor;
+    int     i, j, k, jend, size = mySystem->size, band = mySystem->band;
+
+    for (i = 0; i < size; i++) B[i] = (float) x[i];
+    for (k=0; k < size; k++) {
+        const float *restrict pivotRow = A[k];
+        factor = B[k] / pivotRow[k];
+        jend = (k + band < size) ? k + band : size;
+        for (i = k+1 ; i < jend; i++)
+            B[i] -= factor * pivotRow[i]; }
+
+    for (i = (size-1); i >= 0 ; i--) {
+        factor = 0;
+        jend = (i + band < size) ? i + band : size;
+        for (j = i+1 ; j < jend; j++)
+            factor += A[i][j] * B[j];
+        B[i] = ( B[i] - factor)/A[i][i]; }
+    for (i = 0; i < size; i++) x[i] = B[i];
+}
+
+
+
+/*
+*
+* SPARSE SYSTEM FUNCTIONS
+*
+*/
+
+// symmetric pattern of the 2x2 blocks of the nodes sharing an element, in the ordering 2*number[node]+shift
+femSparseSystem *femSparseSystemCreate(femMesh *theMesh, int *number)
+{
+    int nNodes = theMesh->nodes->nNodes;
+    int i,j,k;
+    femSparseSystem *mySystem = femMalloc(FEM_MEM_SYSTEM, sizeof(femSparseSystem));
+    mySystem->size = 2*nNodes;
+
+    // one block row of 2x2 per node, on its neighbours in the mesh
+    femTopology *theTopology = femMeshTopology(theMesh, NULL);
+    mySystem->rowStart = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (2*nNodes+1));
+    mySystem->rowStart[0] = 0;
+    int *count = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * nNodes);
+    for (i = 0; i < nNodes; i++) count[number[i]] = theTopology->nodeNodeStart[i+1] - theTopology->nodeNodeStart[i];
+    for (i = 0; i < nNodes; i++) {
+        mySystem->rowStart[2*i+1] = mySystem->rowStart[2*i]   + 2*count[i];
+        mySystem->rowStart[2*i+2] = mySystem->rowStart[2*i+1] + 2*count[i]; }
+    femFree(count);
+    mySystem->col = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * mySystem->rowStart[2*nNodes]);
+
+    // columns sorted for the lookups, the second dof of each node has the same ones
+    for (i = 0; i < nNodes; i++) {
+        int row = 2*number[i], first = mySystem->rowStart[row], n = 0;
+        for (k = theTopology->nodeNodeStart[i]; k < theTopology->nodeNodeStart[i+1]; k++) {
+            int c = 2*number[theTopology->nodeNode[k]];
+            for (j = n; j > 0 && mySystem->col[first+2*j-2] > c; j--) {
+                mySystem->col[first+2*j]   = mySystem->col[first+2*j-2];
+                mySystem->col[first+2*j+1] = mySystem->col[first+2*j-1]; }
+            mySystem->col[first+2*j]   = c;
+            mySystem->col[first+2*j+1] = c+1;
+            n++; }
+        memcpy(&mySystem->col[mySystem->rowStart[row+1]], &mySystem->col[first], sizeof(int) * 2*n); }
+
+    int nnz = mySystem->rowStart[2*nNodes];
+    mySystem->A = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * nnz);
+    mySystem->B = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * 2*nNodes);
+    mySystem->diag = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * 2*nNodes);
+    for (i = 0; i < 2*nNodes; i++) mySystem->diag[i] = femSparseSystemFind(mySystem, i, i);
+    femSparseSystemInit(mySystem);
+    return mySystem;
+}
+
+void femSparseSystemFree(femSparseSystem *mySystem)
+{
+    femFree(mySystem->A);
+    femFree(mySystem->B);
+    femFree(mySystem->rowStart);
+    femFree(mySystem->col);
+    femFree(mySystem->diag);
+    femFree(mySystem);
+}
+
+void femSparseSystemInit(femSparseSystem *mySystem)
+{
+    int i, nnz = mySystem->rowStart[mySystem->size];
+    for (i = 0; i < nnz; i++) mySystem->A[i] = 0.0;
+    for (i = 0; i < mySystem->size; i++) mySystem->B[i] = 0.0;
+}
+
+// position of A[row][col] in the values, -1 outside of the pattern
+int femSparseSystemFind(femSparseSystem *mySystem, int row, int col)
+{
+    int low = mySystem->rowStart[row], high = mySystem->rowStart[row+1] - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (mySystem->col[middle] == col) return middle;
+        if (mySystem->col[middle] < col) low = middle + 1;
+        else high = middle - 1; }
+    return -1;
+}
+
+// same symmetric elimination as the band system : row and column cleared, the column moves to B
+void femSparseSystemConstrain(femSparseSystem *mySystem, int myNode, double myValue)
+{
+    double *A = mySystem->A, *B = mySystem->B;
+    for (int k = mySystem->rowStart[myNode]; k < mySystem->rowStart[myNode+1]; k++) {
+        int j = mySystem->col[k];
+        if (j == myNode) continue;
+        int position = femSparseSystemFind(mySystem, j, myNode);
+        B[j] -= myValue * A[position];
+        A[position] = 0.0;
+        A[k] = 0.0; }
+    A[mySystem->diag[myNode]] = 1.0;
+    B[myNode] = myValue;
+}
+
+void femSparseSystemMultiply(femSparseSystem *mySystem, const double *x, double *y)
+{
+    for (int i = 0; i < mySystem->size; i++) {
+        double sum = 0.0;
+        for (int k = mySystem->rowStart[i]; k < mySystem->rowStart[i+1]; k++)
+            sum += mySystem->A[k] * x[mySystem->col[k]];
+        y[i] = sum; }
+}
+
+typedef struct {
+    double coord;
+    int node;
+} femRenumEntry;
+
+static int femRenumCompare(const void *a, const void *b) {
+    double diff = ((const femRenumEntry*)a)->coord - ((const femRenumEntry*)b)->coord;
+    return (diff > 0) - (diff < 0);
+}
+
+// fills number (node -> position) by sorting the nodes along a direction and
+// returns the largest position gap between two nodes of the same element
+int femMeshRenumber(femMesh *theMesh, femRenumType renumType, int *number)
+{
+    femNodes *theNodes = theMesh->nodes;
+    int i, j, nNodes = theNodes->nNodes;
+
+    if (renumType == FEM_NO) {
+        for (i = 0; i < nNodes; i++) number[i] = i; }
+    else {
+        double *coord = (renumType == FEM_XNUM) ? theNodes->X : theNodes->Y;
+        femRenumEntry *entries = femMalloc(FEM_MEM_SOLVER, sizeof(femRenumEntry) * nNodes);
+        for (i = 0; i < nNodes; i++) {
+            entries[i].coord = coord[i];
+            entries[i].node  = i; }
+        qsort(entries, nNodes, sizeof(femRenumEntry), femRenumCompare);
+        for (i = 0; i < nNodes; i++) number[entries[i].node] = i;
+        femFree(entries); }
+
+    int nLocal = theMesh->nLocalNode;
+    int gap = 0;
+    for (i = 0; i < theMesh->nElem; i++) {
+        int *elem = &theMesh->elem[i*nLocal];
+        int myMin = number[elem[0]], myMax = number[elem[0]];
+        for (j = 1; j < nLocal; j++) {
+            myMin = fmin(myMin, number[elem[j]]);
+            myMax = fmax(myMax, number[elem[j]]); }
+        gap = fmax(gap, myMax - myMin); }
+    return gap;
+}
+
 
 
 /*
@@ -1455,5 +2633,6 @@ void trim(char *str) {
 
 double fun(double x, double y) 
 {
+    (void) x; (void) y;
     return 1;
 }
\ No newline at end of file
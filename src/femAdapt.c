@@ -0,0 +1,160 @@
+/*
+ *  femAdapt.c
+ *  Zienkiewicz-Zhu error estimator and mesh size field for adaptive remeshing
+ *
+ *  The recovered stress sigma* is the linear interpolation of the nodal
+ *  averages of femStress. On each element the error is the energy norm of
+ *  sigma* - sigma_h, integrated with the rule of the problem. For linear
+ *  elements the error goes as h : the size of an element is scaled by the
+ *  ratio between the error it should have (the target spread evenly over the
+ *  elements) and the error it has, within [1/4,2] per cycle and [hMin,hMax].
+ *  The size field keeps its own copy of the mesh (a femTransfer of the sizes)
+ *  so that gmsh can query it while the next mesh is generated. For a refinement of the mesh itself, the
+ *  elements are marked instead (Dorfler marking).
+ *
+ */
+
+#include "../headers/femAdapt.h"
+
+
+// energy product sigma . D^-1 sigma with the coefficients A, B, C of the problem
+static double femEstimatorEnergy(femProblem *theProblem, double sxx, double syy, double sxy) {
+    double a = theProblem->A, b = theProblem->B, c = theProblem->C;
+    return (a * (sxx*sxx + syy*syy) - 2.0 * b * sxx * syy) / (a*a - b*b) + sxy*sxy / c;
+}
+
+femEstimator *femEstimatorCreate(femStress *theStress) {
+    femProblem *theProblem = theStress->problem;
+    femIntegration *theRule = theProblem->rule;
+    femDiscrete *theSpace = theProblem->space;
+    femEstimator *theEstimator = femMalloc(FEM_MEM_POST, sizeof(femEstimator));
+    int nElem = theStress->nElem;
+    double phi[4];
+    int i,map[4];
+    theEstimator->stress = theStress;
+    theEstimator->nElem = nElem;
+    theEstimator->error = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+
+    femMesh *theMesh = theProblem->geometry->theElements;
+    femElasticityFactors(theProblem);
+    double error = 0.0, energy = 0.0;
+    for (int iElem = 0; iElem < nElem; iElem++) {
+        double errorElem = 0.0;
+        for (i = 0; i < theSpace->n; i++) map[i] = theMesh->elem[iElem*theMesh->nLocalNode+i];
+        for (int iInteg = 0; iInteg < theRule->n; iInteg++) {
+            double jac = femElasticityElementFactors(theProblem,iElem,iInteg,NULL,NULL);
+            femDiscretePhi2(theSpace,theRule->xsi[iInteg],theRule->eta[iInteg],phi);
+            double sxx = -theStress->sxx[iElem];
+            double syy = -theStress->syy[iElem];
+            double sxy = -theStress->sxy[iElem];
+            for (i = 0; i < theSpace->n; i++) {
+                sxx += phi[i] * theStress->nodeSxx[map[i]];
+                syy += phi[i] * theStress->nodeSyy[map[i]];
+                sxy += phi[i] * theStress->nodeSxy[map[i]]; }
+            errorElem += femEstimatorEnergy(theProblem,sxx,syy,sxy) * jac * theRule->weight[iInteg]; }
+        theEstimator->error[iElem] = errorElem;
+        error += errorElem;
+        energy += femEstimatorEnergy(theProblem,theStress->sxx[iElem],theStress->syy[iElem],
+                                     theStress->sxy[iElem]) * theStress->area[iElem]; }
+
+    theEstimator->errorNorm = sqrt(error);
+    theEstimator->energyNorm = sqrt(energy);
+    theEstimator->eta = (error + energy > 0.0) ? sqrt(error / (error + energy)) : 0.0;
+    return theEstimator;
+}
+
+void femEstimatorFree(femEstimator *theEstimator) {
+    femFree(theEstimator->error);
+    femFree(theEstimator);
+}
+
+typedef struct {
+    double error;
+    int elem;
+} femEstimatorEntry;
+
+static int femEstimatorCompare(const void *a, const void *b) {
+    double ea = ((const femEstimatorEntry*) a)->error, eb = ((const femEstimatorEntry*) b)->error;
+    return (ea < eb) - (ea > eb);
+}
+
+// Dorfler marking : the fewest elements holding a fraction theta of the squared error
+int femEstimatorMark(femEstimator *theEstimator, double theta, int *marked) {
+    int nElem = theEstimator->nElem, nMarked = 0;
+    femEstimatorEntry *entries = femMalloc(FEM_MEM_POST, sizeof(femEstimatorEntry) * nElem);
+    for (int i = 0; i < nElem; i++) {
+        entries[i].error = theEstimator->error[i];
+        entries[i].elem = i;
+        marked[i] = FALSE; }
+    qsort(entries, nElem, sizeof(femEstimatorEntry), femEstimatorCompare);
+    double goal = theta * theEstimator->errorNorm * theEstimator->errorNorm, sum = 0.0;
+    while (nMarked < nElem && sum < goal) {
+        sum += entries[nMarked].error;
+        marked[entries[nMarked++].elem] = TRUE; }
+    femFree(entries);
+    return nMarked;
+}
+
+
+/*
+*
+* SIZE FIELD
+*
+*/
+
+static femSizeField *theSizeField = NULL;
+
+static double femSizeFieldCallback(double x, double y) {
+    return femSizeFieldEvaluate(theSizeField, x, y);
+}
+
+// nodal sizes reaching the relative error eta, kept with a copy of the mesh for the lookups
+femSizeField *femSizeFieldCreate(femEstimator *theEstimator, double eta, double hMin, double hMax) {
+    femStress *theStress = theEstimator->stress;
+    femMesh *theMesh = theStress->problem->geometry->theElements;
+    int nNodes = theMesh->nodes->nNodes, nElem = theMesh->nElem, nLocal = theMesh->nLocalNode;
+    int i,j,iElem;
+    double *size = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+
+    // error allowed on each element : the target spread evenly, in energy norm
+    double norm2 = theEstimator->energyNorm * theEstimator->energyNorm
+                 + theEstimator->errorNorm * theEstimator->errorNorm;
+    double allowed = eta * sqrt(norm2 / nElem);
+    double reference = (nLocal == 3) ? 4.0 / sqrt(3.0) : 1.0;     // side of an equilateral element of unit area
+    for (i = 0; i < nNodes; i++) size[i] = hMax;
+    for (iElem = 0; iElem < nElem; iElem++) {
+        double h = sqrt(reference * theStress->area[iElem]);
+        double error = sqrt(theEstimator->error[iElem]);
+        double ratio = (error > 0.0) ? allowed / error : 2.0;
+        ratio = fmax(0.25, fmin(2.0, ratio));
+        h = fmax(hMin, fmin(hMax, h * ratio));
+        for (j = 0; j < nLocal; j++) {
+            int node = theMesh->elem[iElem*nLocal+j];
+            size[node] = fmin(size[node], h); }}
+
+    femSizeField *theField = femMalloc(FEM_MEM_POST, sizeof(femSizeField));
+    theField->sizes = femTransferCreate(theMesh, 1, size);
+    printf("Adapt   : size field from %.3f to %.3f for a relative error of %.2f %%\n",
+           femMin(size, nNodes), femMax(size, nNodes), 100.0 * eta);
+    femFree(size);
+    return theField;
+}
+
+void femSizeFieldFree(femSizeField *theField) {
+    if (theSizeField == theField) femSizeFieldUse(NULL);
+    femTransferFree(theField->sizes);
+    femFree(theField);
+}
+
+// linear interpolation of the nodal sizes, the nearest node outside of the mesh
+double femSizeFieldEvaluate(femSizeField *theField, double x, double y) {
+    double size;
+    femTransferEvaluate(theField->sizes, x, y, &size);
+    return size;
+}
+
+// the field becomes the size callback of the default geometry, NULL gives back the uniform size
+void femSizeFieldUse(femSizeField *theField) {
+    theSizeField = theField;
+    geoSetSizeCallback((theField != NULL) ? femSizeFieldCallback : geoSizeDefault);
+}
@@ -0,0 +1,94 @@
+/*
+ *  femFactors.c
+ *  Jacobians and shape function gradients of the elements, computed once per problem
+ *
+ *  The stiffness matrix, the gravity loads, the residual forces, the integrals,
+ *  the stresses and the error estimator all need the jacobian of the mapping
+ *  and the gradients of the shape functions at the integration points of every
+ *  element, and the mesh does not move between these passes (when it does, the
+ *  cache is dropped by femElasticityInvalidateFactors). They are computed
+ *  here once, elements split in contiguous ranges over the threads, and stored
+ *  as three separate arrays (jacobians, x and y gradients) in the order of the
+ *  elements and of their points, so that each pass reads them sequentially.
+ *
+ *  On triangles with 3 points, that is 21 doubles per element : the cache is
+ *  skipped when it does not fit in the memory budget, or on request, and the
+ *  factors are then recomputed in each pass (femElasticityElementFactors).
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include "../headers/femFactors.h"
+
+typedef struct {
+    femProblem *theProblem;
+    femFactors *theFactors;
+    int first, last;
+} femFactorsWorker;
+
+
+static void *femFactorsWork(void *data) {
+    femFactorsWorker *theWorker = data;
+    femProblem *theProblem = theWorker->theProblem;
+    femFactors *theFactors = theWorker->theFactors;
+    femIntegration *theRule = theProblem->rule;
+    int nInteg = theFactors->nInteg, n = theFactors->n;
+    int map[4];
+
+    for (int iElem = theWorker->first; iElem < theWorker->last; iElem++)
+        for (int iInteg = 0; iInteg < nInteg; iInteg++) {
+            int k = iElem * nInteg + iInteg;
+            theFactors->jac[k] = femElasticityElementGradients(theProblem, iElem, theRule->xsi[iInteg], theRule->eta[iInteg],
+                                                               &theFactors->dphidx[k*n], &theFactors->dphidy[k*n], map); }
+    return NULL;
+}
+
+// bytes of the cache for the mesh and the rule of a problem
+size_t femFactorsMemory(femProblem *theProblem) {
+    size_t points = (size_t) theProblem->geometry->theElements->nElem * theProblem->rule->n;
+    return sizeof(double) * points * (1 + 2 * theProblem->space->n);
+}
+
+// nThreads <= 0 takes the number of online processors
+femFactors *femFactorsCreate(femProblem *theProblem, int nThreads) {
+    femFactors *theFactors = femMalloc(FEM_MEM_MESH, sizeof(femFactors));
+    int nElem = theProblem->geometry->theElements->nElem;
+    int nInteg = theProblem->rule->n, n = theProblem->space->n, t;
+    if (nThreads <= 0) nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > nElem / 1024 + 1) nThreads = nElem / 1024 + 1;
+    if (nThreads < 1) nThreads = 1;
+    femProfileBegin(FEM_PHASE_SETUP);
+
+    theFactors->nElem = nElem;
+    theFactors->nInteg = nInteg;
+    theFactors->n = n;
+    theFactors->jac    = femMalloc(FEM_MEM_MESH, sizeof(double) * nElem * nInteg);
+    theFactors->dphidx = femMalloc(FEM_MEM_MESH, sizeof(double) * nElem * nInteg * n);
+    theFactors->dphidy = femMalloc(FEM_MEM_MESH, sizeof(double) * nElem * nInteg * n);
+
+    femFactorsWorker workers[nThreads];
+    pthread_t threads[nThreads];
+    for (t = 0; t < nThreads; t++) {
+        workers[t].theProblem = theProblem;
+        workers[t].theFactors = theFactors;
+        workers[t].first = (int) ((long) nElem * t / nThreads);
+        workers[t].last  = (int) ((long) nElem * (t+1) / nThreads); }
+    for (t = 1; t < nThreads; t++)
+        if (pthread_create(&threads[t], NULL, femFactorsWork, &workers[t]) != 0)
+            Error("Cannot create a factors thread");
+    femFactorsWork(&workers[0]);
+    for (t = 1; t < nThreads; t++)
+        pthread_join(threads[t], NULL);
+
+    femProfileCount(0, (double) nElem * nInteg * (16.0 * n + 10.0));
+    femProfileEnd(FEM_PHASE_SETUP);
+    return theFactors;
+}
+
+void femFactorsFree(femFactors *theFactors) {
+    femFree(theFactors->jac);
+    femFree(theFactors->dphidx);
+    femFree(theFactors->dphidy);
+    femFree(theFactors);
+}
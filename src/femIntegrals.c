@@ -0,0 +1,147 @@
+/*
+ *  femIntegrals.c
+ *  Integrals of several fields in one threaded pass, the integrand called on batches of points
+ *
+ *  The elements are split in contiguous ranges, one per thread, and each
+ *  range in batches of FEM_INTEGRALS_BATCH elements. For a batch, the
+ *  integration points are mapped to the physical space and the displacements
+ *  and strains are interpolated there (with the cached factors of the
+ *  problem), all as separate arrays. The integrand is called once on the
+ *  whole batch and fills one array of values per field, which are summed with
+ *  the jacobians and the weights of the rule. The partial sums of the threads
+ *  are reduced in order, so that the result only depends on their number.
+ *
+ *  Area, mass, weight and strain energy are then fields of one integrand and
+ *  cost a single pass over the mesh.
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include "../headers/femIntegrals.h"
+
+#define FEM_INTEGRALS_BATCH 64
+
+typedef struct {
+    femProblem *theProblem;
+    femIntegrand integrand;
+    void *data;
+    int nFields;
+    int first, last;
+    const double *phi;              // shape functions at the points of the rule
+    int *elem;
+    double *x, *y, *u, *v, *exx, *eyy, *exy, *weight;
+    double *values;
+    double *sums;
+} femIntegralsWorker;
+
+
+static void *femIntegralsWork(void *data) {
+    femIntegralsWorker *theWorker = data;
+    femProblem *theProblem = theWorker->theProblem;
+    femIntegration *theRule = theProblem->rule;
+    femNodes *theNodes = theProblem->geometry->theNodes;
+    femMesh *theMesh = theProblem->geometry->theElements;
+    const double *U = theProblem->soluce;
+    int nLocal = theMesh->nLocalNode, nInteg = theRule->n, nFields = theWorker->nFields;
+    double dphidx[4],dphidy[4];
+    int i,k,iInteg;
+
+    for (k = 0; k < nFields; k++) theWorker->sums[k] = 0.0;
+    for (int start = theWorker->first; start < theWorker->last; start += FEM_INTEGRALS_BATCH) {
+        int end = start + FEM_INTEGRALS_BATCH, n = 0;
+        if (end > theWorker->last) end = theWorker->last;
+        for (int iElem = start; iElem < end; iElem++) {
+            const int *map = &theMesh->elem[iElem*nLocal];
+            for (iInteg = 0; iInteg < nInteg; iInteg++, n++) {
+                const double *phi = &theWorker->phi[iInteg*nLocal];
+                double jac = femElasticityElementFactors(theProblem,iElem,iInteg,dphidx,dphidy);
+                double x = 0.0, y = 0.0, u = 0.0, v = 0.0;
+                double dudx = 0.0, dudy = 0.0, dvdx = 0.0, dvdy = 0.0;
+                for (i = 0; i < nLocal; i++) {
+                    x += phi[i] * theNodes->X[map[i]];
+                    y += phi[i] * theNodes->Y[map[i]];
+                    u += phi[i] * U[2*map[i]];
+                    v += phi[i] * U[2*map[i]+1];
+                    dudx += dphidx[i] * U[2*map[i]];
+                    dudy += dphidy[i] * U[2*map[i]];
+                    dvdx += dphidx[i] * U[2*map[i]+1];
+                    dvdy += dphidy[i] * U[2*map[i]+1]; }
+                theWorker->elem[n] = iElem;
+                theWorker->x[n] = x;
+                theWorker->y[n] = y;
+                theWorker->u[n] = u;
+                theWorker->v[n] = v;
+                theWorker->exx[n] = dudx;
+                theWorker->eyy[n] = dvdy;
+                theWorker->exy[n] = 0.5 * (dudy + dvdx);
+                theWorker->weight[n] = jac * theRule->weight[iInteg]; }}
+
+        femIntegrationPoints points = { n, theWorker->elem, theWorker->x, theWorker->y, theWorker->u, theWorker->v,
+                                        theWorker->exx, theWorker->eyy, theWorker->exy };
+        theWorker->integrand(&points, nFields, theWorker->values, theWorker->data);
+        for (k = 0; k < nFields; k++) {
+            const double *values = &theWorker->values[k*n];
+            double sum = 0.0;
+            for (i = 0; i < n; i++) sum += values[i] * theWorker->weight[i];
+            theWorker->sums[k] += sum; }}
+    return NULL;
+}
+
+// integrals[k] of the field k of the integrand over the mesh of the problem,
+// nThreads <= 0 takes the number of online processors
+void femIntegrals(femProblem *theProblem, femIntegrand integrand, void *data, int nFields,
+                  double *integrals, int nThreads) {
+    femIntegration *theRule = theProblem->rule;
+    int nElem = theProblem->geometry->theElements->nElem;
+    int nLocal = theProblem->geometry->theElements->nLocalNode;
+    int nPoints = FEM_INTEGRALS_BATCH * theRule->n;
+    int i,k,t;
+    if (nThreads <= 0) nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > nElem / 1024 + 1) nThreads = nElem / 1024 + 1;
+    if (nThreads < 1) nThreads = 1;
+
+    double phi[4*theRule->n];
+    for (i = 0; i < theRule->n; i++)
+        femDiscretePhi2(theProblem->space, theRule->xsi[i], theRule->eta[i], &phi[i*nLocal]);
+    femElasticityFactors(theProblem);
+
+    // 8 arrays of points, the values and the sums for each thread
+    double *work = femMalloc(FEM_MEM_POST, sizeof(double) * nThreads * ((8 + nFields) * nPoints + nFields));
+    int *elem = femMalloc(FEM_MEM_POST, sizeof(int) * nThreads * nPoints);
+    femIntegralsWorker workers[nThreads];
+    pthread_t threads[nThreads];
+    for (t = 0; t < nThreads; t++) {
+        femIntegralsWorker *theWorker = &workers[t];
+        double *buffer = &work[t * ((8 + nFields) * nPoints + nFields)];
+        theWorker->theProblem = theProblem;
+        theWorker->integrand = integrand;
+        theWorker->data = data;
+        theWorker->nFields = nFields;
+        theWorker->first = (int) ((long) nElem * t / nThreads);
+        theWorker->last  = (int) ((long) nElem * (t+1) / nThreads);
+        theWorker->phi = phi;
+        theWorker->elem = &elem[t * nPoints];
+        theWorker->x      = buffer;
+        theWorker->y      = buffer + nPoints;
+        theWorker->u      = buffer + 2*nPoints;
+        theWorker->v      = buffer + 3*nPoints;
+        theWorker->exx    = buffer + 4*nPoints;
+        theWorker->eyy    = buffer + 5*nPoints;
+        theWorker->exy    = buffer + 6*nPoints;
+        theWorker->weight = buffer + 7*nPoints;
+        theWorker->values = buffer + 8*nPoints;
+        theWorker->sums   = buffer + (8 + nFields)*nPoints; }
+    for (t = 1; t < nThreads; t++)
+        if (pthread_create(&threads[t], NULL, femIntegralsWork, &workers[t]) != 0)
+            Error("Cannot create an integration thread");
+    femIntegralsWork(&workers[0]);
+    for (t = 1; t < nThreads; t++)
+        pthread_join(threads[t], NULL);
+
+    for (k = 0; k < nFields; k++) {
+        integrals[k] = 0.0;
+        for (t = 0; t < nThreads; t++) integrals[k] += workers[t].sums[k]; }
+    femFree(work);
+    femFree(elem);
+}
@@ -0,0 +1,291 @@
+/*
+ *  femLocator.c
+ *  Spatial index over the elements, point location and probes of the solution
+ *
+ *  The elements are bucketed once on a uniform grid of about one element per
+ *  cell, by their bounding boxes (two passes : counts, then a compact array
+ *  of the elements of each cell). A point is looked for in the elements of
+ *  its cell only : on a triangle its reference coordinates come directly,
+ *  on a quad from a few Newton steps on the bilinear map. The barycentric
+ *  coordinates of a triangle are (1 - xsi - eta, xsi, eta), and in general
+ *  the weights of the nodes are the shape functions at (xsi, eta). Large
+ *  batches of points are split over threads, each point being independent.
+ *
+ *  A probe locates its points once. Each evaluation then interpolates the
+ *  displacements and takes the strains and stresses from the gradients of
+ *  the element at the point, for comparison with strain gauges.
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include "../headers/femLocator.h"
+
+#define FEM_LOCATOR_NEWTON 8
+
+typedef struct {
+    femLocator *theLocator;
+    int first, last;
+    const double *x, *y;
+    int *elem;
+    double *xsi, *eta;
+} femLocatorWorker;
+
+
+femLocator *femLocatorCreate(femMesh *theMesh) {
+    femNodes *theNodes = theMesh->nodes;
+    femLocator *theLocator = femMalloc(FEM_MEM_MESH, sizeof(femLocator));
+    int nNodes = theNodes->nNodes, nElem = theMesh->nElem, nLocal = theMesh->nLocalNode;
+    const double *X = theNodes->X, *Y = theNodes->Y;
+    int i,j,iElem;
+    theLocator->mesh = theMesh;
+
+    // grid of about one element per cell
+    double xMax = femMax(theNodes->X, nNodes), yMax = femMax(theNodes->Y, nNodes);
+    theLocator->xMin = femMin(theNodes->X, nNodes);
+    theLocator->yMin = femMin(theNodes->Y, nNodes);
+    theLocator->cell = sqrt((xMax - theLocator->xMin) * (yMax - theLocator->yMin) / nElem) + 1e-12;
+    theLocator->nx = (int) ((xMax - theLocator->xMin) / theLocator->cell) + 1;
+    theLocator->ny = (int) ((yMax - theLocator->yMin) / theLocator->cell) + 1;
+    int nCells = theLocator->nx * theLocator->ny;
+    theLocator->cellStart = femMalloc(FEM_MEM_MESH, sizeof(int) * (nCells + 1));
+    for (i = 0; i <= nCells; i++) theLocator->cellStart[i] = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (iElem = 0; iElem < nElem; iElem++) {
+            double x0 = 1e300, x1 = -1e300, y0 = 1e300, y1 = -1e300;
+            for (j = 0; j < nLocal; j++) {
+                int node = theMesh->elem[iElem*nLocal+j];
+                x0 = fmin(x0, X[node]); x1 = fmax(x1, X[node]);
+                y0 = fmin(y0, Y[node]); y1 = fmax(y1, Y[node]); }
+            int i0 = (int) ((x0 - theLocator->xMin) / theLocator->cell), i1 = (int) ((x1 - theLocator->xMin) / theLocator->cell);
+            int j0 = (int) ((y0 - theLocator->yMin) / theLocator->cell), j1 = (int) ((y1 - theLocator->yMin) / theLocator->cell);
+            for (int jy = j0; jy <= j1; jy++)
+                for (int ix = i0; ix <= i1; ix++) {
+                    int cell = jy * theLocator->nx + ix;
+                    if (pass == 0) theLocator->cellStart[cell+1]++;
+                    else theLocator->cellElem[theLocator->cellStart[cell]++] = iElem; }}
+        if (pass == 0) {
+            for (i = 0; i < nCells; i++) theLocator->cellStart[i+1] += theLocator->cellStart[i];
+            theLocator->cellElem = femMalloc(FEM_MEM_MESH, sizeof(int) * (theLocator->cellStart[nCells] + 1)); }
+        else {
+            for (i = nCells; i > 0; i--) theLocator->cellStart[i] = theLocator->cellStart[i-1];
+            theLocator->cellStart[0] = 0; }}
+    return theLocator;
+}
+
+void femLocatorFree(femLocator *theLocator) {
+    femFree(theLocator->cellStart);
+    femFree(theLocator->cellElem);
+    femFree(theLocator);
+}
+
+static int femLocatorCell(femLocator *theLocator, double x, double y, int *ix, int *iy) {
+    *ix = (int) ((x - theLocator->xMin) / theLocator->cell);
+    *iy = (int) ((y - theLocator->yMin) / theLocator->cell);
+    *ix = (*ix < 0) ? 0 : (*ix >= theLocator->nx) ? theLocator->nx - 1 : *ix;
+    *iy = (*iy < 0) ? 0 : (*iy >= theLocator->ny) ? theLocator->ny - 1 : *iy;
+    return *iy * theLocator->nx + *ix;
+}
+
+// reference coordinates of (x,y) in an element, TRUE if the point is inside
+static int femLocatorInside(femLocator *theLocator, int iElem, double x, double y, double *xsi, double *eta) {
+    femMesh *theMesh = theLocator->mesh;
+    const double *X = theMesh->nodes->X, *Y = theMesh->nodes->Y;
+    int nLocal = theMesh->nLocalNode;
+    const int *nodes = &theMesh->elem[iElem*nLocal];
+    if (nLocal == 3) {
+        double x0 = X[nodes[0]], y0 = Y[nodes[0]];
+        double x1 = X[nodes[1]]-x0, y1 = Y[nodes[1]]-y0, x2 = X[nodes[2]]-x0, y2 = Y[nodes[2]]-y0;
+        double det = x1 * y2 - x2 * y1;
+        *xsi = ((x-x0) * y2 - x2 * (y-y0)) / det;
+        *eta = (x1 * (y-y0) - (x-x0) * y1) / det;
+        return *xsi >= -1e-10 && *eta >= -1e-10 && *xsi + *eta <= 1.0 + 1e-10; }
+
+    // newton on the bilinear map of the quad, from its center
+    double s = 0.0, t = 0.0;
+    for (int iter = 0; iter < FEM_LOCATOR_NEWTON; iter++) {
+        double phi[4] = {(1+s)*(1+t)/4, (1-s)*(1+t)/4, (1-s)*(1-t)/4, (1+s)*(1-t)/4};
+        double ds[4]  = {(1+t)/4, -(1+t)/4, -(1-t)/4, (1-t)/4};
+        double dt[4]  = {(1+s)/4, (1-s)/4, -(1-s)/4, -(1+s)/4};
+        double fx = -x, fy = -y, xs = 0.0, xt = 0.0, ys = 0.0, yt = 0.0;
+        for (int j = 0; j < 4; j++) {
+            fx += phi[j] * X[nodes[j]]; fy += phi[j] * Y[nodes[j]];
+            xs += ds[j] * X[nodes[j]];  xt += dt[j] * X[nodes[j]];
+            ys += ds[j] * Y[nodes[j]];  yt += dt[j] * Y[nodes[j]]; }
+        double det = xs * yt - xt * ys;
+        double dS = (fx * yt - xt * fy) / det, dT = (xs * fy - fx * ys) / det;
+        s -= dS; t -= dT;
+        if (fabs(dS) + fabs(dT) < 1e-14) break;
+        if (fabs(s) > 3.0 || fabs(t) > 3.0) return FALSE; }
+    *xsi = s; *eta = t;
+    return fabs(s) <= 1.0 + 1e-10 && fabs(t) <= 1.0 + 1e-10;
+}
+
+// element holding (x,y) and the reference coordinates of the point, -1 outside of the mesh
+int femLocatorFind(femLocator *theLocator, double x, double y, double *xsi, double *eta) {
+    int ix, iy, cell = femLocatorCell(theLocator, x, y, &ix, &iy);
+    for (int k = theLocator->cellStart[cell]; k < theLocator->cellStart[cell+1]; k++)
+        if (femLocatorInside(theLocator, theLocator->cellElem[k], x, y, xsi, eta))
+            return theLocator->cellElem[k];
+    return -1;
+}
+
+static void *femLocatorWork(void *data) {
+    femLocatorWorker *theWorker = data;
+    for (int i = theWorker->first; i < theWorker->last; i++)
+        theWorker->elem[i] = femLocatorFind(theWorker->theLocator, theWorker->x[i], theWorker->y[i],
+                                            &theWorker->xsi[i], &theWorker->eta[i]);
+    return NULL;
+}
+
+// a batch of points, nThreads <= 0 takes the number of online processors
+void femLocatorFindPoints(femLocator *theLocator, int n, const double *x, const double *y,
+                          int *elem, double *xsi, double *eta, int nThreads) {
+    if (nThreads <= 0) nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > n / 1024 + 1) nThreads = n / 1024 + 1;
+    if (nThreads < 1) nThreads = 1;
+    femLocatorWorker workers[nThreads];
+    pthread_t threads[nThreads];
+    int t;
+    for (t = 0; t < nThreads; t++) {
+        workers[t].theLocator = theLocator;
+        workers[t].first = (int) ((long) n * t / nThreads);
+        workers[t].last  = (int) ((long) n * (t+1) / nThreads);
+        workers[t].x = x; workers[t].y = y;
+        workers[t].elem = elem; workers[t].xsi = xsi; workers[t].eta = eta; }
+    for (t = 1; t < nThreads; t++)
+        if (pthread_create(&threads[t], NULL, femLocatorWork, &workers[t]) != 0)
+            Error("Cannot create a locator thread");
+    femLocatorWork(&workers[0]);
+    for (t = 1; t < nThreads; t++)
+        pthread_join(threads[t], NULL);
+}
+
+// weights of the nodes of an element at (xsi,eta), the barycentric coordinates of a triangle
+void femLocatorWeights(femLocator *theLocator, double xsi, double eta, double *phi) {
+    if (theLocator->mesh->nLocalNode == 3) {
+        phi[0] = 1.0 - xsi - eta; phi[1] = xsi; phi[2] = eta; }
+    else {
+        phi[0] = (1.0 + xsi) * (1.0 + eta) / 4.0;
+        phi[1] = (1.0 - xsi) * (1.0 + eta) / 4.0;
+        phi[2] = (1.0 - xsi) * (1.0 - eta) / 4.0;
+        phi[3] = (1.0 + xsi) * (1.0 - eta) / 4.0; }
+}
+
+// node of the closest elements nearest to (x,y), searched in rings of cells
+int femLocatorNearest(femLocator *theLocator, double x, double y) {
+    femMesh *theMesh = theLocator->mesh;
+    const double *X = theMesh->nodes->X, *Y = theMesh->nodes->Y;
+    int nLocal = theMesh->nLocalNode;
+    int ix, iy;
+    femLocatorCell(theLocator, x, y, &ix, &iy);
+    for (int ring = 0; ring < theLocator->nx + theLocator->ny; ring++) {
+        double distance = 1e300;
+        int nearest = -1;
+        for (int jy = iy - ring; jy <= iy + ring; jy++)
+            for (int jx = ix - ring; jx <= ix + ring; jx++) {
+                if (jx < 0 || jy < 0 || jx >= theLocator->nx || jy >= theLocator->ny) continue;
+                if (abs(jx - ix) != ring && abs(jy - iy) != ring) continue;
+                int other = jy * theLocator->nx + jx;
+                for (int k = theLocator->cellStart[other]; k < theLocator->cellStart[other+1]; k++)
+                    for (int j = 0; j < nLocal; j++) {
+                        int node = theMesh->elem[theLocator->cellElem[k]*nLocal+j];
+                        double dx = X[node] - x, dy = Y[node] - y;
+                        if (dx*dx + dy*dy < distance) { distance = dx*dx + dy*dy; nearest = node; }}}
+        if (nearest != -1) return nearest; }
+    return -1;
+}
+
+
+/*
+*
+* PROBES
+*
+*/
+
+// the points are located once, on the mesh of the problem
+femProbe *femProbeCreate(femProblem *theProblem, femLocator *theLocator, int n, const double *x, const double *y) {
+    if (theLocator->mesh != theProblem->geometry->theElements)
+        Error("The locator is not built on the mesh of the problem");
+    femProbe *theProbe = femMalloc(FEM_MEM_POST, sizeof(femProbe));
+    theProbe->problem = theProblem;
+    theProbe->n = n;
+    theProbe->x    = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->y    = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->elem = femMalloc(FEM_MEM_POST, sizeof(int) * n);
+    theProbe->xsi  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->eta  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->U    = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->V    = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->exx  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->eyy  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->exy  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->sxx  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->syy  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    theProbe->sxy  = femMalloc(FEM_MEM_POST, sizeof(double) * n);
+    memcpy(theProbe->x, x, sizeof(double) * n);
+    memcpy(theProbe->y, y, sizeof(double) * n);
+    femLocatorFindPoints(theLocator, n, x, y, theProbe->elem, theProbe->xsi, theProbe->eta, 0);
+
+    int nOutside = 0;
+    for (int i = 0; i < n; i++) nOutside += (theProbe->elem[i] == -1);
+    printf("Probe   : %d points located", n);
+    if (nOutside > 0) printf(", %d outside of the mesh", nOutside);
+    printf("\n");
+    return theProbe;
+}
+
+void femProbeFree(femProbe *theProbe) {
+    femFree(theProbe->x); femFree(theProbe->y);
+    femFree(theProbe->elem); femFree(theProbe->xsi); femFree(theProbe->eta);
+    femFree(theProbe->U); femFree(theProbe->V);
+    femFree(theProbe->exx); femFree(theProbe->eyy); femFree(theProbe->exy);
+    femFree(theProbe->sxx); femFree(theProbe->syy); femFree(theProbe->sxy);
+    femFree(theProbe);
+}
+
+// displacements, strains and stresses at the points from the current theProblem->soluce,
+// zero for the points outside of the mesh
+void femProbeEvaluate(femProbe *theProbe) {
+    femProblem *theProblem = theProbe->problem;
+    femDiscrete *theSpace = theProblem->space;
+    double *U = theProblem->soluce;
+    double a = theProblem->A, b = theProblem->B, c = theProblem->C;
+    double phi[4],dphidx[4],dphidy[4];
+    int i,j,map[4];
+
+    for (i = 0; i < theProbe->n; i++) {
+        double u = 0.0, v = 0.0, dudx = 0.0, dudy = 0.0, dvdx = 0.0, dvdy = 0.0;
+        if (theProbe->elem[i] != -1) {
+            femDiscretePhi2(theSpace, theProbe->xsi[i], theProbe->eta[i], phi);
+            femElasticityElementGradients(theProblem, theProbe->elem[i], theProbe->xsi[i], theProbe->eta[i], dphidx, dphidy, map);
+            for (j = 0; j < theSpace->n; j++) {
+                u    += U[2*map[j]]   * phi[j];
+                v    += U[2*map[j]+1] * phi[j];
+                dudx += U[2*map[j]]   * dphidx[j];
+                dudy += U[2*map[j]]   * dphidy[j];
+                dvdx += U[2*map[j]+1] * dphidx[j];
+                dvdy += U[2*map[j]+1] * dphidy[j]; }}
+        double exx = dudx, eyy = dvdy, exy = 0.5 * (dudy + dvdx);
+        theProbe->U[i] = u;
+        theProbe->V[i] = v;
+        theProbe->exx[i] = exx;
+        theProbe->eyy[i] = eyy;
+        theProbe->exy[i] = exy;
+        theProbe->sxx[i] = a * exx + b * eyy;
+        theProbe->syy[i] = b * exx + a * eyy;
+        theProbe->sxy[i] = 2.0 * c * exy; }
+}
+
+// one line per point : x, y, u, v, exx, eyy, exy, sxx, syy, sxy
+void femProbeWrite(femProbe *theProbe, const char *filename) {
+    int n = theProbe->n;
+    double *data = femMalloc(FEM_MEM_POST, sizeof(double) * 10 * n);
+    for (int i = 0; i < n; i++) {
+        double fields[10] = {theProbe->x[i], theProbe->y[i], theProbe->U[i], theProbe->V[i],
+                             theProbe->exx[i], theProbe->eyy[i], theProbe->exy[i],
+                             theProbe->sxx[i], theProbe->syy[i], theProbe->sxy[i]};
+        memcpy(&data[10*i], fields, sizeof(fields)); }
+    femSolutionWrite(n, 10, data, filename);
+    femFree(data);
+}
@@ -0,0 +1,221 @@
+/*
+ *  femMemory.c
+ *  Tracked allocations by subsystem, memory budget and high-water mark
+ *
+ *  Every block obtained with femMalloc carries a small header with its size
+ *  and subsystem, so that femFree can update the counters without being told.
+ *  The budget defaults to the physical memory of the machine : a system that
+ *  would not fit is refused before it is allocated instead of being killed.
+ *
+ *  An arena hands out pieces of a few large blocks whose sizes double, so that
+ *  a whole mesh lives in a handful of contiguous allocations and is released
+ *  in one go.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../headers/femMemory.h"
+#include "../headers/femProfile.h"
+
+typedef union {
+    struct {
+        size_t bytes;
+        femMemoryType type;
+    } info;
+    max_align_t align;
+} femMemoryHeader;
+
+#define FEM_ARENA_FIRSTBLOCK 65536
+#define FEM_ARENA_ALIGN 16
+
+static const char *theMemoryNames[FEM_MEM_COUNT] = {
+    "mesh", "system", "solver", "post-processing", "rendering" };
+
+static femMemoryStats theMemoryStats[FEM_MEM_COUNT];
+static size_t theCurrent = 0, thePeak = 0, theBudget = 0;
+static pthread_mutex_t theMemoryLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+static void femMemoryAdd(femMemoryType type, size_t bytes) {
+    pthread_mutex_lock(&theMemoryLock);
+    femMemoryStats *theStat = &theMemoryStats[type];
+    theStat->current += bytes;
+    theStat->allocations++;
+    if (theStat->current > theStat->peak) theStat->peak = theStat->current;
+    theCurrent += bytes;
+    if (theCurrent > thePeak) thePeak = theCurrent;
+    pthread_mutex_unlock(&theMemoryLock);
+}
+
+static void femMemoryRemove(femMemoryType type, size_t bytes) {
+    pthread_mutex_lock(&theMemoryLock);
+    theMemoryStats[type].current -= bytes;
+    theCurrent -= bytes;
+    pthread_mutex_unlock(&theMemoryLock);
+}
+
+void *femMalloc(femMemoryType type, size_t bytes) {
+    femMemoryHeader *header = malloc(sizeof(femMemoryHeader) + bytes);
+    if (header == NULL) {
+        printf("\n-------------------------------------------------------------------------------- ");
+        printf("\n  Error : cannot allocate %zu bytes for the %s (%zu bytes in use)\n", bytes, theMemoryNames[type], theCurrent);
+        printf("--------------------------------------------------------------------- Yek Yek !! \n\n");
+        exit(69); }
+    header->info.bytes = bytes;
+    header->info.type = type;
+    femMemoryAdd(type, bytes);
+    femProfileCount(bytes, 0.0);
+    return header + 1;
+}
+
+void *femRealloc(femMemoryType type, void *ptr, size_t bytes) {
+    void *theNew = femMalloc(type, bytes);
+    if (ptr != NULL) {
+        femMemoryHeader *header = (femMemoryHeader *) ptr - 1;
+        memcpy(theNew, ptr, (header->info.bytes < bytes) ? header->info.bytes : bytes);
+        femFree(ptr); }
+    return theNew;
+}
+
+void femFree(void *ptr) {
+    if (ptr == NULL) return;
+    femMemoryHeader *header = (femMemoryHeader *) ptr - 1;
+    femMemoryRemove(header->info.type, header->info.bytes);
+    free(header);
+}
+
+// read under the lock of femMalloc and femFree, the threaded passes allocate too
+size_t femMemoryCurrent(void) {
+    pthread_mutex_lock(&theMemoryLock);
+    size_t bytes = theCurrent;
+    pthread_mutex_unlock(&theMemoryLock);
+    return bytes;
+}
+
+size_t femMemoryPeak(void) {
+    pthread_mutex_lock(&theMemoryLock);
+    size_t bytes = thePeak;
+    pthread_mutex_unlock(&theMemoryLock);
+    return bytes;
+}
+
+// the high-water marks restart from what is allocated now
+void femMemoryResetPeak(void) {
+    pthread_mutex_lock(&theMemoryLock);
+    thePeak = theCurrent;
+    for (int i = 0; i < FEM_MEM_COUNT; i++)
+        theMemoryStats[i].peak = theMemoryStats[i].current;
+    pthread_mutex_unlock(&theMemoryLock);
+}
+
+femMemoryStats femMemoryStatsOf(femMemoryType type) {
+    pthread_mutex_lock(&theMemoryLock);
+    femMemoryStats theStat = theMemoryStats[type];
+    pthread_mutex_unlock(&theMemoryLock);
+    return theStat;
+}
+
+const char *femMemoryName(femMemoryType type) {
+    return theMemoryNames[type];
+}
+
+// 0 restores the default : the physical memory when the system reports it
+void femMemorySetBudget(size_t bytes) {
+    theBudget = bytes;
+}
+
+size_t femMemoryBudget(void) {
+    if (theBudget == 0) {
+        long pages = sysconf(_SC_PHYS_PAGES);
+        long pageSize = sysconf(_SC_PAGESIZE);
+        if (pages > 0 && pageSize > 0) return (size_t) pages * pageSize;
+        return (size_t) -1; }
+    return theBudget;
+}
+
+// would bytes more than what is in use stay within the budget ?
+int femMemoryFits(size_t bytes) {
+    return femMemoryCurrent() + bytes <= femMemoryBudget();
+}
+
+void femMemoryReport(FILE *file) {
+    fprintf(file, "\n ==== Memory ======================================================================== \n");
+    fprintf(file, "  %-16s %14s %14s %14s\n", "subsystem", "in use [MB]", "peak [MB]", "allocations");
+    for (int i = 0; i < FEM_MEM_COUNT; i++) {
+        femMemoryStats theStat = femMemoryStatsOf(i);
+        if (theStat.allocations == 0) continue;
+        fprintf(file, "  %-16s %14.3f %14.3f %14ld\n", theMemoryNames[i], theStat.current / 1048576.0,
+                theStat.peak / 1048576.0, theStat.allocations); }
+    fprintf(file, "  %-16s %14.3f %14.3f   (budget %.1f MB)\n", "high-water mark", femMemoryCurrent() / 1048576.0,
+            femMemoryPeak() / 1048576.0, femMemoryBudget() / 1048576.0);
+    fprintf(file, " ==================================================================================== \n\n");
+}
+
+
+/*
+*
+* ARENA
+*
+*/
+
+femArena *femArenaCreate(femMemoryType type) {
+    femArena *theArena = femMalloc(type, sizeof(femArena));
+    theArena->type = type;
+    theArena->nextSize = FEM_ARENA_FIRSTBLOCK;
+    theArena->blocks = NULL;
+    return theArena;
+}
+
+// pieces are aligned on 16 bytes, a request larger than the next block gets a block of its own size :
+// that block is full at once, it goes behind the current one which keeps serving the smaller pieces
+// and the growth of the next blocks is left unchanged
+void *femArenaAlloc(femArena *theArena, size_t bytes) {
+    size_t header = (sizeof(femArenaBlock) + FEM_ARENA_ALIGN - 1) & ~(size_t) (FEM_ARENA_ALIGN - 1);
+    bytes = (bytes + FEM_ARENA_ALIGN - 1) & ~(size_t) (FEM_ARENA_ALIGN - 1);
+    femArenaBlock *theBlock = theArena->blocks;
+    if (theBlock == NULL || theBlock->used + bytes > theBlock->size) {
+        int oversized = (bytes > theArena->nextSize);
+        size_t size = oversized ? bytes : theArena->nextSize;
+        femArenaBlock *theCurrent = theBlock;
+        theBlock = femMalloc(theArena->type, header + size);
+        theBlock->size = size;
+        theBlock->used = 0;
+        if (oversized && theCurrent != NULL) {
+            theBlock->next = theCurrent->next;
+            theCurrent->next = theBlock; }
+        else {
+            theBlock->next = theArena->blocks;
+            theArena->blocks = theBlock; }
+        if (!oversized) theArena->nextSize *= 2; }
+    void *ptr = (char *) theBlock + header + theBlock->used;
+    theBlock->used += bytes;
+    return ptr;
+}
+
+// gives every block back, the arena can be filled again
+void femArenaReset(femArena *theArena) {
+    femArenaBlock *theBlock = theArena->blocks;
+    while (theBlock != NULL) {
+        femArenaBlock *next = theBlock->next;
+        femFree(theBlock);
+        theBlock = next; }
+    theArena->blocks = NULL;
+    theArena->nextSize = FEM_ARENA_FIRSTBLOCK;
+}
+
+void femArenaFree(femArena *theArena) {
+    if (theArena == NULL) return;
+    femArenaReset(theArena);
+    femFree(theArena);
+}
+
+// bytes handed out by the arena
+size_t femArenaMemory(femArena *theArena) {
+    size_t bytes = 0;
+    for (femArenaBlock *theBlock = theArena->blocks; theBlock != NULL; theBlock = theBlock->next)
+        bytes += theBlock->used;
+    return bytes;
+}
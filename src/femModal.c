@@ -0,0 +1,247 @@
+/*
+ *  femModal.c
+ *  Natural frequencies and mode shapes by shift-invert Lanczos on the factorized stiffness
+ *
+ *  The free vibrations solve K x = lambda M x on the unconstrained dofs, with
+ *  the consistent mass matrix M assembled with K (femElasticitySetMass) and
+ *  lambda the square of the circular frequency. The lowest modes are the
+ *  largest eigenvalues 1/(lambda - shift) of (K - shift M)^-1 M : with the shift
+ *  at zero, each step of the Lanczos iterations is one solve with the
+ *  factorization of the static problem (femElasticitySolveIncrements), which is
+ *  then reused as it is. A model whose conditions leave a rigid body motion has
+ *  a singular K : a small negative shift (below the lowest eigenvalue) keeps the
+ *  factorization regular, at the price of a second one.
+ *
+ *  Rigid body modes (lambda at zero, compared with E / (rho L^2) for a mesh of
+ *  size L) are computed as well, up to three of them, then dropped with a warning.
+ *
+ *  The Lanczos vectors are orthonormal for the mass and are kept : each new
+ *  vector is orthogonalized against all of them twice (classical Gram-Schmidt
+ *  with a second pass), so that no spurious copy of a converged mode appears.
+ *  The eigenvalues of the small tridiagonal matrix (Jacobi rotations) give the
+ *  Ritz values every few steps, and the iterations stop when the residual
+ *  estimates |beta_m s_m| of the nModes largest ones are below the tolerance.
+ *
+ */
+
+#include "../headers/femModal.h"
+
+#define FEM_MODAL_CHECK 5
+#define FEM_MODAL_SWEEPS 50
+#define FEM_MODAL_MAXRIGID 3
+#define FEM_MODAL_RIGID 1e-8
+
+
+// eigenvalues d and eigenvectors (columns of V) of the symmetric matrix A (n x n), destroyed
+static void femModalJacobi(int n, double *A, double *V, double *d) {
+    int i,j,k,sweep;
+    for (i = 0; i < n*n; i++) V[i] = 0.0;
+    for (i = 0; i < n; i++) V[i*n+i] = 1.0;
+    for (sweep = 0; sweep < FEM_MODAL_SWEEPS; sweep++) {
+        double off = 0.0, diag = 0.0;
+        for (i = 0; i < n; i++) {
+            diag += A[i*n+i] * A[i*n+i];
+            for (j = i+1; j < n; j++) off += A[i*n+j] * A[i*n+j]; }
+        if (off <= 1e-30 * diag) break;
+        for (i = 0; i < n; i++)
+            for (j = i+1; j < n; j++) {
+                double apq = A[i*n+j];
+                if (apq == 0.0) continue;
+                double theta = (A[j*n+j] - A[i*n+i]) / (2.0 * apq);
+                double t = ((theta >= 0.0) ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta*theta + 1.0));
+                double c = 1.0 / sqrt(t*t + 1.0), s = t * c;
+                for (k = 0; k < n; k++) {
+                    double aki = A[k*n+i], akj = A[k*n+j];
+                    A[k*n+i] = c * aki - s * akj;
+                    A[k*n+j] = s * aki + c * akj; }
+                for (k = 0; k < n; k++) {
+                    double aik = A[i*n+k], ajk = A[j*n+k];
+                    A[i*n+k] = c * aik - s * ajk;
+                    A[j*n+k] = s * aik + c * ajk; }
+                for (k = 0; k < n; k++) {
+                    double vki = V[k*n+i], vkj = V[k*n+j];
+                    V[k*n+i] = c * vki - s * vkj;
+                    V[k*n+j] = s * vki + c * vkj; }}}
+    for (i = 0; i < n; i++) d[i] = A[i*n+i];
+}
+
+static double femModalDot(int n, const double *x, const double *y) {
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) sum += x[i] * y[i];
+    return sum;
+}
+
+// Ritz values of the m first steps in decreasing order (theta, eigenvectors in S with the
+// same order, m x m), returns how many of the nModes first ones are converged
+static int femModalRitz(int m, const double *alpha, const double *beta, int nModes, double tol,
+                        double *T, double *S, double *theta, double *residuals) {
+    int i,j,k;
+    double *V = T + m*m, *d = theta + m;
+    for (i = 0; i < m*m; i++) T[i] = 0.0;
+    for (i = 0; i < m; i++) {
+        T[i*m+i] = alpha[i];
+        if (i+1 < m) T[i*m+i+1] = T[(i+1)*m+i] = beta[i]; }
+    femModalJacobi(m, T, V, d);
+
+    // selection sort, m is small
+    int *order = (int *) (S + m*m);
+    for (i = 0; i < m; i++) order[i] = i;
+    for (i = 0; i < m; i++)
+        for (j = i+1; j < m; j++)
+            if (d[order[j]] > d[order[i]]) { k = order[i]; order[i] = order[j]; order[j] = k; }
+    for (i = 0; i < m; i++) {
+        theta[i] = d[order[i]];
+        for (k = 0; k < m; k++) S[k*m+i] = V[k*m+order[i]]; }
+
+    int converged = 0;
+    for (i = 0; i < nModes && i < m; i++) {
+        residuals[i] = fabs(beta[m-1] * S[(m-1)*m+i]) / fabs(theta[i]);
+        if (residuals[i] <= tol) converged++; }
+    return converged;
+}
+
+// the nModes lowest elastic modes of the problem, tol is the relative residual of their eigenvalues,
+// K - shift M is factorized for a shift that is not zero (the static one is factorized again later)
+femModal *femModalCreate(femProblem *theProblem, int nModes, double tol, double shift) {
+    if (theProblem->massSystem == NULL)
+        Error("The mass matrix is not assembled, see femElasticitySetMass");
+    femNodes *theNodes = theProblem->geometry->theNodes;
+    int size = 2*theNodes->nNodes;
+    int i,j,k,pass,nFree = 0;
+    for (i = 0; i < size; i++)
+        if (theProblem->constrainedNodes[i] == -1) nFree++;
+    // room for the rigid body modes in front of the elastic ones
+    int nElastic = nModes;
+    nModes += FEM_MODAL_MAXRIGID;
+    if (nModes > nFree) nModes = nFree;
+    int maxSteps = 3*nModes + 40;
+    if (maxSteps > nFree) maxSteps = nFree;
+
+    size_t bytes = sizeof(double) * ((size_t) size * (maxSteps + 4) + 5 * (size_t) maxSteps * (maxSteps + 1));
+    if (!femMemoryFits(bytes)) {
+        char message[MAXNAME];
+        snprintf(message, MAXNAME, "The Lanczos vectors need %.1f MB, more than the memory budget", bytes / 1048576.0);
+        Error(message); }
+    femElasticitySetShift(theProblem, shift);
+    if (!theProblem->factorized)
+        femElasticityFactorize(theProblem);
+    femProfileBegin(FEM_PHASE_MODAL);
+
+    double *Q = femMalloc(FEM_MEM_SOLVER, sizeof(double) * size * (maxSteps + 1));
+    double *w = femMalloc(FEM_MEM_SOLVER, sizeof(double) * size * 3), *Mw = w + size, *Mq = Mw + size;
+    double *alpha = femMalloc(FEM_MEM_SOLVER, sizeof(double) * (5 * maxSteps + 5 * maxSteps * maxSteps));
+    double *beta = alpha + maxSteps, *coef = beta + maxSteps;
+    double *T = coef + maxSteps, *S = T + 2 * maxSteps * maxSteps, *theta = S + 2 * maxSteps * maxSteps;
+    double *residuals = femMalloc(FEM_MEM_SOLVER, sizeof(double) * (nModes + 1));
+    double nnz = theProblem->massSystem->rowStart[size];
+
+    // a fixed pseudo-random start, free dofs only, with one step of the operator
+    unsigned int seed = 1234567;
+    for (i = 0; i < size; i++) {
+        seed = 1103515245u * seed + 12345u;
+        w[i] = (theProblem->constrainedNodes[i] == -1) ? (seed >> 8) / 16777216.0 - 0.5 : 0.0; }
+    femElasticityMassMultiply(theProblem, w, Mw);
+    femElasticitySolveIncrements(theProblem, 1, Mw, Q);
+    femElasticityMassMultiply(theProblem, Q, Mq);
+    double norm = sqrt(femModalDot(size, Q, Mq));
+    for (i = 0; i < size; i++) Q[i] /= norm;
+
+    int m = 0, checked = 0, converged = 0;
+    for (j = 0; j < maxSteps; j++) {
+        double *q = &Q[(size_t) j * size];
+        femElasticityMassMultiply(theProblem, q, Mq);
+        femElasticitySolveIncrements(theProblem, 1, Mq, w);
+        alpha[j] = femModalDot(size, w, Mq);
+
+        // against all the previous vectors, which also removes the three term recurrence
+        for (pass = 0; pass < 2; pass++) {
+            femElasticityMassMultiply(theProblem, w, Mw);
+            for (k = 0; k <= j; k++) coef[k] = femModalDot(size, &Q[(size_t) k * size], Mw);
+            for (k = 0; k <= j; k++) {
+                const double *qk = &Q[(size_t) k * size];
+                for (i = 0; i < size; i++) w[i] -= coef[k] * qk[i]; }}
+        femElasticityMassMultiply(theProblem, w, Mw);
+        beta[j] = sqrt(fmax(femModalDot(size, w, Mw), 0.0));
+        femProfileCount(0, 8.0 * size * (j+1) + 8.0 * nnz + 4.0 * size);
+        m = j+1;
+
+        int invariant = beta[j] <= 1e-12 * fabs(alpha[j]);
+        if (m >= nModes && (m % FEM_MODAL_CHECK == 0 || invariant || m == maxSteps)) {
+            converged = femModalRitz(m, alpha, beta, nModes, tol, T, S, theta, residuals);
+            checked = m;
+            if (converged == nModes || invariant) break; }
+        if (invariant) break;
+        double *next = &Q[(size_t) (j+1) * size];
+        for (i = 0; i < size; i++) next[i] = w[i] / beta[j];
+    }
+    if (nModes > m) nModes = m;
+    if (checked != m)
+        converged = femModalRitz(m, alpha, beta, nModes, tol, T, S, theta, residuals);
+
+    // rigid body modes come first, the elastic ones after them up to the number asked for
+    double dx = femMax(theNodes->X, theNodes->nNodes) - femMin(theNodes->X, theNodes->nNodes);
+    double dy = femMax(theNodes->Y, theNodes->nNodes) - femMin(theNodes->Y, theNodes->nNodes);
+    double scale = theProblem->E / (theProblem->rho * (dx*dx + dy*dy));
+    int nRigid = 0;
+    while (nRigid < nModes && fabs(shift + 1.0 / theta[nRigid]) <= FEM_MODAL_RIGID * scale) nRigid++;
+    if (nModes - nRigid > nElastic) nModes = nRigid + nElastic;
+    converged = 0;
+    for (k = nRigid; k < nModes; k++)
+        if (residuals[k] <= tol) converged++;
+    if (nRigid > 0) {
+        char message[MAXNAME];
+        snprintf(message, MAXNAME, "K is singular, %d rigid body mode(s) dropped : %s", nRigid,
+                 shift < 0.0 ? "the conditions leave the model free to move" : "use a small negative shift");
+        Warning(message); }
+
+    femModal *theModal = femMalloc(FEM_MEM_POST, sizeof(femModal));
+    theModal->problem = theProblem;
+    theModal->nModes = nModes - nRigid;
+    theModal->size = size;
+    theModal->steps = m;
+    theModal->converged = converged;
+    theModal->nRigid = nRigid;
+    theModal->shift = shift;
+    nElastic = nModes - nRigid;
+    theModal->eigenvalues = femMalloc(FEM_MEM_POST, sizeof(double) * (nElastic + 1));
+    theModal->frequencies = femMalloc(FEM_MEM_POST, sizeof(double) * (nElastic + 1));
+    theModal->residuals   = femMalloc(FEM_MEM_POST, sizeof(double) * (nElastic + 1));
+    theModal->modes       = femMalloc(FEM_MEM_POST, sizeof(double) * size * (nElastic + 1));
+
+    // ritz vectors, with their largest component positive
+    for (k = 0; k < nElastic; k++) {
+        double *mode = &theModal->modes[(size_t) k * size];
+        int r = nRigid + k;
+        theModal->eigenvalues[k] = shift + 1.0 / theta[r];
+        theModal->frequencies[k] = sqrt(fmax(theModal->eigenvalues[k], 0.0)) / (2.0 * M_PI);
+        theModal->residuals[k] = residuals[r];
+        for (i = 0; i < size; i++) mode[i] = 0.0;
+        for (j = 0; j < m; j++) {
+            const double *qj = &Q[(size_t) j * size];
+            for (i = 0; i < size; i++) mode[i] += S[j*m+r] * qj[i]; }
+        int largest = 0;
+        for (i = 0; i < size; i++)
+            if (fabs(mode[i]) > fabs(mode[largest])) largest = i;
+        if (mode[largest] < 0.0)
+            for (i = 0; i < size; i++) mode[i] = -mode[i]; }
+    femProfileCount(0, 2.0 * size * m * nElastic);
+    femProfileEnd(FEM_PHASE_MODAL);
+    // the static problem is factorized again when it is solved next
+    femElasticitySetShift(theProblem, 0.0);
+
+    printf("Modal   : %d modes in %d Lanczos steps, %d within a residual %.1e, shift %.3e \n",
+           nElastic, m, converged, tol, shift);
+    femFree(Q);
+    femFree(w);
+    femFree(alpha);
+    femFree(residuals);
+    return theModal;
+}
+
+void femModalFree(femModal *theModal) {
+    femFree(theModal->eigenvalues);
+    femFree(theModal->frequencies);
+    femFree(theModal->residuals);
+    femFree(theModal->modes);
+    femFree(theModal);
+}
@@ -0,0 +1,177 @@
+/*
+ *  femMonitor.c
+ *  Telemetry of the iterative solvers and stopping on quantities of interest
+ *
+ *  After each iteration the solver reports its relative residual and an
+ *  estimate of the error in energy norm : the energy norm of the correction
+ *  alpha p relative to the one of the iterate (for the conjugate gradients
+ *  alpha^2 p^T A p = alpha r^T z, a lower bound of the error one step back).
+ *  The monitor adds the largest displacement on one domain and the resultant
+ *  of the nodal forces A u - f on another one, its reaction when the domain
+ *  is fixed. Only the elements touching the reaction domain are needed, found
+ *  around its nodes in the topology of the mesh (nodeElem) : their matrices
+ *  are kept, with the rows of the other nodes zeroed, so a report costs a few
+ *  hundred flops per element of the domain. With a tolerance, the solve stops
+ *  once both quantities change by less than that relative amount on two
+ *  consecutive iterations.
+ *
+ */
+
+#include "../headers/femMonitor.h"
+#include "../headers/femTopology.h"
+
+
+// nodes of a domain of edges, each one once
+static int femMonitorNodes(femGeo *theGeometry, char *nameDomain, int *marked, int *nodes) {
+    int iDomain = geoGetDomainGeo(theGeometry, nameDomain);
+    if (iDomain == -1) Error("Undefined domain :-(");
+    femDomain *theDomain = theGeometry->theDomains[iDomain];
+    int n = 0;
+    for (int e = 0; e < theDomain->nElem; e++)
+        for (int j = 0; j < 2; j++) {
+            int node = theDomain->mesh->elem[2*theDomain->elem[e]+j];
+            if (marked[node]) continue;
+            marked[node] = TRUE;
+            if (nodes != NULL) nodes[n] = node;
+            n++; }
+    return n;
+}
+
+femMonitor *femMonitorCreate(femProblem *theProblem, char *nameDomain, char *nameReaction) {
+    if (theProblem->solverType != FEM_MULTIGRID)
+        Error("Only the iterative solvers can be monitored");
+    femGeo *theGeometry = theProblem->geometry;
+    femMesh *theMesh = theGeometry->theElements;
+    int nNodes = theGeometry->theNodes->nNodes, nLocal = theMesh->nLocalNode;
+    int i,j,k,iElem;
+    femMonitor *theMonitor = femMalloc(FEM_MEM_SOLVER, sizeof(femMonitor));
+    theMonitor->problem = theProblem;
+
+    int *marked = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+    for (i = 0; i < nNodes; i++) marked[i] = FALSE;
+    theMonitor->nodes = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+    theMonitor->nNodes = femMonitorNodes(theGeometry, nameDomain, marked, theMonitor->nodes);
+    for (i = 0; i < nNodes; i++) marked[i] = FALSE;
+    int *reaction = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+    theMonitor->nReaction = femMonitorNodes(theGeometry, nameReaction, marked, reaction);
+
+    // matrices of the elements around the reaction nodes, each one taken from its first marked node
+    femTopology *theTopology = femMeshTopology(theMesh, NULL);
+    int nLoc = 2*nLocal, nElem = 0;
+    int *elements = femMalloc(FEM_MEM_SOLVER, sizeof(int) * (theTopology->nodeStart[nNodes] + 1));
+    for (i = 0; i < theMonitor->nReaction; i++) {
+        int node = reaction[i];
+        for (k = theTopology->nodeStart[node]; k < theTopology->nodeStart[node+1]; k++) {
+            iElem = theTopology->nodeElem[k];
+            for (j = 0; !marked[theMesh->elem[nLocal*iElem+j]]; j++);
+            if (theMesh->elem[nLocal*iElem+j] == node) elements[nElem++] = iElem; }}
+    femFree(reaction);
+    theMonitor->nElem = nElem;
+    theMonitor->nLoc = nLoc;
+    theMonitor->map = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nLocal * nElem);
+    theMonitor->A = femMalloc(FEM_MEM_SOLVER, sizeof(double) * nLoc * nLoc * nElem);
+    theMonitor->B = femMalloc(FEM_MEM_SOLVER, sizeof(double) * nLoc * nElem);
+    for (k = 0; k < nElem; k++) {
+        double *Aloc = &theMonitor->A[nLoc*nLoc*k], *Bloc = &theMonitor->B[nLoc*k];
+        int *map = &theMonitor->map[nLocal*k];
+        femElasticityElementMatrix(theProblem, elements[k], Aloc, Bloc, map);
+        for (i = 0; i < nLoc; i++) {
+            if (marked[map[i/2]]) continue;
+            Bloc[i] = 0.0;
+            for (j = 0; j < nLoc; j++) Aloc[i*nLoc+j] = 0.0; }}
+    femFree(elements);
+
+    // the neumann loads falling on the reaction nodes
+    double *loads = femMalloc(FEM_MEM_SOLVER, sizeof(double) * 2 * nNodes);
+    for (i = 0; i < 2*nNodes; i++) loads[i] = 0.0;
+    for (i = 0; i < theProblem->nBoundaryConditions; i++) {
+        femBoundaryCondition *theCondition = theProblem->conditions[i];
+        if (theCondition->type == NEUMANN_X || theCondition->type == NEUMANN_Y)
+            femElasticityTractionLoads(theProblem, theCondition->domain, theCondition->type, theCondition->value, loads); }
+    theMonitor->load[0] = theMonitor->load[1] = 0.0;
+    for (i = 0; i < nNodes; i++) {
+        if (!marked[i]) continue;
+        theMonitor->load[0] += loads[2*i];
+        theMonitor->load[1] += loads[2*i+1]; }
+    femFree(loads);
+    femFree(marked);
+
+    theMonitor->callback = NULL;
+    theMonitor->data = NULL;
+    theMonitor->log = NULL;
+    theMonitor->tolerance = 0.0;
+    theMonitor->stable = 0;
+    if (theProblem->monitor != NULL) femMonitorFree(theProblem->monitor);
+    theProblem->monitor = theMonitor;
+    printf("Monitor : %d nodes on %s, reaction on %s (%d nodes, %d elements)\n",
+           theMonitor->nNodes, nameDomain, nameReaction, theMonitor->nReaction, nElem);
+    return theMonitor;
+}
+
+void femMonitorFree(femMonitor *theMonitor) {
+    if (theMonitor->problem->monitor == theMonitor) theMonitor->problem->monitor = NULL;
+    femFree(theMonitor->nodes);
+    femFree(theMonitor->map);
+    femFree(theMonitor->A);
+    femFree(theMonitor->B);
+    femFree(theMonitor);
+}
+
+void femMonitorSetCallback(femMonitor *theMonitor, femIterationCallback callback, void *data) {
+    theMonitor->callback = callback;
+    theMonitor->data = data;
+}
+
+void femMonitorSetLog(femMonitor *theMonitor, FILE *log) {
+    theMonitor->log = log;
+}
+
+void femMonitorSetTolerance(femMonitor *theMonitor, double tolerance) {
+    theMonitor->tolerance = tolerance;
+}
+
+// called by the solver after each iteration with the iterate x (natural ordering), TRUE to stop
+int femMonitorReport(femMonitor *theMonitor, int iteration, double residual, double energy, const double *x) {
+    int i,j,k,iElem;
+    int nLoc = theMonitor->nLoc, nLocal = nLoc/2;
+    femIterationReport theReport;
+    theReport.iteration = iteration;
+    theReport.residual = residual;
+    theReport.energy = energy;
+
+    double displacement = 0.0;
+    for (i = 0; i < theMonitor->nNodes; i++) {
+        int node = theMonitor->nodes[i];
+        double u = x[2*node]*x[2*node] + x[2*node+1]*x[2*node+1];
+        if (u > displacement) displacement = u; }
+    theReport.displacement = sqrt(displacement);
+
+    double force[2] = {-theMonitor->load[0], -theMonitor->load[1]};
+    for (iElem = 0; iElem < theMonitor->nElem; iElem++) {
+        const double *Aloc = &theMonitor->A[nLoc*nLoc*iElem], *Bloc = &theMonitor->B[nLoc*iElem];
+        const int *map = &theMonitor->map[nLocal*iElem];
+        double Uloc[8];
+        for (j = 0; j < nLocal; j++) {
+            Uloc[2*j]   = x[2*map[j]];
+            Uloc[2*j+1] = x[2*map[j]+1]; }
+        for (i = 0; i < nLoc; i++) {
+            double r = -Bloc[i];
+            for (k = 0; k < nLoc; k++) r += Aloc[i*nLoc+k] * Uloc[k];
+            force[i%2] += r; }}
+    theReport.reaction = sqrt(force[0]*force[0] + force[1]*force[1]);
+
+    if (theMonitor->callback != NULL) theMonitor->callback(&theReport, theMonitor->data);
+    if (theMonitor->log != NULL)
+        fprintf(theMonitor->log, "Monitor : %4d  residual %.2e  energy %.2e  displacement %.6e  reaction %.6e\n",
+                iteration, residual, energy, theReport.displacement, theReport.reaction);
+
+    // both quantities of interest within the tolerance twice in a row
+    if (iteration <= 1) theMonitor->stable = 0;
+    else {
+        femIterationReport *theLast = &theMonitor->last;
+        int stable = fabs(theReport.displacement - theLast->displacement) <= theMonitor->tolerance * fabs(theReport.displacement)
+                  && fabs(theReport.reaction - theLast->reaction) <= theMonitor->tolerance * fabs(theReport.reaction);
+        theMonitor->stable = stable ? theMonitor->stable + 1 : 0; }
+    theMonitor->last = theReport;
+    return theMonitor->tolerance > 0.0 && theMonitor->stable >= 2;
+}
@@ -0,0 +1,692 @@
+/*
+ *  femMultigrid.c
+ *  Geometric and algebraic multigrid, as a preconditioner of the conjugate gradients
+ *
+ *  Each level but the coarsest keeps the prolongation P from the next one,
+ *  row by row, and the coarse operators are the Galerkin products P^T A P.
+ *  The constrained dofs have no entry in P, their rows are the identity so
+ *  that the corrections never move them; a coarse dof left without any
+ *  coupling is constrained in the same way. One V or W-cycle with symmetric
+ *  smoothing (forward then backward Gauss-Seidel, or a chebyshev polynomial
+ *  of the jacobi iteration) and a band factorization of the coarsest level is
+ *  a symmetric preconditioner of the conjugate gradients.
+ *
+ *  Geometric levels are built by uniform newest vertex bisection of the coarse
+ *  mesh : every pass bisects all the triangles, so each level has about twice
+ *  the elements of the previous one and two passes halve the mesh size. A new
+ *  node is the midpoint of a coarse edge, P is then the average of its two
+ *  parents, dof by dof.
+ *
+ *  Algebraic levels come from smoothed aggregation : the nodes (blocks of two
+ *  dofs, then of three) are grouped along the strong couplings of the matrix,
+ *  the rigid body modes of the plane (two translations and the rotation) are
+ *  orthonormalized on each aggregate to give a tentative P with three coarse
+ *  dofs per aggregate, and one damped jacobi step on A smooths it. The
+ *  triangular factors of the orthonormalizations are the rigid body modes of
+ *  the next level.
+ *
+ */
+
+#include "../headers/femMultigrid.h"
+
+#define FEM_MULTIGRID_POWER 15
+#define FEM_MULTIGRID_MODES 3
+
+
+static femMultigrid *femMultigridAlloc(int nLevels) {
+    femMultigrid *theMultigrid = femMalloc(FEM_MEM_SOLVER, sizeof(femMultigrid));
+    theMultigrid->nLevels = nLevels;
+    theMultigrid->refinements = NULL;
+    theMultigrid->coarseNumber = NULL;
+    theMultigrid->coarseOrder = NULL;
+    theMultigrid->coarse = NULL;
+    theMultigrid->levels = NULL;
+    theMultigrid->work = NULL;
+    theMultigrid->smoother = FEM_GAUSS_SEIDEL;
+    theMultigrid->nSmooth = 2;
+    theMultigrid->gamma = 1;
+    theMultigrid->strength = 0.08;
+    theMultigrid->coarseSize = 400;
+    theMultigrid->tolerance = 1e-10;
+    theMultigrid->maxIterations = 500;
+    theMultigrid->iterations = 0;
+    theMultigrid->flops = 0.0;
+    theMultigrid->monitor = NULL;
+    return theMultigrid;
+}
+
+// each pass of the refinement is one level, the geometry ends up on the finest mesh
+femMultigrid *femMultigridCreate(femGeo *theGeometry, int nRefinements) {
+    if (nRefinements < 0) nRefinements = 0;
+    if (nRefinements >= FEM_MULTIGRID_MAXLEVELS) Error("Too many multigrid levels");
+    femMultigrid *theMultigrid = femMultigridAlloc(nRefinements + 1);
+    femMesh *theElements = theGeometry->theElements;
+    int nNodes = theGeometry->theNodes->nNodes;
+
+    // the coarsest level is factorized with the best of the two renumberings
+    theMultigrid->coarseNumber = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+    int bandX = femMeshRenumber(theElements, FEM_XNUM, theMultigrid->coarseNumber);
+    int bandY = femMeshRenumber(theElements, FEM_YNUM, theMultigrid->coarseNumber);
+    if (bandX < bandY) femMeshRenumber(theElements, FEM_XNUM, theMultigrid->coarseNumber);
+
+    theMultigrid->refinements = femMalloc(FEM_MEM_SOLVER, sizeof(femRefinement*) * (nRefinements + 1));
+    for (int l = 0; l < nRefinements; l++) {
+        int *marked = femMalloc(FEM_MEM_SOLVER, sizeof(int) * theElements->nElem);
+        for (int i = 0; i < theElements->nElem; i++) marked[i] = TRUE;
+        theMultigrid->refinements[l] = geoMeshRefineGeo(theGeometry, marked);
+        femFree(marked); }
+    printf("Solver  : %d multigrid levels, from %d to %d nodes\n",
+           theMultigrid->nLevels, nNodes, theGeometry->theNodes->nNodes);
+    return theMultigrid;
+}
+
+// the levels are found by femMultigridSetup from the assembled system and the coordinates
+femMultigrid *femMultigridCreateAlgebraic() {
+    return femMultigridAlloc(0);
+}
+
+static void femMultigridRelease(femMultigrid *theMultigrid) {
+    if (theMultigrid->levels == NULL) return;
+    for (int l = 0; l < theMultigrid->nLevels; l++) {
+        femMultigridLevel *theLevel = &theMultigrid->levels[l];
+        if (l > 0) femSparseSystemFree(theLevel->system);
+        if (theLevel->pStart) { femFree(theLevel->pStart); femFree(theLevel->pCol); femFree(theLevel->pValue); }
+        femFree(theLevel->fixed);
+        femFree(theLevel->x); femFree(theLevel->b);
+        femFree(theLevel->r); femFree(theLevel->d); }
+    femFree(theMultigrid->levels);
+    femFree(theMultigrid->work);
+    femFree(theMultigrid->coarseOrder);
+    femBandSystemFree(theMultigrid->coarse);
+    theMultigrid->levels = NULL;
+    theMultigrid->work = NULL;
+    theMultigrid->coarseOrder = NULL;
+    theMultigrid->coarse = NULL;
+}
+
+void femMultigridFree(femMultigrid *theMultigrid) {
+    femMultigridRelease(theMultigrid);
+    if (theMultigrid->refinements) {
+        for (int l = 0; l < theMultigrid->nLevels - 1; l++)
+            femRefinementFree(theMultigrid->refinements[l]);
+        femFree(theMultigrid->refinements);
+        femFree(theMultigrid->coarseNumber); }
+    femFree(theMultigrid);
+}
+
+// replaces the algebraic multigrid of the problem, which then owns the hierarchy
+void femMultigridAttach(femMultigrid *theMultigrid, femProblem *theProblem) {
+    if (theProblem->solverType != FEM_MULTIGRID) Error("The problem does not use the multigrid solver");
+    int nLevels = theMultigrid->nLevels;
+    if (theMultigrid->refinements != NULL && nLevels > 1 &&
+        theMultigrid->refinements[nLevels-2]->nNodes != theProblem->geometry->theNodes->nNodes)
+        Error("The multigrid levels do not match the mesh of the problem");
+    if (theProblem->multigrid != NULL && theProblem->multigrid != theMultigrid) femMultigridFree(theProblem->multigrid);
+    theProblem->multigrid = theMultigrid;
+    theProblem->factorized = FALSE;
+}
+
+
+/*
+ *  Sparse products
+ */
+
+// C = A B row by row, the diagonal is always in the pattern of a square C
+static void femMultigridProduct(int nRows, int nCols, const int *aStart, const int *aCol, const double *aValue,
+                                const int *bStart, const int *bCol, const double *bValue, int diagonal,
+                                int **cStart, int **cCol, double **cValue) {
+    int *start = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (nRows+1));
+    int *marker = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * nCols);
+    int i,k,m;
+    for (i = 0; i < nCols; i++) marker[i] = -1;
+    start[0] = 0;
+    for (i = 0; i < nRows; i++) {
+        int n = 0;
+        if (diagonal) { marker[i] = i; n++; }
+        for (k = aStart[i]; k < aStart[i+1]; k++) {
+            if (aValue[k] == 0.0) continue;
+            for (m = bStart[aCol[k]]; m < bStart[aCol[k]+1]; m++)
+                if (marker[bCol[m]] != i) { marker[bCol[m]] = i; n++; }}
+        start[i+1] = start[i] + n; }
+
+    // the marker now holds the position of each column in the current row
+    int *col = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (start[nRows] + 1));
+    double *value = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * (start[nRows] + 1));
+    for (i = 0; i < nCols; i++) marker[i] = -1;
+    for (i = 0; i < nRows; i++) {
+        int p = start[i];
+        if (diagonal) { marker[i] = p; col[p] = i; value[p++] = 0.0; }
+        for (k = aStart[i]; k < aStart[i+1]; k++) {
+            if (aValue[k] == 0.0) continue;
+            for (m = bStart[aCol[k]]; m < bStart[aCol[k]+1]; m++) {
+                int c = bCol[m];
+                if (marker[c] < start[i]) { marker[c] = p; col[p] = c; value[p++] = aValue[k] * bValue[m]; }
+                else value[marker[c]] += aValue[k] * bValue[m]; }}}
+    femFree(marker);
+    *cStart = start; *cCol = col; *cValue = value;
+}
+
+static void femMultigridTranspose(int nRows, int nCols, const int *start, const int *col, const double *value,
+                                  int **tStart, int **tCol, double **tValue) {
+    int *count = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (nCols+1));
+    int i,k;
+    for (i = 0; i <= nCols; i++) count[i] = 0;
+    for (k = 0; k < start[nRows]; k++) count[col[k]+1]++;
+    for (i = 0; i < nCols; i++) count[i+1] += count[i];
+    int *tc = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (start[nRows] + 1));
+    double *tv = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * (start[nRows] + 1));
+    for (i = 0; i < nRows; i++)
+        for (k = start[i]; k < start[i+1]; k++) {
+            tc[count[col[k]]] = i;
+            tv[count[col[k]]++] = value[k]; }
+    for (i = nCols; i > 0; i--) count[i] = count[i-1];
+    count[0] = 0;
+    *tStart = count; *tCol = tc; *tValue = tv;
+}
+
+// P^T A P, the coarse dofs without any coupling become constrained
+static femSparseSystem *femMultigridGalerkin(femMultigridLevel *theFine, int nCoarse, int **fixed) {
+    femSparseSystem *fine = theFine->system;
+    int *apStart, *apCol, *ptStart, *ptCol;
+    double *apValue, *ptValue;
+    int i,j,k;
+    femMultigridProduct(theFine->size, nCoarse, fine->rowStart, fine->col, fine->A,
+                        theFine->pStart, theFine->pCol, theFine->pValue, FALSE, &apStart, &apCol, &apValue);
+    femMultigridTranspose(theFine->size, nCoarse, theFine->pStart, theFine->pCol, theFine->pValue, &ptStart, &ptCol, &ptValue);
+
+    femSparseSystem *coarse = femMalloc(FEM_MEM_SYSTEM, sizeof(femSparseSystem));
+    coarse->size = nCoarse;
+    femMultigridProduct(nCoarse, nCoarse, ptStart, ptCol, ptValue, apStart, apCol, apValue, TRUE,
+                        &coarse->rowStart, &coarse->col, &coarse->A);
+    femFree(apStart); femFree(apCol); femFree(apValue);
+    femFree(ptStart); femFree(ptCol); femFree(ptValue);
+
+    // sorted columns for the lookups
+    for (i = 0; i < nCoarse; i++) {
+        int first = coarse->rowStart[i], n = coarse->rowStart[i+1] - first;
+        int *c = &coarse->col[first];
+        double *a = &coarse->A[first];
+        for (j = 1; j < n; j++) {
+            int column = c[j];
+            double value = a[j];
+            for (k = j; k > 0 && c[k-1] > column; k--) { c[k] = c[k-1]; a[k] = a[k-1]; }
+            c[k] = column; a[k] = value; }}
+    coarse->B = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * nCoarse);
+    coarse->diag = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * nCoarse);
+    double scale = 0.0;
+    for (i = 0; i < nCoarse; i++) {
+        coarse->B[i] = 0.0;
+        coarse->diag[i] = femSparseSystemFind(coarse, i, i);
+        scale = fmax(scale, coarse->A[coarse->diag[i]]); }
+
+    *fixed = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nCoarse);
+    for (i = 0; i < nCoarse; i++) (*fixed)[i] = (coarse->A[coarse->diag[i]] <= 1e-12 * scale);
+    for (i = 0; i < nCoarse; i++)
+        for (k = coarse->rowStart[i]; k < coarse->rowStart[i+1]; k++)
+            if ((*fixed)[i] || (*fixed)[coarse->col[k]]) coarse->A[k] = (coarse->col[k] == i) ? 1.0 : 0.0;
+    return coarse;
+}
+
+
+/*
+ *  Prolongations
+ */
+
+static void femMultigridAllocP(femMultigridLevel *theLevel, int nnz) {
+    theLevel->pStart = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (theLevel->size+1));
+    theLevel->pCol = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (nnz+1));
+    theLevel->pValue = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * (nnz+1));
+}
+
+// the average of the two parents, a coarse dof is constrained with the fine dof of its node
+static int femMultigridGeometric(femMultigridLevel *theLevel, femRefinement *theRefinement) {
+    int nCoarse = theRefinement->nNodesCoarse;
+    int *fixed = theLevel->fixed;
+    femMultigridAllocP(theLevel, 2*theLevel->size);
+    int n = 0;
+    for (int i = 0; i < theRefinement->nNodes; i++)
+        for (int s = 0; s < 2; s++) {
+            theLevel->pStart[2*i+s] = n;
+            if (fixed[2*i+s]) continue;
+            if (i < nCoarse) {
+                theLevel->pCol[n] = 2*i+s;
+                theLevel->pValue[n++] = 1.0;
+                continue; }
+            for (int j = 0; j < 2; j++) {
+                int dof = 2*theRefinement->parents[2*(i-nCoarse)+j] + s;
+                if (fixed[dof]) continue;
+                theLevel->pCol[n] = dof;
+                theLevel->pValue[n++] = 0.5; }}
+    theLevel->pStart[theLevel->size] = n;
+    return 2*nCoarse;
+}
+
+// largest eigenvalue of D^-1 A by power iterations
+static double femMultigridLambda(femMultigridLevel *theLevel) {
+    femSparseSystem *theSystem = theLevel->system;
+    double *v = theLevel->x, *w = theLevel->r, lambda = 1.0;
+    int i, size = theLevel->size;
+    for (i = 0; i < size; i++) v[i] = theLevel->fixed[i] ? 0.0 : 1.0 + 0.5 * sin((double) i);
+    for (int k = 0; k < FEM_MULTIGRID_POWER; k++) {
+        double norm = 0.0, normW = 0.0;
+        femSparseSystemMultiply(theSystem, v, w);
+        for (i = 0; i < size; i++) {
+            w[i] = theLevel->fixed[i] ? 0.0 : w[i] / theSystem->A[theSystem->diag[i]];
+            norm += v[i] * v[i];
+            normW += w[i] * w[i]; }
+        if (normW == 0.0) break;
+        lambda = sqrt(normW / norm);
+        for (i = 0; i < size; i++) v[i] = w[i] / sqrt(normW); }
+    return lambda;
+}
+
+// smoothed aggregation of the nodes (blocks of blockSize dofs), modes holds the rigid body modes of
+// the level, three per dof, and receives those of the coarse level; returns the number of coarse dofs
+static int femMultigridAggregate(femMultigridLevel *theLevel, int blockSize, double strength, double **modes) {
+    femSparseSystem *theSystem = theLevel->system;
+    int *fixed = theLevel->fixed;
+    int size = theLevel->size, nNodes = size / blockSize;
+    int i,j,k,p,s;
+
+    // norm of the diagonal blocks, a node whose dofs are all constrained is left out
+    double *norm = femMalloc(FEM_MEM_SOLVER, sizeof(double) * nNodes);
+    int *aggregate = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+    for (i = 0; i < nNodes; i++) {
+        norm[i] = 0.0;
+        aggregate[i] = -2;
+        for (s = 0; s < blockSize; s++) {
+            int row = blockSize*i+s;
+            if (!fixed[row]) aggregate[i] = -1;
+            for (k = theSystem->rowStart[row]; k < theSystem->rowStart[row+1]; k++)
+                if (theSystem->col[k] / blockSize == i) norm[i] += theSystem->A[k] * theSystem->A[k]; }
+        norm[i] = sqrt(norm[i]); }
+
+    // strong couplings : |A_ij| >= strength sqrt(|A_ii| |A_jj|) for the frobenius norms of the blocks
+    int *strongStart = femMalloc(FEM_MEM_SOLVER, sizeof(int) * (nNodes+1));
+    int *marker = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+    double *coupling = femMalloc(FEM_MEM_SOLVER, sizeof(double) * nNodes);
+    int *strong = NULL;
+    for (i = 0; i < nNodes; i++) { marker[i] = -1; coupling[i] = 0.0; }
+    strongStart[0] = 0;
+    for (int pass = 0; pass < 2; pass++) {
+        for (i = 0; i < nNodes; i++) {
+            int n = 0;
+            for (s = 0; s < blockSize && aggregate[i] != -2; s++) {
+                int row = blockSize*i+s;
+                for (k = theSystem->rowStart[row]; k < theSystem->rowStart[row+1]; k++) {
+                    j = theSystem->col[k] / blockSize;
+                    coupling[j] += theSystem->A[k] * theSystem->A[k]; }}
+            for (s = 0; s < blockSize && aggregate[i] != -2; s++) {
+                int row = blockSize*i+s;
+                for (k = theSystem->rowStart[row]; k < theSystem->rowStart[row+1]; k++) {
+                    j = theSystem->col[k] / blockSize;
+                    if (marker[j] == 2*i+pass) continue;
+                    marker[j] = 2*i+pass;
+                    if (j != i && aggregate[j] != -2 && sqrt(coupling[j]) >= strength * sqrt(norm[i] * norm[j])) {
+                        if (pass == 1) strong[strongStart[i] + n] = j;
+                        n++; }
+                    coupling[j] = 0.0; }}
+            if (pass == 0) strongStart[i+1] = strongStart[i] + n; }
+        if (pass == 0) strong = femMalloc(FEM_MEM_SOLVER, sizeof(int) * (strongStart[nNodes] + 1)); }
+    femFree(coupling); femFree(norm);
+
+    // a node and its strong neighbours when none of them is taken, then the remaining nodes join
+    // a neighbouring aggregate, and what is left starts new aggregates
+    int nAggregates = 0;
+    for (i = 0; i < nNodes; i++) {
+        if (aggregate[i] != -1) continue;
+        for (k = strongStart[i]; k < strongStart[i+1] && aggregate[strong[k]] == -1; k++);
+        if (k < strongStart[i+1]) continue;
+        aggregate[i] = nAggregates;
+        for (k = strongStart[i]; k < strongStart[i+1]; k++) aggregate[strong[k]] = nAggregates;
+        nAggregates++; }
+    for (i = 0; i < nNodes; i++) marker[i] = aggregate[i];
+    for (i = 0; i < nNodes; i++) {
+        if (aggregate[i] != -1) continue;
+        for (k = strongStart[i]; k < strongStart[i+1]; k++)
+            if (marker[strong[k]] >= 0) { aggregate[i] = marker[strong[k]]; break; }}
+    for (i = 0; i < nNodes; i++) {
+        if (aggregate[i] != -1) continue;
+        aggregate[i] = nAggregates;
+        for (k = strongStart[i]; k < strongStart[i+1]; k++)
+            if (aggregate[strong[k]] == -1) aggregate[strong[k]] = nAggregates;
+        nAggregates++; }
+    femFree(strong); femFree(strongStart); femFree(marker);
+
+    // tentative prolongation : the modes orthonormalized on the free dofs of each aggregate
+    int nCoarse = FEM_MULTIGRID_MODES * nAggregates;
+    int *memberStart = femMalloc(FEM_MEM_SOLVER, sizeof(int) * (nAggregates+1));
+    int *member = femMalloc(FEM_MEM_SOLVER, sizeof(int) * (nNodes+1));
+    for (i = 0; i <= nAggregates; i++) memberStart[i] = 0;
+    for (i = 0; i < nNodes; i++) if (aggregate[i] >= 0) memberStart[aggregate[i]+1]++;
+    for (i = 0; i < nAggregates; i++) memberStart[i+1] += memberStart[i];
+    for (i = 0; i < nNodes; i++) if (aggregate[i] >= 0) member[memberStart[aggregate[i]]++] = i;
+    for (i = nAggregates; i > 0; i--) memberStart[i] = memberStart[i-1];
+    memberStart[0] = 0;
+
+    double *Q = femMalloc(FEM_MEM_SOLVER, sizeof(double) * FEM_MULTIGRID_MODES * size);
+    double *coarseModes = femMalloc(FEM_MEM_SOLVER, sizeof(double) * FEM_MULTIGRID_MODES * (nCoarse+1));
+    int *kept = femMalloc(FEM_MEM_SOLVER, sizeof(int) * (nCoarse+1));
+    for (i = 0; i < FEM_MULTIGRID_MODES * size; i++) Q[i] = fixed[i / FEM_MULTIGRID_MODES] ? 0.0 : (*modes)[i];
+    for (int a = 0; a < nAggregates; a++) {
+        double *R = &coarseModes[FEM_MULTIGRID_MODES * FEM_MULTIGRID_MODES * a];
+        for (i = 0; i < FEM_MULTIGRID_MODES * FEM_MULTIGRID_MODES; i++) R[i] = 0.0;
+        for (int c = 0; c < FEM_MULTIGRID_MODES; c++) {
+            double original = 0.0, length = 0.0;
+            for (p = memberStart[a]; p < memberStart[a+1]; p++)
+                for (s = 0; s < blockSize; s++) {
+                    double q = Q[FEM_MULTIGRID_MODES * (blockSize*member[p]+s) + c];
+                    original += q * q; }
+            // modified Gram-Schmidt, a dependent mode is dropped and its coarse dof constrained
+            for (int m = 0; m < c; m++) {
+                if (!kept[FEM_MULTIGRID_MODES*a+m]) continue;
+                double dot = 0.0;
+                for (p = memberStart[a]; p < memberStart[a+1]; p++)
+                    for (s = 0; s < blockSize; s++) {
+                        double *q = &Q[FEM_MULTIGRID_MODES * (blockSize*member[p]+s)];
+                        dot += q[m] * q[c]; }
+                R[FEM_MULTIGRID_MODES*m + c] = dot;
+                for (p = memberStart[a]; p < memberStart[a+1]; p++)
+                    for (s = 0; s < blockSize; s++) {
+                        double *q = &Q[FEM_MULTIGRID_MODES * (blockSize*member[p]+s)];
+                        q[c] -= dot * q[m]; }}
+            for (p = memberStart[a]; p < memberStart[a+1]; p++)
+                for (s = 0; s < blockSize; s++) {
+                    double q = Q[FEM_MULTIGRID_MODES * (blockSize*member[p]+s) + c];
+                    length += q * q; }
+            kept[FEM_MULTIGRID_MODES*a+c] = (length > 1e-16 * original && length > 0.0);
+            double factor = kept[FEM_MULTIGRID_MODES*a+c] ? 1.0 / sqrt(length) : 0.0;
+            R[FEM_MULTIGRID_MODES*c + c] = kept[FEM_MULTIGRID_MODES*a+c] ? sqrt(length) : 0.0;
+            for (p = memberStart[a]; p < memberStart[a+1]; p++)
+                for (s = 0; s < blockSize; s++)
+                    Q[FEM_MULTIGRID_MODES * (blockSize*member[p]+s) + c] *= factor; }}
+
+    int *tStart = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (size+1));
+    int *tCol = femMalloc(FEM_MEM_SYSTEM, sizeof(int) * (FEM_MULTIGRID_MODES * size + 1));
+    double *tValue = femMalloc(FEM_MEM_SYSTEM, sizeof(double) * (FEM_MULTIGRID_MODES * size + 1));
+    int n = 0;
+    for (i = 0; i < size; i++) {
+        tStart[i] = n;
+        int a = aggregate[i / blockSize];
+        if (a < 0 || fixed[i]) continue;
+        for (int c = 0; c < FEM_MULTIGRID_MODES; c++) {
+            if (!kept[FEM_MULTIGRID_MODES*a+c]) continue;
+            tCol[n] = FEM_MULTIGRID_MODES*a+c;
+            tValue[n++] = Q[FEM_MULTIGRID_MODES*i+c]; }}
+    tStart[size] = n;
+    femFree(Q); femFree(kept);
+    femFree(member); femFree(memberStart); femFree(aggregate);
+
+    // P = (I - omega D^-1 A) T with omega = 4 / (3 lambda)
+    theLevel->lambda = femMultigridLambda(theLevel);
+    double omega = 4.0 / (3.0 * theLevel->lambda);
+    int *apStart, *apCol;
+    double *apValue;
+    femMultigridProduct(size, nCoarse, theSystem->rowStart, theSystem->col, theSystem->A,
+                        tStart, tCol, tValue, FALSE, &apStart, &apCol, &apValue);
+    femMultigridAllocP(theLevel, apStart[size]);
+    double *dense = femMalloc(FEM_MEM_SOLVER, sizeof(double) * (nCoarse+1));
+    for (i = 0; i < nCoarse; i++) dense[i] = 0.0;
+    n = 0;
+    for (i = 0; i < size; i++) {
+        theLevel->pStart[i] = n;
+        if (fixed[i]) continue;
+        double factor = omega / theSystem->A[theSystem->diag[i]];
+        for (k = tStart[i]; k < tStart[i+1]; k++) dense[tCol[k]] = tValue[k];
+        for (k = apStart[i]; k < apStart[i+1]; k++) {
+            theLevel->pCol[n] = apCol[k];
+            theLevel->pValue[n++] = dense[apCol[k]] - factor * apValue[k]; }
+        for (k = tStart[i]; k < tStart[i+1]; k++) dense[tCol[k]] = 0.0; }
+    theLevel->pStart[size] = n;
+    femFree(dense);
+    femFree(apStart); femFree(apCol); femFree(apValue);
+    femFree(tStart); femFree(tCol); femFree(tValue);
+
+    femFree(*modes);
+    *modes = coarseModes;
+    return nCoarse;
+}
+
+
+/*
+ *  Cycles
+ */
+
+static void femMultigridRestrict(femMultigridLevel *theFine, const double *fine, femMultigridLevel *theCoarse) {
+    double *coarse = theCoarse->b;
+    for (int i = 0; i < theCoarse->size; i++) coarse[i] = 0.0;
+    for (int i = 0; i < theFine->size; i++)
+        for (int k = theFine->pStart[i]; k < theFine->pStart[i+1]; k++)
+            coarse[theFine->pCol[k]] += theFine->pValue[k] * fine[i];
+    for (int i = 0; i < theCoarse->size; i++) if (theCoarse->fixed[i]) coarse[i] = 0.0;
+}
+
+static void femMultigridProlongate(femMultigridLevel *theFine, const double *coarse) {
+    for (int i = 0; i < theFine->size; i++)
+        for (int k = theFine->pStart[i]; k < theFine->pStart[i+1]; k++)
+            theFine->x[i] += theFine->pValue[k] * coarse[theFine->pCol[k]];
+}
+
+static void femMultigridGaussSeidel(femMultigridLevel *theLevel, int backward) {
+    femSparseSystem *theSystem = theLevel->system;
+    double *x = theLevel->x, *b = theLevel->b;
+    for (int n = 0; n < theLevel->size; n++) {
+        int i = backward ? theLevel->size - 1 - n : n;
+        double sum = b[i];
+        for (int k = theSystem->rowStart[i]; k < theSystem->rowStart[i+1]; k++)
+            sum -= theSystem->A[k] * x[theSystem->col[k]];
+        x[i] += sum / theSystem->A[theSystem->diag[i]]; }
+}
+
+// chebyshev acceleration of the jacobi iteration on [0.1, 1.1] lambda, the upper part of the spectrum
+static void femMultigridChebyshev(femMultigridLevel *theLevel, int degree) {
+    femSparseSystem *theSystem = theLevel->system;
+    double *x = theLevel->x, *r = theLevel->r, *d = theLevel->d, *A = theSystem->A;
+    int i, size = theLevel->size;
+    double upper = 1.1 * theLevel->lambda, lower = 0.1 * theLevel->lambda;
+    double theta = 0.5 * (upper + lower), delta = 0.5 * (upper - lower);
+    double sigma = theta / delta, rho = 1.0 / sigma;
+
+    femSparseSystemMultiply(theSystem, x, r);
+    for (i = 0; i < size; i++) {
+        r[i] = theLevel->b[i] - r[i];
+        d[i] = r[i] / (theta * A[theSystem->diag[i]]); }
+    for (int k = 0; k < degree; k++) {
+        for (i = 0; i < size; i++) x[i] += d[i];
+        if (k == degree - 1) break;
+        for (i = 0; i < size; i++) {
+            double sum = 0.0;
+            for (int p = theSystem->rowStart[i]; p < theSystem->rowStart[i+1]; p++)
+                sum += A[p] * d[theSystem->col[p]];
+            r[i] -= sum; }
+        double rhoNew = 1.0 / (2.0 * sigma - rho);
+        for (i = 0; i < size; i++)
+            d[i] = rhoNew * rho * d[i] + 2.0 * rhoNew / delta * r[i] / A[theSystem->diag[i]];
+        rho = rhoNew; }
+}
+
+static void femMultigridSmooth(femMultigrid *theMultigrid, femMultigridLevel *theLevel, int backward) {
+    if (theMultigrid->smoother == FEM_CHEBYSHEV) femMultigridChebyshev(theLevel, theMultigrid->nSmooth);
+    else for (int k = 0; k < theMultigrid->nSmooth; k++) femMultigridGaussSeidel(theLevel, backward);
+}
+
+// improves levels[l].x for levels[l].b, the direct solve on the coarsest level
+static void femMultigridCycle(femMultigrid *theMultigrid, int l) {
+    femMultigridLevel *theLevel = &theMultigrid->levels[l];
+    int i;
+    if (l == theMultigrid->nLevels - 1) {
+        femBandSystem *theBand = theMultigrid->coarse;
+        int *order = theMultigrid->coarseOrder;
+        for (i = 0; i < theLevel->size; i++) theBand->B[order[i]] = theLevel->b[i];
+        femBandSystemSolve(theBand);
+        for (i = 0; i < theLevel->size; i++) theLevel->x[i] = theBand->B[order[i]];
+        return; }
+
+    femMultigridLevel *theCoarse = &theMultigrid->levels[l+1];
+    femMultigridSmooth(theMultigrid, theLevel, FALSE);
+    femSparseSystemMultiply(theLevel->system, theLevel->x, theLevel->r);
+    for (i = 0; i < theLevel->size; i++) theLevel->r[i] = theLevel->b[i] - theLevel->r[i];
+    femMultigridRestrict(theLevel, theLevel->r, theCoarse);
+    for (i = 0; i < theCoarse->size; i++) theCoarse->x[i] = 0.0;
+    for (int g = 0; g < theMultigrid->gamma; g++) femMultigridCycle(theMultigrid, l+1);
+    femMultigridProlongate(theLevel, theCoarse->x);
+    femMultigridSmooth(theMultigrid, theLevel, TRUE);
+}
+
+static void femMultigridLevelAlloc(femMultigridLevel *theLevel, femSparseSystem *theSystem, int *fixed) {
+    theLevel->system = theSystem;
+    theLevel->size = theSystem->size;
+    theLevel->fixed = fixed;
+    theLevel->pStart = NULL;
+    theLevel->pCol = NULL;
+    theLevel->pValue = NULL;
+    theLevel->x = femMalloc(FEM_MEM_SOLVER, sizeof(double) * theLevel->size);
+    theLevel->b = femMalloc(FEM_MEM_SOLVER, sizeof(double) * theLevel->size);
+    theLevel->r = femMalloc(FEM_MEM_SOLVER, sizeof(double) * theLevel->size);
+    theLevel->d = femMalloc(FEM_MEM_SOLVER, sizeof(double) * theLevel->size);
+    theLevel->lambda = 0.0;
+}
+
+// coarse operators and factorization for the constrained system of the problem
+void femMultigridSetup(femMultigrid *theMultigrid, femProblem *theProblem) {
+    femSparseSystem *theSystem = theProblem->sparseSystem;
+    int i,l;
+    femMultigridRelease(theMultigrid);
+    theMultigrid->levels = femMalloc(FEM_MEM_SOLVER, sizeof(femMultigridLevel) * FEM_MULTIGRID_MAXLEVELS);
+    int *fixed = femMalloc(FEM_MEM_SOLVER, sizeof(int) * theSystem->size);
+    for (i = 0; i < theSystem->size; i++) fixed[i] = (theProblem->constrainedNodes[i] != -1);
+    femMultigridLevelAlloc(&theMultigrid->levels[0], theSystem, fixed);
+
+    if (theMultigrid->refinements != NULL) {
+        for (l = 1; l < theMultigrid->nLevels; l++) {
+            femMultigridLevel *theFine = &theMultigrid->levels[l-1];
+            int nCoarse = femMultigridGeometric(theFine, theMultigrid->refinements[theMultigrid->nLevels - 1 - l]);
+            theSystem = femMultigridGalerkin(theFine, nCoarse, &fixed);
+            femMultigridLevelAlloc(&theMultigrid->levels[l], theSystem, fixed); }}
+    else {
+        // rigid body modes of the nodes, around the center of the mesh and scaled by its size
+        femNodes *theNodes = theProblem->geometry->theNodes;
+        int nNodes = theNodes->nNodes;
+        double xMin = femMin(theNodes->X, nNodes), xMax = femMax(theNodes->X, nNodes);
+        double yMin = femMin(theNodes->Y, nNodes), yMax = femMax(theNodes->Y, nNodes);
+        double length = fmax(fmax(xMax - xMin, yMax - yMin), 1e-300);
+        double *modes = femMalloc(FEM_MEM_SOLVER, sizeof(double) * FEM_MULTIGRID_MODES * 2 * nNodes);
+        for (i = 0; i < nNodes; i++) {
+            double x = (theNodes->X[i] - 0.5 * (xMin + xMax)) / length;
+            double y = (theNodes->Y[i] - 0.5 * (yMin + yMax)) / length;
+            double *m = &modes[2 * FEM_MULTIGRID_MODES * i];
+            m[0] = 1.0; m[1] = 0.0; m[2] = -y;
+            m[3] = 0.0; m[4] = 1.0; m[5] =  x; }
+        int blockSize = 2;
+        double strength = theMultigrid->strength;
+        for (l = 0; l < FEM_MULTIGRID_MAXLEVELS - 1 && theMultigrid->levels[l].size > theMultigrid->coarseSize; l++) {
+            femMultigridLevel *theFine = &theMultigrid->levels[l];
+            int nCoarse = femMultigridAggregate(theFine, blockSize, strength, &modes);
+            if (nCoarse == 0 || nCoarse > 0.8 * theFine->size) {
+                femFree(theFine->pStart); femFree(theFine->pCol); femFree(theFine->pValue);
+                theFine->pStart = NULL;
+                break; }
+            theSystem = femMultigridGalerkin(theFine, nCoarse, &fixed);
+            femMultigridLevelAlloc(&theMultigrid->levels[l+1], theSystem, fixed);
+            blockSize = FEM_MULTIGRID_MODES;
+            strength *= 0.5; }
+        femFree(modes);
+        theMultigrid->nLevels = l + 1;
+        printf("Solver  : %d algebraic multigrid levels, from %d to %d dofs\n",
+               theMultigrid->nLevels, theMultigrid->levels[0].size, theMultigrid->levels[l].size); }
+
+    int nLevels = theMultigrid->nLevels;
+    theMultigrid->flops = 0.0;
+    for (l = 0; l < nLevels; l++) {
+        femMultigridLevel *theLevel = &theMultigrid->levels[l];
+        if (theMultigrid->smoother == FEM_CHEBYSHEV && l < nLevels - 1 && theLevel->lambda == 0.0)
+            theLevel->lambda = femMultigridLambda(theLevel);
+        double nnz = theLevel->system->rowStart[theLevel->size];
+        double pnz = (l < nLevels - 1) ? theLevel->pStart[theLevel->size] : 0.0;
+        theMultigrid->flops += pow(theMultigrid->gamma, l) * (2.0 * (2 * theMultigrid->nSmooth + 1) * nnz + 4.0 * pnz + 8.0 * theLevel->size); }
+
+    // band factorization of the coarsest level, renumbered when it is a mesh
+    femMultigridLevel *theCoarsest = &theMultigrid->levels[nLevels-1];
+    theSystem = theCoarsest->system;
+    int *order = femMalloc(FEM_MEM_SOLVER, sizeof(int) * theCoarsest->size);
+    for (i = 0; i < theCoarsest->size; i++)
+        order[i] = (theMultigrid->coarseNumber != NULL) ? 2*theMultigrid->coarseNumber[i/2] + i%2 : i;
+    int band = 1;
+    for (i = 0; i < theCoarsest->size; i++)
+        for (int p = theSystem->rowStart[i]; p < theSystem->rowStart[i+1]; p++)
+            if (theSystem->A[p] != 0.0) band = fmax(band, abs(order[theSystem->col[p]] - order[i]) + 1);
+    theMultigrid->coarseOrder = order;
+    theMultigrid->coarse = femBandSystemCreate(theCoarsest->size, band);
+    for (i = 0; i < theCoarsest->size; i++)
+        for (int p = theSystem->rowStart[i]; p < theSystem->rowStart[i+1]; p++) {
+            int row = order[i], column = order[theSystem->col[p]];
+            if (column >= row && theSystem->A[p] != 0.0) theMultigrid->coarse->A[row][column] = theSystem->A[p]; }
+    femBandSystemFactor(theMultigrid->coarse);
+
+    int size = theMultigrid->levels[0].size;
+    theMultigrid->work = femMalloc(FEM_MEM_SOLVER, sizeof(double) * 4 * size);
+    theMultigrid->flops += 4.0 * theCoarsest->size * band + 2.0 * theMultigrid->levels[0].system->rowStart[size] + 12.0 * size;
+    femProfileCount(0, (double) theCoarsest->size * band * band);
+}
+
+// preconditioned conjugate gradients for A x = B from the given x, returns the number of iterations
+int femMultigridSolve(femMultigrid *theMultigrid, const double *B, double *x) {
+    if (theMultigrid->levels == NULL) Error("The multigrid solver is not set up");
+    femMultigridLevel *theFinest = &theMultigrid->levels[0];
+    femSparseSystem *theSystem = theFinest->system;
+    int i, size = theFinest->size, iter = 0;
+    double *r = theMultigrid->work, *z = r + size, *p = z + size, *q = p + size;
+
+    // the imposed values are set once, the identity rows keep them
+    double norm = 0.0, rz = 0.0;
+    for (i = 0; i < size; i++) {
+        if (theFinest->fixed[i]) x[i] = B[i];
+        norm += B[i] * B[i]; }
+    norm = (norm > 0.0) ? sqrt(norm) : 1.0;
+    femSparseSystemMultiply(theSystem, x, r);
+    double residual = 0.0;
+    for (i = 0; i < size; i++) {
+        r[i] = B[i] - r[i];
+        residual += r[i] * r[i]; }
+    residual = sqrt(residual);
+
+    int stop = FALSE;
+    while (!stop && residual > theMultigrid->tolerance * norm && iter < theMultigrid->maxIterations) {
+        memcpy(theFinest->b, r, sizeof(double) * size);
+        for (i = 0; i < size; i++) theFinest->x[i] = 0.0;
+        femMultigridCycle(theMultigrid, 0);
+        double rzNew = 0.0;
+        for (i = 0; i < size; i++) {
+            z[i] = theFinest->x[i];
+            rzNew += r[i] * z[i]; }
+        for (i = 0; i < size; i++) p[i] = (iter == 0) ? z[i] : z[i] + rzNew / rz * p[i];
+        rz = rzNew;
+        femSparseSystemMultiply(theSystem, p, q);
+        double pq = 0.0;
+        for (i = 0; i < size; i++) pq += p[i] * q[i];
+        double alpha = rz / pq;
+        residual = 0.0;
+        for (i = 0; i < size; i++) {
+            x[i] += alpha * p[i];
+            r[i] -= alpha * q[i];
+            residual += r[i] * r[i]; }
+        residual = sqrt(residual);
+        iter++;
+
+        // x^T A x = x^T (B - r), the correction alpha p has the energy alpha r^T z
+        if (theMultigrid->monitor != NULL) {
+            double energy = 0.0;
+            for (i = 0; i < size; i++) energy += x[i] * (B[i] - r[i]);
+            energy = (energy > 0.0) ? sqrt(alpha * rz / energy) : 0.0;
+            stop = femMonitorReport(theMultigrid->monitor, iter, residual / norm, energy, x); }}
+
+    if (stop)
+        printf("Solver  : quantities of interest stable after %d iterations at a relative residual %.2e\n",
+               iter, residual / norm);
+    else if (residual > theMultigrid->tolerance * norm)
+        printf("Solver  : the multigrid CG stopped after %d iterations at a relative residual %.2e\n",
+               iter, residual / norm);
+    theMultigrid->iterations = iter;
+    femProfileCount(0, iter * theMultigrid->flops);
+    return iter;
+}
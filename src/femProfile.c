@@ -0,0 +1,170 @@
+/*
+ *  femProfile.c
+ *  Phase level timers and counters for the solver pipeline
+ *
+ *  femProfileBegin/femProfileEnd bracket a phase. Bytes and flops reported with
+ *  femProfileCount go to the innermost phase open on the calling thread. An
+ *  End closes the innermost open phase of its kind : the phases still open
+ *  above it (an End was missed) are closed with it, with a warning, so that
+ *  the stack recovers and the next phases are not charged to them.
+ *  Everything is a no-op until femProfileEnable is called.
+ *
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "../headers/femProfile.h"
+
+#define MAXDEPTH 16
+
+typedef struct {
+    femPhase phase;
+    double start, duration;
+    unsigned long thread;
+} femTraceEvent;
+
+static const char *thePhaseNames[FEM_PHASE_COUNT] = {
+    "geoMeshImport", "geoMeshRead", "setup", "assembly", "neumann", "constraints",
+    "factorization", "solve", "forces", "stress", "modal", "output", "rendering" };
+
+static int theProfileEnabled = 0;
+static int theTraceEnabled = 0;
+static double theOrigin = 0.0;
+static femPhaseStats theStats[FEM_PHASE_COUNT];
+static femTraceEvent *theEvents = NULL;
+static int nEvents = 0, nEventsMax = 0;
+static pthread_mutex_t theProfileLock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread femPhase theStack[MAXDEPTH];
+static __thread double theStarts[MAXDEPTH];
+static __thread int theDepth = 0;
+static __thread int theOverflow = 0;                // phases begun beyond MAXDEPTH, not timed
+
+
+double femProfileTime(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+void femProfileReset(void) {
+    pthread_mutex_lock(&theProfileLock);
+    for (int i = 0; i < FEM_PHASE_COUNT; i++) {
+        theStats[i].calls = 0;
+        theStats[i].seconds = 0.0;
+        theStats[i].bytes = 0;
+        theStats[i].flops = 0.0; }
+    nEvents = 0;
+    theOrigin = femProfileTime();
+    pthread_mutex_unlock(&theProfileLock);
+}
+
+void femProfileEnable(int enabled, int trace) {
+    femProfileReset();
+    theProfileEnabled = enabled;
+    theTraceEnabled = enabled && trace;
+}
+
+int femProfileEnabled(void) {
+    return theProfileEnabled;
+}
+
+void femProfileBegin(femPhase phase) {
+    if (!theProfileEnabled) return;
+    if (theDepth == MAXDEPTH) { theOverflow++; return; }
+    theStack[theDepth] = phase;
+    theStarts[theDepth++] = femProfileTime();
+}
+
+// records the innermost open phase and pops it
+static void femProfileClose(double end) {
+    femPhase phase = theStack[--theDepth];
+    double start = theStarts[theDepth];
+    double duration = end - start;
+
+    pthread_mutex_lock(&theProfileLock);
+    theStats[phase].calls++;
+    theStats[phase].seconds += duration;
+    if (theTraceEnabled) {
+        if (nEvents == nEventsMax) {
+            nEventsMax = (nEventsMax == 0) ? 256 : 2*nEventsMax;
+            theEvents = realloc(theEvents, sizeof(femTraceEvent) * nEventsMax); }
+        theEvents[nEvents].phase = phase;
+        theEvents[nEvents].start = start - theOrigin;
+        theEvents[nEvents].duration = duration;
+        theEvents[nEvents].thread = (unsigned long) pthread_self();
+        nEvents++; }
+    pthread_mutex_unlock(&theProfileLock);
+}
+
+void femProfileEnd(femPhase phase) {
+    if (!theProfileEnabled) return;
+    if (theOverflow > 0) { theOverflow--; return; }
+    int level = theDepth - 1;
+    while (level >= 0 && theStack[level] != phase) level--;
+    if (level < 0) {
+        fprintf(stderr, "Profile : end of the phase %s, which is not open\n", thePhaseNames[phase]);
+        return; }
+    double end = femProfileTime();
+    while (theDepth - 1 > level) {
+        fprintf(stderr, "Profile : the phase %s was not ended, closed with %s\n",
+                thePhaseNames[theStack[theDepth-1]], thePhaseNames[phase]);
+        femProfileClose(end); }
+    femProfileClose(end);
+}
+
+void femProfileCount(size_t bytes, double flops) {
+    if (!theProfileEnabled || theDepth == 0) return;
+    femPhase phase = theStack[theDepth-1];
+    pthread_mutex_lock(&theProfileLock);
+    theStats[phase].bytes += bytes;
+    theStats[phase].flops += flops;
+    pthread_mutex_unlock(&theProfileLock);
+}
+
+const char *femProfileName(femPhase phase) {
+    return thePhaseNames[phase];
+}
+
+femPhaseStats femProfileStats(femPhase phase) {
+    pthread_mutex_lock(&theProfileLock);
+    femPhaseStats theStat = theStats[phase];
+    pthread_mutex_unlock(&theProfileLock);
+    return theStat;
+}
+
+void femProfileReport(FILE *file) {
+    if (!theProfileEnabled) return;
+    double total = 0.0;
+    fprintf(file, "\n ==== Profile ======================================================================= \n");
+    fprintf(file, "  %-16s %8s %14s %14s %14s %12s\n", "phase", "calls", "wall [ms]", "alloc [MB]", "flops [M]", "GFlop/s");
+    for (int i = 0; i < FEM_PHASE_COUNT; i++) {
+        femPhaseStats theStat = femProfileStats(i);
+        if (theStat.calls == 0) continue;
+        total += theStat.seconds;
+        fprintf(file, "  %-16s %8d %14.3f %14.3f %14.3f %12.3f\n", thePhaseNames[i], theStat.calls,
+                1e3 * theStat.seconds, theStat.bytes / 1048576.0, 1e-6 * theStat.flops,
+                (theStat.seconds > 0.0) ? 1e-9 * theStat.flops / theStat.seconds : 0.0); }
+    fprintf(file, "  %-16s %8s %14.3f   (phases may nest)\n", "total", "", 1e3 * total);
+    fprintf(file, " ==================================================================================== \n\n");
+}
+
+// chrome://tracing or perfetto "complete" events, times in microseconds
+void femProfileWriteTrace(const char *filename) {
+    if (!theTraceEnabled) return;
+    FILE *file = fopen(filename, "w");
+    if (!file) {
+        printf("Error! Unable to open file at %s\n", filename);
+        return; }
+    fprintf(file, "{\"traceEvents\":[\n");
+    pthread_mutex_lock(&theProfileLock);
+    for (int i = 0; i < nEvents; i++) {
+        femTraceEvent *theEvent = &theEvents[i];
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                thePhaseNames[theEvent->phase], theEvent->thread % 100000, 1e6 * theEvent->start,
+                1e6 * theEvent->duration, (i+1 < nEvents) ? "," : ""); }
+    pthread_mutex_unlock(&theProfileLock);
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+}
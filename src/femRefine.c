@@ -0,0 +1,218 @@
+/*
+ *  femRefine.c
+ *  Local refinement of triangle meshes by newest vertex bisection
+ *
+ *  The first node of each triangle is its newest vertex : the triangle is
+ *  split through the midpoint of the opposite edge, its refinement edge, and
+ *  the midpoint becomes the newest vertex of both children. On a fresh mesh
+ *  the nodes are rotated so that the refinement edge is the longest one.
+ *  A triangle can only be split along its refinement edge : the marked edges
+ *  are closed (any triangle with a marked edge gets its refinement edge
+ *  marked) until the refinement is conforming, then every triangle is bisected
+ *  once per marked edge. New nodes are appended after the existing ones, the
+ *  edges of the domains are split along with the triangles, and the midpoints
+ *  on curved boundaries stay on the chord.
+ *
+ *  The edges are numbered from the topology of the mesh : a side of a triangle
+ *  gets a new number unless the neighbour across it (elemElem) comes first,
+ *  and the edges of the domains find theirs through the triangle holding them
+ *  (edgeElem). The children keep the numbers of the coarse edges they lie on,
+ *  their other sides are new and never split in the same pass.
+ *
+ */
+
+#include "../headers/femRefine.h"
+#include "../headers/femTopology.h"
+
+typedef struct {
+    int a, b;                       // end nodes
+    int marked;
+    int mid;                        // -1 until the edge is split
+} femRefineEdge;
+
+
+// side j of a triangle, from node j to node j+1, that joins the nodes a and b, -1 for none
+static int femRefineSide(const int *t, int a, int b) {
+    for (int j = 0; j < 3; j++)
+        if ((t[j] == a && t[(j+1)%3] == b) || (t[j] == b && t[(j+1)%3] == a)) return j;
+    return -1;
+}
+
+// the longest edge becomes the refinement edge, the orientation is kept
+static void femRefineLongestEdge(femNodes *theNodes, int *elem, int nElem) {
+    for (int iElem = 0; iElem < nElem; iElem++) {
+        int *t = &elem[3*iElem], k = 0;
+        double longest = -1.0;
+        for (int j = 0; j < 3; j++) {
+            double dx = theNodes->X[t[(j+1)%3]] - theNodes->X[t[(j+2)%3]];
+            double dy = theNodes->Y[t[(j+1)%3]] - theNodes->Y[t[(j+2)%3]];
+            if (dx*dx + dy*dy > longest) { longest = dx*dx + dy*dy; k = j; }}
+        int n0 = t[k], n1 = t[(k+1)%3], n2 = t[(k+2)%3];
+        t[0] = n0; t[1] = n1; t[2] = n2; }
+}
+
+// bisects the marked triangles (marked[iElem] != 0) and as many neighbours as conformity needs
+femRefinement *geoMeshRefineGeo(femGeo *theGeometry, const int *marked) {
+    femArena *theArena = geoArena(theGeometry);
+    femNodes *theNodes = theGeometry->theNodes;
+    femMesh *theElements = theGeometry->theElements;
+    femMesh *theEdges = theGeometry->theEdges;
+    int nElem = theElements->nElem, nNodes = theNodes->nNodes;
+    int i,j,iElem,nMarked = 0;
+    if (theElements->nLocalNode != 3) Error("Only triangles can be refined by bisection");
+    if (theGeometry->nRefinements == 0) {
+        femRefineLongestEdge(theNodes, theElements->elem, nElem);
+        femMeshInvalidate(theElements); }
+
+    // the sides of the triangles numbered as edges, the first triangle around an edge numbers it
+    femTopology *theTopology = femMeshTopology(theElements, theEdges);
+    const int *coarse = theElements->elem;
+    int *edgeOf = femMalloc(FEM_MEM_MESH, sizeof(int) * 3 * nElem);
+    femRefineEdge *edges = femMalloc(FEM_MEM_MESH, sizeof(femRefineEdge) * (3 * nElem + 1));
+    int nEdgesCoarse = 0;
+    for (iElem = 0; iElem < nElem; iElem++) {
+        const int *t = &coarse[3*iElem];
+        for (j = 0; j < 3; j++) {
+            int a = t[j], b = t[(j+1)%3], other = theTopology->elemElem[3*iElem+j];
+            int side = (other == -1 || other > iElem) ? -1 : femRefineSide(&coarse[3*other], a, b);
+            if (side != -1) {
+                edgeOf[3*iElem+j] = edgeOf[3*other+side];
+                continue; }
+            femRefineEdge *theEdge = &edges[nEdgesCoarse];
+            theEdge->a = a;
+            theEdge->b = b;
+            theEdge->marked = FALSE;
+            theEdge->mid = -1;
+            edgeOf[3*iElem+j] = nEdgesCoarse++; }
+        if (!marked[iElem]) continue;
+        edges[edgeOf[3*iElem+1]].marked = TRUE;
+        nMarked++; }
+
+    // conformity closure
+    int changed = TRUE;
+    while (changed) {
+        changed = FALSE;
+        for (iElem = 0; iElem < nElem; iElem++) {
+            const int *side = &edgeOf[3*iElem];
+            if (edges[side[1]].marked) continue;
+            if (edges[side[0]].marked || edges[side[2]].marked) {
+                edges[side[1]].marked = TRUE;
+                changed = TRUE; }}}
+
+    int nSplit = 0, nRefined = 0, nElemFine = nElem;
+    for (i = 0; i < nEdgesCoarse; i++) nSplit += edges[i].marked;
+    for (iElem = 0; iElem < nElem; iElem++) {
+        int k = 0;
+        for (j = 0; j < 3; j++) k += edges[edgeOf[3*iElem+j]].marked;
+        nElemFine += k;
+        nRefined += (k > 0); }
+
+    // the edge under each edge of the domains, -1 when no triangle holds it
+    int *edgeOfDomain = femMalloc(FEM_MEM_MESH, sizeof(int) * (theEdges->nElem + 1));
+    int nEdgesFine = theEdges->nElem;
+    for (i = 0; i < theEdges->nElem; i++) {
+        int holder = theTopology->edgeElem[2*i];
+        edgeOfDomain[i] = -1;
+        if (holder == -1) continue;
+        edgeOfDomain[i] = edgeOf[3*holder + femRefineSide(&coarse[3*holder], theEdges->elem[2*i], theEdges->elem[2*i+1])];
+        nEdgesFine += edges[edgeOfDomain[i]].marked; }
+
+    femRefinement *theRefinement = femMalloc(FEM_MEM_MESH, sizeof(femRefinement));
+    theRefinement->nNodesCoarse = nNodes;
+    theRefinement->nNodes = nNodes + nSplit;
+    theRefinement->nElemCoarse = nElem;
+    theRefinement->nElem = nElemFine;
+    theRefinement->parents = femMalloc(FEM_MEM_MESH, sizeof(int) * (2 * nSplit + 1));
+
+    // the mesh data moves to larger arrays of the arena, the old ones go with the next reset
+    double *X = femArenaAlloc(theArena, sizeof(double) * (nNodes + nSplit));
+    double *Y = femArenaAlloc(theArena, sizeof(double) * (nNodes + nSplit));
+    memcpy(X, theNodes->X, sizeof(double) * nNodes);
+    memcpy(Y, theNodes->Y, sizeof(double) * nNodes);
+    int *elem = femArenaAlloc(theArena, sizeof(int) * 3 * nElemFine);
+    memcpy(elem, coarse, sizeof(int) * 3 * nElem);
+    int *sides = femMalloc(FEM_MEM_MESH, sizeof(int) * 3 * nElemFine);
+    memcpy(sides, edgeOf, sizeof(int) * 3 * nElem);
+
+    // a triangle and then its first child are bisected while their refinement edge is marked,
+    // the second children are appended and visited later; the sides not on a coarse edge are -1
+    int nNew = nNodes;
+    for (iElem = 0; iElem < nElem; iElem++) {
+        int *t = &elem[3*iElem], *side = &sides[3*iElem];
+        while (side[1] != -1 && edges[side[1]].marked) {
+            femRefineEdge *theEdge = &edges[side[1]];
+            if (theEdge->mid == -1) {
+                theEdge->mid = nNew;
+                X[nNew] = 0.5 * (X[theEdge->a] + X[theEdge->b]);
+                Y[nNew] = 0.5 * (Y[theEdge->a] + Y[theEdge->b]);
+                theRefinement->parents[2*(nNew-nNodes)]   = theEdge->a;
+                theRefinement->parents[2*(nNew-nNodes)+1] = theEdge->b;
+                nNew++; }
+            int m = theEdge->mid, v0 = t[0], v1 = t[1], v2 = t[2];
+            int *child = &elem[3*nElem], *childSide = &sides[3*nElem];
+            nElem++;
+            child[0] = m; child[1] = v2; child[2] = v0;
+            childSide[0] = -1; childSide[1] = side[2]; childSide[2] = -1;
+            t[0] = m; t[1] = v0; t[2] = v1;
+            side[1] = side[0]; side[0] = side[2] = -1; }}
+    femFree(sides);
+
+    // the edges of the domains are split in place, the second half right after the first one
+    int *domainEdges = femArenaAlloc(theArena, sizeof(int) * 2 * nEdgesFine);
+    int *split = femMalloc(FEM_MEM_MESH, sizeof(int) * (theEdges->nElem + 1));
+    memcpy(domainEdges, theEdges->elem, sizeof(int) * 2 * theEdges->nElem);
+    int nEdges = theEdges->nElem;
+    for (i = 0; i < theEdges->nElem; i++) {
+        split[i] = -1;
+        if (edgeOfDomain[i] == -1 || !edges[edgeOfDomain[i]].marked) continue;
+        int mid = edges[edgeOfDomain[i]].mid;
+        split[i] = nEdges;
+        domainEdges[2*nEdges]   = mid;
+        domainEdges[2*nEdges+1] = domainEdges[2*i+1];
+        domainEdges[2*i+1] = mid;
+        nEdges++; }
+    for (int iDomain = 0; iDomain < theGeometry->nDomains; iDomain++) {
+        femDomain *theDomain = theGeometry->theDomains[iDomain];
+        int n = 0;
+        for (i = 0; i < theDomain->nElem; i++) n += 1 + (split[theDomain->elem[i]] != -1);
+        int *domainElem = femArenaAlloc(theArena, sizeof(int) * n);
+        n = 0;
+        for (i = 0; i < theDomain->nElem; i++) {
+            domainElem[n++] = theDomain->elem[i];
+            if (split[theDomain->elem[i]] != -1) domainElem[n++] = split[theDomain->elem[i]]; }
+        theDomain->elem = domainElem;
+        theDomain->nElem = n; }
+    femFree(split);
+    femFree(edgeOfDomain);
+    femFree(edgeOf);
+    femFree(edges);
+
+    femMeshInvalidate(theElements);
+    femMeshInvalidate(theEdges);
+    theNodes->X = X;
+    theNodes->Y = Y;
+    theNodes->nNodes = nNew;
+    theElements->elem = elem;
+    theElements->nElem = nElem;
+    theEdges->elem = domainEdges;
+    theEdges->nElem = nEdges;
+    theGeometry->nRefinements++;
+    printf("Geo     : %d triangles bisected (%d marked) : %d nodes, %d triangles \n",
+           nRefined, nMarked, nNew, nElem);
+    return theRefinement;
+}
+
+// linear interpolation of nodal fields (nFields values per node) on the refined mesh
+void femRefinementProlongate(femRefinement *theRefinement, int nFields, const double *coarse, double *fine) {
+    int nCoarse = theRefinement->nNodesCoarse;
+    memcpy(fine, coarse, sizeof(double) * nFields * nCoarse);
+    for (int i = nCoarse; i < theRefinement->nNodes; i++) {
+        int a = theRefinement->parents[2*(i-nCoarse)], b = theRefinement->parents[2*(i-nCoarse)+1];
+        for (int k = 0; k < nFields; k++)
+            fine[nFields*i+k] = 0.5 * (fine[nFields*a+k] + fine[nFields*b+k]); }
+}
+
+void femRefinementFree(femRefinement *theRefinement) {
+    femFree(theRefinement->parents);
+    femFree(theRefinement);
+}
@@ -0,0 +1,208 @@
+/*
+ *  femRunner.c
+ *  Parallel scenario runner : many independent elasticity problems on one mesh
+ *
+ *  Each scenario builds its own femProblem on a shared read-only femGeo.
+ *  Scenarios are dealt round-robin to per-worker queues; an idle worker
+ *  steals from the front of the other queues. A memory budget caps the
+ *  sum of the systems being solved at the same time.
+ *
+ *  The shared geometry is only read by the workers. Its one lazy cache, the
+ *  topology of the mesh that the sparse systems need, is built under the lock
+ *  of femMeshTopology; any other cache hung on a shared geometry must either
+ *  be built the same way or be warmed before femRunnerRun starts the workers.
+ *
+ */
+
+#include "../headers/femRunner.h"
+
+
+void femScenarioInit(femScenario *theScenario, femGeo *theGeometry,
+                     double E, double nu, double rho, double g, femElasticCase iCase) {
+    theScenario->name[0] = '\0';
+    theScenario->geometry = theGeometry;
+    theScenario->E   = E;
+    theScenario->nu  = nu;
+    theScenario->rho = rho;
+    theScenario->g   = g;
+    theScenario->iCase = iCase;
+    theScenario->solverType = FEM_FULL;
+    theScenario->renumType = FEM_NO;
+    theScenario->nConditions = 0;
+    theScenario->status = 0;
+    theScenario->soluce = NULL;
+    theScenario->uMax = 0.0;
+}
+
+void femScenarioSetSolver(femScenario *theScenario, femSolverType solverType, femRenumType renumType) {
+    theScenario->solverType = solverType;
+    theScenario->renumType = renumType;
+}
+
+void femScenarioAddCondition(femScenario *theScenario, char *nameDomain, femBoundaryType type, double value) {
+    if (theScenario->nConditions >= MAXSCENARIOBC)
+        Error("Too many boundary conditions for a scenario");
+    femScenarioCondition *theCondition = &theScenario->conditions[theScenario->nConditions++];
+    snprintf(theCondition->domain, MAXNAME, "%s", nameDomain);
+    theCondition->type = type;
+    theCondition->value = value;
+}
+
+// bytes needed while the scenario is being solved, the system of its solver dominates
+// (the band is that of the renumbering femElasticityCreateSolver will make)
+size_t femScenarioMemory(femScenario *theScenario) {
+    femMesh *theMesh = theScenario->geometry->theElements;
+    int nNodes = theScenario->geometry->theNodes->nNodes, size = 2 * nNodes, band = 0;
+    if (theScenario->solverType == FEM_BAND) {
+        int *number = femMalloc(FEM_MEM_SOLVER, sizeof(int) * nNodes);
+        band = 2 * (femMeshRenumber(theMesh, theScenario->renumType, number) + 1);
+        femFree(number); }
+    return femSystemMemory(theScenario->solverType, size, band)
+         + (5*sizeof(double) + 2*sizeof(int)) * (size_t) size;  // soluce, residuals, lift, loads, constraints, numbering and the copy
+}
+
+void femScenarioSolve(femScenario *theScenario) {
+    femProblem *theProblem = femElasticityCreateSolver(theScenario->geometry,
+                theScenario->E, theScenario->nu, theScenario->rho, theScenario->g, theScenario->iCase,
+                theScenario->solverType, theScenario->renumType);
+    for (int i = 0; i < theScenario->nConditions; i++) {
+        femScenarioCondition *theCondition = &theScenario->conditions[i];
+        femElasticityAddBoundaryCondition(theProblem, theCondition->domain, theCondition->type, theCondition->value);
+    }
+
+    double *theSoluce = femElasticitySolve(theProblem);
+    int nNodes = theScenario->geometry->theNodes->nNodes;
+    theScenario->soluce = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nNodes);
+    memcpy(theScenario->soluce, theSoluce, sizeof(double) * 2 * nNodes);
+
+    double uMax = 0.0;
+    for (int i = 0; i < nNodes; i++) {
+        double u = sqrt(theSoluce[2*i]*theSoluce[2*i] + theSoluce[2*i+1]*theSoluce[2*i+1]);
+        uMax = fmax(uMax, u); }
+    theScenario->uMax = uMax;
+    theScenario->status = 1;
+
+    femElasticityFree(theProblem);
+}
+
+void femScenarioFree(femScenario *theScenario) {
+    femFree(theScenario->soluce);
+    theScenario->soluce = NULL;
+}
+
+
+/*
+*
+* WORK STEALING POOL
+*
+*/
+
+typedef struct {
+    femRunner *theRunner;
+    int id;
+} femRunnerWorker;
+
+// the owner takes from the back of its own queue...
+static int femRunnerPop(femRunnerQueue *theQueue) {
+    int task = -1;
+    pthread_mutex_lock(&theQueue->lock);
+    if (theQueue->tail > theQueue->head)
+        task = theQueue->tasks[--theQueue->tail];
+    pthread_mutex_unlock(&theQueue->lock);
+    return task;
+}
+
+// ...while thieves take from the front
+static int femRunnerSteal(femRunnerQueue *theQueue) {
+    int task = -1;
+    pthread_mutex_lock(&theQueue->lock);
+    if (theQueue->tail > theQueue->head)
+        task = theQueue->tasks[theQueue->head++];
+    pthread_mutex_unlock(&theQueue->lock);
+    return task;
+}
+
+static int femRunnerNext(femRunner *theRunner, int id) {
+    int task = femRunnerPop(&theRunner->queues[id]);
+    for (int i = 1; task == -1 && i < theRunner->nWorkers; i++)
+        task = femRunnerSteal(&theRunner->queues[(id+i) % theRunner->nWorkers]);
+    return task;
+}
+
+static void femRunnerReserve(femRunner *theRunner, size_t bytes) {
+    pthread_mutex_lock(&theRunner->memoryLock);
+    while (theRunner->used > 0 && theRunner->used + bytes > theRunner->budget)
+        pthread_cond_wait(&theRunner->memoryFreed, &theRunner->memoryLock);
+    theRunner->used += bytes;
+    pthread_mutex_unlock(&theRunner->memoryLock);
+}
+
+static void femRunnerRelease(femRunner *theRunner, size_t bytes) {
+    pthread_mutex_lock(&theRunner->memoryLock);
+    theRunner->used -= bytes;
+    pthread_cond_broadcast(&theRunner->memoryFreed);
+    pthread_mutex_unlock(&theRunner->memoryLock);
+}
+
+static void *femRunnerWork(void *data) {
+    femRunnerWorker *theWorker = data;
+    femRunner *theRunner = theWorker->theRunner;
+    int task;
+    while ((task = femRunnerNext(theRunner, theWorker->id)) != -1) {
+        femScenario *theScenario = &theRunner->scenarios[task];
+        size_t bytes = femScenarioMemory(theScenario);
+        if (bytes > theRunner->budget) {
+            theScenario->status = -1;
+            continue; }
+        femRunnerReserve(theRunner, bytes);
+        femScenarioSolve(theScenario);
+        femRunnerRelease(theRunner, bytes);
+    }
+    return NULL;
+}
+
+// solve all scenarios with nWorkers threads, never holding more than budget bytes of systems at once
+void femRunnerRun(femScenario *theScenarios, int nScenarios, int nWorkers, size_t budget) {
+    if (nWorkers < 1) nWorkers = 1;
+    femRunner theRunner;
+    theRunner.scenarios = theScenarios;
+    theRunner.nWorkers = nWorkers;
+    theRunner.budget = budget;
+    theRunner.used = 0;
+    pthread_mutex_init(&theRunner.memoryLock, NULL);
+    pthread_cond_init(&theRunner.memoryFreed, NULL);
+
+    theRunner.queues = malloc(sizeof(femRunnerQueue) * nWorkers);
+    for (int i = 0; i < nWorkers; i++) {
+        femRunnerQueue *theQueue = &theRunner.queues[i];
+        pthread_mutex_init(&theQueue->lock, NULL);
+        theQueue->tasks = malloc(sizeof(int) * (nScenarios/nWorkers + 1));
+        theQueue->head = 0;
+        theQueue->tail = 0; }
+    for (int i = 0; i < nScenarios; i++) {
+        femRunnerQueue *theQueue = &theRunner.queues[i % nWorkers];
+        theQueue->tasks[theQueue->tail++] = i; }
+
+    pthread_t *threads = malloc(sizeof(pthread_t) * nWorkers);
+    femRunnerWorker *workers = malloc(sizeof(femRunnerWorker) * nWorkers);
+    for (int i = 0; i < nWorkers; i++) {
+        workers[i].theRunner = &theRunner;
+        workers[i].id = i;
+        if (pthread_create(&threads[i], NULL, femRunnerWork, &workers[i]) != 0)
+            Error("Cannot create a worker thread"); }
+    for (int i = 0; i < nWorkers; i++)
+        pthread_join(threads[i], NULL);
+
+    for (int i = 0; i < nScenarios; i++)
+        if (theScenarios[i].status == -1) {
+            printf("Runner  : scenario %d (%s) skipped, it does not fit in the memory budget\n", i, theScenarios[i].name); }
+
+    for (int i = 0; i < nWorkers; i++) {
+        pthread_mutex_destroy(&theRunner.queues[i].lock);
+        free(theRunner.queues[i].tasks); }
+    free(theRunner.queues);
+    free(threads);
+    free(workers);
+    pthread_mutex_destroy(&theRunner.memoryLock);
+    pthread_cond_destroy(&theRunner.memoryFreed);
+}
@@ -0,0 +1,216 @@
+/*
+ *  femStress.c
+ *  Strains, stresses, von Mises and principal stresses recovered from the displacements
+ *
+ *  The strains are constant on a linear triangle : they are evaluated at the
+ *  center of each element with the gradients of the stiffness matrix (those of
+ *  any integration point on a triangle, kept by femFactors), and the
+ *  stresses follow from the coefficients A, B, C of the problem. The elements
+ *  are split in contiguous ranges, one per thread; the nodes are then split
+ *  the same way, and each thread gathers the elements around its nodes from
+ *  the topology of the mesh (nodeElem) for the averages weighted by the
+ *  areas, so that no partial sums have to be reduced. All fields are separate
+ *  arrays, kept from one update to the next.
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include "../headers/femStress.h"
+#include "../headers/femTopology.h"
+
+typedef struct {
+    femStress *theStress;
+    femTopology *theTopology;
+    int phase;
+    int first, last;
+    int nodeFirst, nodeLast;
+} femStressWorker;
+
+
+static double femStressVonMises(femProblem *theProblem, double sxx, double syy, double sxy) {
+    double szz = (theProblem->planarStrainStress == PLANAR_STRESS) ? 0.0 : theProblem->nu * (sxx + syy);
+    return sqrt(0.5 * ((sxx-syy)*(sxx-syy) + (syy-szz)*(syy-szz) + (szz-sxx)*(szz-sxx)) + 3.0*sxy*sxy);
+}
+
+static void femStressPrincipal(double sxx, double syy, double sxy, double *s1, double *s2) {
+    double center = 0.5 * (sxx + syy);
+    double radius = sqrt(0.25 * (sxx-syy)*(sxx-syy) + sxy*sxy);
+    *s1 = center + radius;
+    *s2 = center - radius;
+}
+
+// area weighted averages of the element stresses around the nodes of the range
+static void femStressAverage(femStressWorker *theWorker) {
+    femStress *theStress = theWorker->theStress;
+    femProblem *theProblem = theStress->problem;
+    const femTopology *theTopology = theWorker->theTopology;
+    for (int i = theWorker->nodeFirst; i < theWorker->nodeLast; i++) {
+        double sxx = 0.0, syy = 0.0, sxy = 0.0, weight = 0.0;
+        for (int k = theTopology->nodeStart[i]; k < theTopology->nodeStart[i+1]; k++) {
+            int iElem = theTopology->nodeElem[k];
+            double area = theStress->area[iElem];
+            sxx += area * theStress->sxx[iElem];
+            syy += area * theStress->syy[iElem];
+            sxy += area * theStress->sxy[iElem];
+            weight += area; }
+        if (weight == 0.0) weight = 1.0;
+        sxx /= weight; syy /= weight; sxy /= weight;
+        theStress->nodeSxx[i] = sxx;
+        theStress->nodeSyy[i] = syy;
+        theStress->nodeSxy[i] = sxy;
+        theStress->nodeVonMises[i] = femStressVonMises(theProblem,sxx,syy,sxy);
+        femStressPrincipal(sxx,syy,sxy,&theStress->nodeS1[i],&theStress->nodeS2[i]); }
+}
+
+static void *femStressWork(void *data) {
+    femStressWorker *theWorker = data;
+    if (theWorker->phase == 1) {
+        femStressAverage(theWorker);
+        return NULL; }
+    femStress *theStress = theWorker->theStress;
+    femProblem *theProblem = theStress->problem;
+    femDiscrete *theSpace = theProblem->space;
+    double *U = theProblem->soluce;
+    double a = theProblem->A, b = theProblem->B, c = theProblem->C;
+    femMesh *theMesh = theProblem->geometry->theElements;
+    double dphidx[4],dphidy[4];
+    int i,map[4];
+
+    // center and area of the reference element
+    double xsi = 1.0/3.0, eta = 1.0/3.0, reference = 0.5;
+    if (theSpace->type == FEM_QUAD) { xsi = 0.0; eta = 0.0; reference = 4.0; }
+
+    for (int iElem = theWorker->first; iElem < theWorker->last; iElem++) {
+        double jac;
+        if (theSpace->type == FEM_TRIANGLE) {
+            jac = femElasticityElementFactors(theProblem,iElem,0,dphidx,dphidy);
+            for (i = 0; i < theSpace->n; i++) map[i] = theMesh->elem[iElem*theMesh->nLocalNode+i]; }
+        else
+            jac = femElasticityElementGradients(theProblem,iElem,xsi,eta,dphidx,dphidy,map);
+        double dudx = 0.0, dudy = 0.0, dvdx = 0.0, dvdy = 0.0;
+        for (i = 0; i < theSpace->n; i++) {
+            dudx += U[2*map[i]]   * dphidx[i];
+            dudy += U[2*map[i]]   * dphidy[i];
+            dvdx += U[2*map[i]+1] * dphidx[i];
+            dvdy += U[2*map[i]+1] * dphidy[i]; }
+        double exx = dudx, eyy = dvdy, exy = 0.5 * (dudy + dvdx);
+        double sxx = a * exx + b * eyy;
+        double syy = b * exx + a * eyy;
+        double sxy = 2.0 * c * exy;
+        double area = jac * reference;
+
+        theStress->exx[iElem] = exx;
+        theStress->eyy[iElem] = eyy;
+        theStress->exy[iElem] = exy;
+        theStress->sxx[iElem] = sxx;
+        theStress->syy[iElem] = syy;
+        theStress->sxy[iElem] = sxy;
+        theStress->area[iElem] = area;
+        theStress->vonMises[iElem] = femStressVonMises(theProblem,sxx,syy,sxy);
+        femStressPrincipal(sxx,syy,sxy,&theStress->s1[iElem],&theStress->s2[iElem]); }
+    return NULL;
+}
+
+// nThreads <= 0 takes the number of online processors
+femStress *femStressCreate(femProblem *theProblem, int nThreads) {
+    femStress *theStress = femMalloc(FEM_MEM_POST, sizeof(femStress));
+    int nElem = theProblem->geometry->theElements->nElem;
+    int nNodes = theProblem->geometry->theNodes->nNodes;
+    if (nThreads <= 0) nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > nElem / 1024 + 1) nThreads = nElem / 1024 + 1;
+    if (nThreads < 1) nThreads = 1;
+    theStress->problem = theProblem;
+    theStress->nElem = nElem;
+    theStress->nNodes = nNodes;
+    theStress->nThreads = nThreads;
+
+    theStress->exx      = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->eyy      = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->exy      = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->sxx      = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->syy      = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->sxy      = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->vonMises = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->s1       = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->s2       = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->area     = femMalloc(FEM_MEM_POST, sizeof(double) * nElem);
+    theStress->nodeSxx      = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    theStress->nodeSyy      = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    theStress->nodeSxy      = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    theStress->nodeVonMises = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    theStress->nodeS1       = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    theStress->nodeS2       = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+
+    femStressUpdate(theStress);
+    return theStress;
+}
+
+void femStressFree(femStress *theStress) {
+    femFree(theStress->exx); femFree(theStress->eyy); femFree(theStress->exy);
+    femFree(theStress->sxx); femFree(theStress->syy); femFree(theStress->sxy);
+    femFree(theStress->vonMises); femFree(theStress->s1); femFree(theStress->s2);
+    femFree(theStress->area);
+    femFree(theStress->nodeSxx); femFree(theStress->nodeSyy); femFree(theStress->nodeSxy);
+    femFree(theStress->nodeVonMises); femFree(theStress->nodeS1); femFree(theStress->nodeS2);
+    femFree(theStress);
+}
+
+// recomputes every field from the current theProblem->soluce
+void femStressUpdate(femStress *theStress) {
+    femProblem *theProblem = theStress->problem;
+    int nThreads = theStress->nThreads;
+    int nNodes = theStress->nNodes;
+    int nElem = theStress->nElem;
+    int t,phase;
+    femProfileBegin(FEM_PHASE_STRESS);
+    femElasticityFactors(theProblem);
+    femTopology *theTopology = femMeshTopology(theProblem->geometry->theElements, NULL);
+
+    // the fields of the elements, then the invariants of the averaged stresses at the nodes
+    femStressWorker workers[nThreads];
+    pthread_t threads[nThreads];
+    for (t = 0; t < nThreads; t++) {
+        workers[t].theStress = theStress;
+        workers[t].theTopology = theTopology;
+        workers[t].first = (int) ((long) nElem * t / nThreads);
+        workers[t].last  = (int) ((long) nElem * (t+1) / nThreads);
+        workers[t].nodeFirst = (int) ((long) nNodes * t / nThreads);
+        workers[t].nodeLast  = (int) ((long) nNodes * (t+1) / nThreads); }
+    for (phase = 0; phase < 2; phase++) {
+        for (t = 0; t < nThreads; t++) workers[t].phase = phase;
+        for (t = 1; t < nThreads; t++)
+            if (pthread_create(&threads[t], NULL, femStressWork, &workers[t]) != 0)
+                Error("Cannot create a stress thread");
+        femStressWork(&workers[0]);
+        for (t = 1; t < nThreads; t++)
+            pthread_join(threads[t], NULL); }
+
+    femProfileCount(0, (double) nElem * (theProblem->space->n * 30.0 + 60.0) + 40.0 * nNodes);
+    femProfileEnd(FEM_PHASE_STRESS);
+}
+
+// maximum of the element values (the nodal averages smooth the peaks out)
+double femStressMaxVonMises(femStress *theStress) {
+    return femMax(theStress->vonMises, theStress->nElem);
+}
+
+// nodal sxx, syy, sxy, von Mises, s1, s2, six values per node
+void femStressNodal(femStress *theStress, double *data) {
+    for (int i = 0; i < theStress->nNodes; i++) {
+        data[6*i]   = theStress->nodeSxx[i];
+        data[6*i+1] = theStress->nodeSyy[i];
+        data[6*i+2] = theStress->nodeSxy[i];
+        data[6*i+3] = theStress->nodeVonMises[i];
+        data[6*i+4] = theStress->nodeS1[i];
+        data[6*i+5] = theStress->nodeS2[i]; }
+}
+
+// the nodal fields of femStressNodal in the format of femSolutionWrite
+void femStressWrite(femStress *theStress, const char *filename) {
+    int nNodes = theStress->nNodes;
+    double *data = femMalloc(FEM_MEM_POST, sizeof(double) * 6 * nNodes);
+    femStressNodal(theStress, data);
+    femSolutionWrite(nNodes, 6, data, filename);
+    femFree(data);
+}
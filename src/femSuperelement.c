@@ -0,0 +1,125 @@
+/*
+ *  femSuperelement.c
+ *  Static condensation of a problem onto the dofs of selected domains
+ *
+ *  The retained dofs are the free dofs of the nodes of the selected domains.
+ *  Their flexibility F (the block of the inverse stiffness) is obtained with
+ *  the factorization of the problem, one substitution per retained dof done in
+ *  blocks. A load applied on those dofs is then answered by a dense product
+ *  u = u0 + F f on the retained dofs, and the whole field is recovered with a
+ *  single substitution when it is needed. The Schur complement S = F^-1 is the
+ *  stiffness of the superelement.
+ *
+ */
+
+#include "../headers/femSuperelement.h"
+
+#define FEM_SUPER_BLOCK 32
+
+
+femSuperelement *femSuperelementCreate(femProblem *theProblem, int nDomains, char **nameDomains) {
+    femGeo *theGeometry = theProblem->geometry;
+    femSuperelement *theSuper = femMalloc(FEM_MEM_POST, sizeof(femSuperelement));
+    int size = 2*theGeometry->theNodes->nNodes;
+    int i,j,r;
+    theSuper->problem = theProblem;
+    theSuper->size = size;
+    theSuper->work = femMalloc(FEM_MEM_POST, sizeof(double) * size);
+
+    // retained dofs : both directions of every node of the domains, unless imposed
+    int *marked = femMalloc(FEM_MEM_POST, sizeof(int) * size);
+    for (i = 0; i < size; i++) marked[i] = FALSE;
+    for (int iName = 0; iName < nDomains; iName++) {
+        int iDomain = geoGetDomainGeo(theGeometry, nameDomains[iName]);
+        if (iDomain == -1) Error("Undefined domain :-(");
+        femDomain *theDomain = theGeometry->theDomains[iDomain];
+        for (int e = 0; e < theDomain->nElem; e++)
+            for (j = 0; j < 2; j++) {
+                int node = theDomain->mesh->elem[2*theDomain->elem[e]+j];
+                marked[2*node] = marked[2*node+1] = TRUE; }}
+    theSuper->nDofs = 0;
+    theSuper->dofs = femMalloc(FEM_MEM_POST, sizeof(int) * size);
+    for (i = 0; i < size; i++)
+        if (marked[i] && theProblem->constrainedNodes[i] == -1)
+            theSuper->dofs[theSuper->nDofs++] = i;
+    femFree(marked);
+    int nDofs = theSuper->nDofs;
+
+    double *theSoluce = femElasticitySolveFactorized(theProblem);
+    theSuper->base = femMalloc(FEM_MEM_POST, sizeof(double) * size);
+    memcpy(theSuper->base, theSoluce, sizeof(double) * size);
+
+    // columns of the flexibility : unit forces on the retained dofs, FEM_SUPER_BLOCK at a time
+    theSuper->flexibility = femMalloc(FEM_MEM_POST, sizeof(double) * nDofs * nDofs);
+    double *loads   = femMalloc(FEM_MEM_POST, sizeof(double) * size * FEM_SUPER_BLOCK);
+    double *soluces = femMalloc(FEM_MEM_POST, sizeof(double) * size * FEM_SUPER_BLOCK);
+    for (int j0 = 0; j0 < nDofs; j0 += FEM_SUPER_BLOCK) {
+        int nRhs = (nDofs - j0 < FEM_SUPER_BLOCK) ? nDofs - j0 : FEM_SUPER_BLOCK;
+        for (i = 0; i < size * nRhs; i++) loads[i] = 0.0;
+        for (r = 0; r < nRhs; r++) loads[r*size + theSuper->dofs[j0+r]] = 1.0;
+        femElasticitySolveIncrements(theProblem, nRhs, loads, soluces);
+        for (r = 0; r < nRhs; r++)
+            for (i = 0; i < nDofs; i++)
+                theSuper->flexibility[i*nDofs + j0+r] = soluces[r*size + theSuper->dofs[i]]; }
+    femFree(loads);
+    femFree(soluces);
+
+    printf("Super   : %d dofs retained on %d domain(s), %d substitutions\n", nDofs, nDomains, nDofs);
+    return theSuper;
+}
+
+void femSuperelementFree(femSuperelement *theSuper) {
+    femFree(theSuper->flexibility);
+    femFree(theSuper->base);
+    femFree(theSuper->dofs);
+    femFree(theSuper->work);
+    femFree(theSuper);
+}
+
+// adds the nodal forces of a uniform traction on a domain to loads (nDofs values), the part
+// falling on dofs that are not retained is not seen by the superelement
+void femSuperelementTraction(femSuperelement *theSuper, char *nameDomain, femBoundaryType type, double value, double *loads) {
+    femGeo *theGeometry = theSuper->problem->geometry;
+    int iDomain = geoGetDomainGeo(theGeometry, nameDomain);
+    if (iDomain == -1) Error("Undefined domain :-(");
+    double *work = theSuper->work;
+    for (int i = 0; i < theSuper->size; i++) work[i] = 0.0;
+    femElasticityTractionLoads(theSuper->problem, theGeometry->theDomains[iDomain], type, value, work);
+    for (int i = 0; i < theSuper->nDofs; i++)
+        loads[i] += work[theSuper->dofs[i]];
+}
+
+// displacements of the retained dofs for extra forces loads on them : a dense product
+void femSuperelementSolve(femSuperelement *theSuper, const double *loads, double *displacements) {
+    int nDofs = theSuper->nDofs;
+    for (int i = 0; i < nDofs; i++) {
+        const double *row = &theSuper->flexibility[i*nDofs];
+        double u = theSuper->base[theSuper->dofs[i]];
+        for (int j = 0; j < nDofs; j++)
+            u += row[j] * loads[j];
+        displacements[i] = u; }
+}
+
+// whole displacement field (natural ordering) for extra forces on the retained dofs
+void femSuperelementRecover(femSuperelement *theSuper, const double *loads, double *soluce) {
+    double *work = theSuper->work;
+    for (int i = 0; i < theSuper->size; i++) work[i] = 0.0;
+    for (int i = 0; i < theSuper->nDofs; i++) work[theSuper->dofs[i]] = loads[i];
+    femElasticitySolveIncrements(theSuper->problem, 1, work, soluce);
+    for (int i = 0; i < theSuper->size; i++) soluce[i] += theSuper->base[i];
+}
+
+// condensed stiffness (Schur complement) of the retained dofs, nDofs x nDofs row by row
+void femSuperelementStiffness(femSuperelement *theSuper, double *stiffness) {
+    int nDofs = theSuper->nDofs;
+    femFullSystem *theSystem = femFullSystemCreate(nDofs);
+    for (int i = 0; i < nDofs; i++)
+        for (int j = 0; j < nDofs; j++)
+            theSystem->A[i][j] = theSuper->flexibility[i*nDofs+j];
+    femFullSystemFactor(theSystem);
+    for (int j = 0; j < nDofs; j++) {
+        for (int i = 0; i < nDofs; i++) theSystem->B[i] = (i == j) ? 1.0 : 0.0;
+        femFullSystemSolve(theSystem);
+        for (int i = 0; i < nDofs; i++) stiffness[i*nDofs+j] = theSystem->B[i]; }
+    femFullSystemFree(theSystem);
+}
@@ -0,0 +1,104 @@
+/*
+ *  femSweep.c
+ *  Linear superposition of unit load cases for load and stiffness sweeps
+ *
+ *  The displacements are linear in the Neumann values and in rho*g, and scale
+ *  as 1/E at fixed nu, while the part due to imposed displacements does not
+ *  depend on E. With one factorization we solve a unit case for each Neumann
+ *  condition, one for gravity and one for the Dirichlet values alone; any
+ *  combination of loads and E is then a handful of vector additions.
+ *
+ */
+
+#include "../headers/femSweep.h"
+
+
+// solves the problem with the current values and returns a copy of the displacements
+static double *femSweepSolve(femSweep *theSweep) {
+    double *theSoluce = femElasticitySolveFactorized(theSweep->problem);
+    double *theCopy = femMalloc(FEM_MEM_POST, sizeof(double) * theSweep->size);
+    memcpy(theCopy, theSoluce, sizeof(double) * theSweep->size);
+    return theCopy;
+}
+
+femSweep *femSweepCreate(femProblem *theProblem) {
+    femSweep *theSweep = femMalloc(FEM_MEM_POST, sizeof(femSweep));
+    theSweep->problem = theProblem;
+    theSweep->E = theProblem->E;
+    theSweep->size = 2*theProblem->geometry->theNodes->nNodes;
+    int size = theSweep->size;
+
+    theSweep->nLoads = 0;
+    theSweep->conditions = femMalloc(FEM_MEM_POST, sizeof(int) * (theProblem->nBoundaryConditions + 1));
+    for (int i = 0; i < theProblem->nBoundaryConditions; i++) {
+        femBoundaryType type = theProblem->conditions[i]->type;
+        if (type == NEUMANN_X || type == NEUMANN_Y)
+            theSweep->conditions[theSweep->nLoads++] = i; }
+
+    // the loads of the problem are switched off, then on one at a time
+    double *values = femMalloc(FEM_MEM_POST, sizeof(double) * (theSweep->nLoads + 1));
+    double rho = theProblem->rho, g = theProblem->g;
+    double *soluce = femMalloc(FEM_MEM_POST, sizeof(double) * size);
+    memcpy(soluce, theProblem->soluce, sizeof(double) * size);
+    for (int i = 0; i < theSweep->nLoads; i++) {
+        values[i] = theProblem->conditions[theSweep->conditions[i]]->value;
+        theProblem->conditions[theSweep->conditions[i]]->value = 0.0; }
+    theProblem->rho = 0.0;
+    theSweep->dirichlet = femSweepSolve(theSweep);
+
+    theProblem->rho = 1.0;
+    theProblem->g = 1.0;
+    theSweep->gravity = femSweepSolve(theSweep);
+    for (int j = 0; j < size; j++) theSweep->gravity[j] -= theSweep->dirichlet[j];
+    theProblem->rho = 0.0;
+
+    theSweep->unit = femMalloc(FEM_MEM_POST, sizeof(double*) * (theSweep->nLoads + 1));
+    for (int i = 0; i < theSweep->nLoads; i++) {
+        femBoundaryCondition *theCondition = theProblem->conditions[theSweep->conditions[i]];
+        theCondition->value = 1.0;
+        theSweep->unit[i] = femSweepSolve(theSweep);
+        for (int j = 0; j < size; j++) theSweep->unit[i][j] -= theSweep->dirichlet[j];
+        theCondition->value = 0.0; }
+
+    // the problem is given back as it was
+    for (int i = 0; i < theSweep->nLoads; i++)
+        theProblem->conditions[theSweep->conditions[i]]->value = values[i];
+    theProblem->rho = rho;
+    theProblem->g = g;
+    memcpy(theProblem->soluce, soluce, sizeof(double) * size);
+    femFree(soluce);
+    femFree(values);
+    printf("Sweep   : %d unit load cases and gravity solved with one factorization\n", theSweep->nLoads);
+    return theSweep;
+}
+
+void femSweepFree(femSweep *theSweep) {
+    for (int i = 0; i < theSweep->nLoads; i++) femFree(theSweep->unit[i]);
+    femFree(theSweep->unit);
+    femFree(theSweep->gravity);
+    femFree(theSweep->dirichlet);
+    femFree(theSweep->conditions);
+    femFree(theSweep);
+}
+
+// displacements for the Neumann values loads[i] (in the order of the conditions), rho*g and E
+void femSweepCombine(femSweep *theSweep, const double *loads, double rhoG, double E, double *soluce) {
+    int size = theSweep->size;
+    double scale = theSweep->E / E;
+    for (int j = 0; j < size; j++)
+        soluce[j] = theSweep->dirichlet[j] + scale * rhoG * theSweep->gravity[j];
+    for (int i = 0; i < theSweep->nLoads; i++) {
+        double factor = scale * loads[i];
+        double *unit = theSweep->unit[i];
+        for (int j = 0; j < size; j++)
+            soluce[j] += factor * unit[j]; }
+}
+
+// maximum nodal displacement of a combination, work holds 2*nNodes doubles
+double femSweepMaxDisplacement(femSweep *theSweep, const double *loads, double rhoG, double E, double *work) {
+    femSweepCombine(theSweep, loads, rhoG, E, work);
+    double uMax = 0.0;
+    for (int j = 0; j < theSweep->size; j += 2)
+        uMax = fmax(uMax, sqrt(work[j]*work[j] + work[j+1]*work[j+1]));
+    return uMax;
+}
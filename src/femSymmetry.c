@@ -0,0 +1,150 @@
+/*
+ *  femSymmetry.c
+ *  Whole mesh and fields mirrored from a half model, symmetric about x = 0
+ *
+ *  A geometry and a load symmetric about x = 0 have a symmetric solution :
+ *  only the half x >= 0 is solved, with a zero horizontal displacement on the
+ *  cut. The whole mesh is rebuilt here for the output and the viewer : the
+ *  nodes of the half are kept, each node off the axis gets an image (-x,y),
+ *  the elements and the edges are mirrored with their orientation reversed,
+ *  and each domain holds the edges of both sides.
+ *
+ *  A field f(x,y) of the half gives f(-x,y) = parity * f(x,y) on the images :
+ *  -1 for the horizontal displacement and the shear, +1 otherwise, and the odd
+ *  fields vanish on the axis. Nodal forces are not point values : the forces on
+ *  the axis only gather the half of the edges around a node, their vertical
+ *  component is doubled and the horizontal one, the reaction of the other
+ *  half, vanishes.
+ *
+ */
+
+#include "../headers/femSymmetry.h"
+
+
+femSymmetry *femSymmetryCreate(femGeo *theHalf) {
+    femNodes *halfNodes = theHalf->theNodes;
+    femMesh *halfElements = theHalf->theElements;
+    femMesh *halfEdges = theHalf->theEdges;
+    int nHalf = halfNodes->nNodes, nLocal = halfElements->nLocalNode;
+    int i,j,iDomain;
+
+    femSymmetry *theSymmetry = femMalloc(FEM_MEM_POST, sizeof(femSymmetry));
+    theSymmetry->half = theHalf;
+    theSymmetry->nHalf = nHalf;
+    theSymmetry->onAxis = femMalloc(FEM_MEM_POST, sizeof(int) * nHalf);
+    int *image = femMalloc(FEM_MEM_POST, sizeof(int) * nHalf);
+
+    // nodes on the cut, up to a tolerance relative to the width of the half
+    double width = 0.0;
+    for (i = 0; i < nHalf; i++) width = fmax(width, fabs(halfNodes->X[i]));
+    int nNodes = nHalf;
+    for (i = 0; i < nHalf; i++) {
+        theSymmetry->onAxis[i] = fabs(halfNodes->X[i]) <= 1e-8 * width;
+        image[i] = theSymmetry->onAxis[i] ? i : nNodes++; }
+    theSymmetry->nNodes = nNodes;
+    theSymmetry->source = femMalloc(FEM_MEM_POST, sizeof(int) * nNodes);
+
+    femGeo *theGeometry = geoCreate();
+    theGeometry->h = theHalf->h;
+    theGeometry->elementType = theHalf->elementType;
+    theSymmetry->geometry = theGeometry;
+    femArena *theArena = geoArena(theGeometry);
+    femNodes *theNodes = femArenaAlloc(theArena, sizeof(femNodes));
+    theNodes->nNodes = nNodes;
+    theNodes->X = femArenaAlloc(theArena, sizeof(double) * nNodes);
+    theNodes->Y = femArenaAlloc(theArena, sizeof(double) * nNodes);
+    for (i = 0; i < nHalf; i++) {
+        theNodes->X[i] = halfNodes->X[i];
+        theNodes->Y[i] = halfNodes->Y[i];
+        theSymmetry->source[i] = i;
+        if (theSymmetry->onAxis[i]) continue;
+        theNodes->X[image[i]] = -halfNodes->X[i];
+        theNodes->Y[image[i]] =  halfNodes->Y[i];
+        theSymmetry->source[image[i]] = i; }
+    theGeometry->theNodes = theNodes;
+
+    // the mirrored elements run through their nodes in the reverse order
+    int nElem = halfElements->nElem;
+    femMesh *theElements = femArenaAlloc(theArena, sizeof(femMesh));
+    theElements->nLocalNode = nLocal;
+    theElements->nElem = 2 * nElem;
+    theElements->nodes = theNodes;
+    theElements->topology = NULL;
+    theElements->elem = femArenaAlloc(theArena, sizeof(int) * nLocal * 2 * nElem);
+    for (i = 0; i < nElem; i++)
+        for (j = 0; j < nLocal; j++) {
+            theElements->elem[nLocal*i+j] = halfElements->elem[nLocal*i+j];
+            theElements->elem[nLocal*(nElem+i)+j] = image[halfElements->elem[nLocal*i+(nLocal-j)%nLocal]]; }
+    theGeometry->theElements = theElements;
+
+    // edges on the axis are their own image
+    int nEdges = halfEdges->nElem, nMirrored = 0;
+    int *mirrored = femMalloc(FEM_MEM_POST, sizeof(int) * nEdges);
+    for (i = 0; i < nEdges; i++) {
+        int a = halfEdges->elem[2*i], b = halfEdges->elem[2*i+1];
+        mirrored[i] = (theSymmetry->onAxis[a] && theSymmetry->onAxis[b]) ? -1 : nEdges + nMirrored++; }
+    femMesh *theEdges = femArenaAlloc(theArena, sizeof(femMesh));
+    theEdges->nLocalNode = 2;
+    theEdges->nElem = nEdges + nMirrored;
+    theEdges->nodes = theNodes;
+    theEdges->topology = NULL;
+    theEdges->elem = femArenaAlloc(theArena, sizeof(int) * 2 * theEdges->nElem);
+    for (i = 0; i < nEdges; i++) {
+        theEdges->elem[2*i]   = halfEdges->elem[2*i];
+        theEdges->elem[2*i+1] = halfEdges->elem[2*i+1];
+        if (mirrored[i] == -1) continue;
+        theEdges->elem[2*mirrored[i]]   = image[halfEdges->elem[2*i+1]];
+        theEdges->elem[2*mirrored[i]+1] = image[halfEdges->elem[2*i]]; }
+    theGeometry->theEdges = theEdges;
+
+    theGeometry->nDomains = theHalf->nDomains;
+    theGeometry->theDomains = femArenaAlloc(theArena, sizeof(femDomain*) * theHalf->nDomains);
+    for (iDomain = 0; iDomain < theHalf->nDomains; iDomain++) {
+        femDomain *halfDomain = theHalf->theDomains[iDomain];
+        femDomain *theDomain = femArenaAlloc(theArena, sizeof(femDomain));
+        int n = halfDomain->nElem;
+        theDomain->mesh = theEdges;
+        strcpy(theDomain->name, halfDomain->name);
+        theDomain->elem = femArenaAlloc(theArena, sizeof(int) * 2 * n);
+        theDomain->nElem = 0;
+        for (i = 0; i < n; i++) theDomain->elem[theDomain->nElem++] = halfDomain->elem[i];
+        for (i = 0; i < n; i++)
+            if (mirrored[halfDomain->elem[i]] != -1) theDomain->elem[theDomain->nElem++] = mirrored[halfDomain->elem[i]];
+        theGeometry->theDomains[iDomain] = theDomain; }
+
+    printf("Geo     : half model of %d nodes mirrored about x = 0 : %d nodes, %d elements\n",
+           nHalf, nNodes, theElements->nElem);
+    femFree(mirrored);
+    femFree(image);
+    return theSymmetry;
+}
+
+void femSymmetryFree(femSymmetry *theSymmetry) {
+    geoFree(theSymmetry->geometry);
+    femFree(theSymmetry->onAxis);
+    femFree(theSymmetry->source);
+    femFree(theSymmetry);
+}
+
+// nFields values per node of the half to the whole mesh, parity[k] is -1 for the fields odd in x
+void femSymmetryMirror(femSymmetry *theSymmetry, int nFields, const double *parity,
+                       const double *half, double *whole) {
+    for (int i = 0; i < theSymmetry->nNodes; i++) {
+        int node = theSymmetry->source[i];
+        for (int k = 0; k < nFields; k++) {
+            double value = half[nFields*node+k];
+            if (i >= theSymmetry->nHalf) value *= parity[k];
+            else if (theSymmetry->onAxis[node] && parity[k] < 0.0) value = 0.0;
+            whole[nFields*i+k] = value; }}
+}
+
+// nodal forces (x,y) of the half to the whole mesh
+void femSymmetryMirrorForces(femSymmetry *theSymmetry, const double *half, double *whole) {
+    for (int i = 0; i < theSymmetry->nNodes; i++) {
+        int node = theSymmetry->source[i];
+        double fx = half[2*node], fy = half[2*node+1];
+        if (i >= theSymmetry->nHalf) fx = -fx;
+        else if (theSymmetry->onAxis[node]) { fx = 0.0; fy = 2.0 * fy; }
+        whole[2*i] = fx;
+        whole[2*i+1] = fy; }
+}
@@ -0,0 +1,194 @@
+/*
+ *  femTopology.c
+ *  Adjacency graphs of a mesh, built once and cached on the mesh
+ *
+ *  The elements of each node come from a counting sort of the connectivity :
+ *  every thread counts the nodes of its range of elements, a prefix sum over
+ *  the nodes and the threads gives each thread its own slots, and the second
+ *  pass fills them. The ranges being in increasing order, so are the elements
+ *  of each node. The neighbours of each node are then gathered from its
+ *  elements with a marker per thread (count, prefix sum, fill), and the
+ *  neighbour of an element across one of its edges is the other element
+ *  around the first node of the edge that also holds the second one. All of
+ *  it is linear in the size of the mesh.
+ *
+ *  The graphs are kept on the mesh until femMeshInvalidate, which the
+ *  operations changing the connectivity (refinement, new mesh) call. The
+ *  lazy build is serialized by a lock, so that problems solved at the same
+ *  time on one shared mesh (femRunnerRun) find a single copy of the graphs.
+ *
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include "../headers/femTopology.h"
+
+static pthread_mutex_t theTopologyLock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct {
+    femMesh *theMesh;
+    femTopology *theTopology;
+    int phase;
+    int elemFirst, elemLast;
+    int nodeFirst, nodeLast;
+    int *counts;                    // slots of this thread for each node
+    int *marker;
+} femTopologyWorker;
+
+
+static void *femTopologyWork(void *data) {
+    femTopologyWorker *theWorker = data;
+    femMesh *theMesh = theWorker->theMesh;
+    femTopology *theTopology = theWorker->theTopology;
+    int nLocal = theMesh->nLocalNode;
+    const int *elem = theMesh->elem;
+    int *counts = theWorker->counts, *marker = theWorker->marker;
+    int i,j,k,l,iElem;
+
+    switch (theWorker->phase) {
+    case 0 :
+        for (i = nLocal * theWorker->elemFirst; i < nLocal * theWorker->elemLast; i++) counts[elem[i]]++;
+        break;
+    case 1 :
+        for (iElem = theWorker->elemFirst; iElem < theWorker->elemLast; iElem++)
+            for (j = 0; j < nLocal; j++)
+                theTopology->nodeElem[counts[elem[iElem*nLocal+j]]++] = iElem;
+        break;
+    case 2 :
+    case 3 :
+        for (i = theWorker->nodeFirst; i < theWorker->nodeLast; i++) {
+            int stamp = 2*i + theWorker->phase - 2, n = 0;
+            int *row = (theWorker->phase == 3) ? &theTopology->nodeNode[theTopology->nodeNodeStart[i]] : NULL;
+            for (k = theTopology->nodeStart[i]; k < theTopology->nodeStart[i+1]; k++)
+                for (j = 0; j < nLocal; j++) {
+                    int node = elem[theTopology->nodeElem[k]*nLocal+j];
+                    if (marker[node] == stamp) continue;
+                    marker[node] = stamp;
+                    if (row != NULL) {
+                        for (l = n; l > 0 && row[l-1] > node; l--) row[l] = row[l-1];
+                        row[l] = node; }
+                    n++; }
+            if (row == NULL) theTopology->nodeNodeStart[i+1] = n; }
+        break;
+    case 4 :
+        for (iElem = theWorker->elemFirst; iElem < theWorker->elemLast; iElem++)
+            for (j = 0; j < nLocal; j++) {
+                int a = elem[iElem*nLocal+j], b = elem[iElem*nLocal+(j+1)%nLocal], other = -1;
+                for (k = theTopology->nodeStart[a]; k < theTopology->nodeStart[a+1] && other == -1; k++) {
+                    int candidate = theTopology->nodeElem[k];
+                    if (candidate == iElem) continue;
+                    for (l = 0; l < nLocal; l++)
+                        if (elem[candidate*nLocal+l] == b) other = candidate; }
+                theTopology->elemElem[iElem*nLocal+j] = other; }
+        break; }
+    return NULL;
+}
+
+static void femTopologyRun(femTopologyWorker *workers, int nThreads, int phase) {
+    pthread_t threads[nThreads];
+    int t;
+    for (t = 0; t < nThreads; t++) workers[t].phase = phase;
+    for (t = 1; t < nThreads; t++)
+        if (pthread_create(&threads[t], NULL, femTopologyWork, &workers[t]) != 0)
+            Error("Cannot create a topology thread");
+    femTopologyWork(&workers[0]);
+    for (t = 1; t < nThreads; t++)
+        pthread_join(threads[t], NULL);
+}
+
+static femTopology *femTopologyCreate(femMesh *theMesh) {
+    int nNodes = theMesh->nodes->nNodes, nElem = theMesh->nElem, nLocal = theMesh->nLocalNode;
+    int i,t;
+    int nThreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    if (nThreads > nElem / 4096 + 1) nThreads = nElem / 4096 + 1;
+    if (nThreads < 1) nThreads = 1;
+
+    femTopology *theTopology = femMalloc(FEM_MEM_MESH, sizeof(femTopology));
+    theTopology->nNodes = nNodes;
+    theTopology->nElem = nElem;
+    theTopology->nLocalNode = nLocal;
+    theTopology->nodeStart = femMalloc(FEM_MEM_MESH, sizeof(int) * (nNodes + 1));
+    theTopology->nodeElem = femMalloc(FEM_MEM_MESH, sizeof(int) * (nLocal * nElem + 1));
+    theTopology->nodeNodeStart = femMalloc(FEM_MEM_MESH, sizeof(int) * (nNodes + 1));
+    theTopology->elemElem = femMalloc(FEM_MEM_MESH, sizeof(int) * (nLocal * nElem + 1));
+    theTopology->nEdges = 0;
+    theTopology->edgeElem = NULL;
+
+    int *counts = femMalloc(FEM_MEM_MESH, sizeof(int) * nThreads * nNodes);
+    int *marker = femMalloc(FEM_MEM_MESH, sizeof(int) * nThreads * nNodes);
+    for (i = 0; i < nThreads * nNodes; i++) { counts[i] = 0; marker[i] = -1; }
+    femTopologyWorker workers[nThreads];
+    for (t = 0; t < nThreads; t++) {
+        workers[t].theMesh = theMesh;
+        workers[t].theTopology = theTopology;
+        workers[t].elemFirst = (int) ((long) nElem * t / nThreads);
+        workers[t].elemLast  = (int) ((long) nElem * (t+1) / nThreads);
+        workers[t].nodeFirst = (int) ((long) nNodes * t / nThreads);
+        workers[t].nodeLast  = (int) ((long) nNodes * (t+1) / nThreads);
+        workers[t].counts = &counts[t * nNodes];
+        workers[t].marker = &marker[t * nNodes]; }
+
+    // counting sort of the elements by node, the counts become the slots of each thread
+    femTopologyRun(workers, nThreads, 0);
+    int start = 0;
+    for (i = 0; i < nNodes; i++) {
+        theTopology->nodeStart[i] = start;
+        for (t = 0; t < nThreads; t++) {
+            int count = counts[t * nNodes + i];
+            counts[t * nNodes + i] = start;
+            start += count; }}
+    theTopology->nodeStart[nNodes] = start;
+    femTopologyRun(workers, nThreads, 1);
+
+    // neighbours of the nodes : the sizes, then the sorted rows
+    femTopologyRun(workers, nThreads, 2);
+    theTopology->nodeNodeStart[0] = 0;
+    for (i = 0; i < nNodes; i++) theTopology->nodeNodeStart[i+1] += theTopology->nodeNodeStart[i];
+    theTopology->nodeNode = femMalloc(FEM_MEM_MESH, sizeof(int) * (theTopology->nodeNodeStart[nNodes] + 1));
+    femTopologyRun(workers, nThreads, 3);
+
+    femTopologyRun(workers, nThreads, 4);
+    femFree(counts);
+    femFree(marker);
+    return theTopology;
+}
+
+// elements holding each edge of a mesh of edges on the same nodes
+static void femTopologyEdges(femTopology *theTopology, femMesh *theMesh, femMesh *theEdges) {
+    int nLocal = theMesh->nLocalNode;
+    theTopology->nEdges = theEdges->nElem;
+    theTopology->edgeElem = femMalloc(FEM_MEM_MESH, sizeof(int) * (2 * theEdges->nElem + 1));
+    for (int i = 0; i < theEdges->nElem; i++) {
+        int a = theEdges->elem[2*i], b = theEdges->elem[2*i+1], n = 0;
+        theTopology->edgeElem[2*i] = theTopology->edgeElem[2*i+1] = -1;
+        for (int k = theTopology->nodeStart[a]; k < theTopology->nodeStart[a+1] && n < 2; k++) {
+            int iElem = theTopology->nodeElem[k];
+            for (int j = 0; j < nLocal; j++)
+                if (theMesh->elem[iElem*nLocal+j] == b) theTopology->edgeElem[2*i + n++] = iElem; }}
+}
+
+// the graphs of the mesh, built on the first call; theEdges can be NULL when edgeElem is not needed
+femTopology *femMeshTopology(femMesh *theMesh, femMesh *theEdges) {
+    pthread_mutex_lock(&theTopologyLock);
+    if (theMesh->topology == NULL) theMesh->topology = femTopologyCreate(theMesh);
+    femTopology *theTopology = theMesh->topology;
+    if (theEdges != NULL && theTopology->edgeElem == NULL) femTopologyEdges(theTopology, theMesh, theEdges);
+    pthread_mutex_unlock(&theTopologyLock);
+    return theTopology;
+}
+
+// the cached graphs are dropped, to be called whenever the connectivity changes
+void femMeshInvalidate(femMesh *theMesh) {
+    pthread_mutex_lock(&theTopologyLock);
+    femTopology *theTopology = theMesh->topology;
+    theMesh->topology = NULL;
+    pthread_mutex_unlock(&theTopologyLock);
+    if (theTopology == NULL) return;
+    femFree(theTopology->nodeStart);
+    femFree(theTopology->nodeElem);
+    femFree(theTopology->nodeNodeStart);
+    femFree(theTopology->nodeNode);
+    femFree(theTopology->elemElem);
+    if (theTopology->edgeElem) femFree(theTopology->edgeElem);
+    femFree(theTopology);
+}
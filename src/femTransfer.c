@@ -0,0 +1,83 @@
+/*
+ *  femTransfer.c
+ *  Transfer of nodal fields from one mesh to another by point location
+ *
+ *  The transfer keeps its own copy of the source mesh and of the fields, so
+ *  that the source can be remeshed, refined or freed before the fields are
+ *  evaluated. A locator on the copy finds the element holding a point and the
+ *  fields are interpolated with the shape functions there. A point outside of
+ *  the source mesh, on a curved boundary meshed again, takes the values of
+ *  the nearest node of the closest cells.
+ *
+ *  The transferred displacements are a good starting point for the iterative
+ *  solvers : femTransferWarmStart puts them in the solution of a problem on
+ *  the new mesh before it is solved.
+ *
+ */
+
+#include "../headers/femTransfer.h"
+#include "../headers/femTopology.h"
+
+
+femTransfer *femTransferCreate(femMesh *theMesh, int nFields, const double *values) {
+    femNodes *theNodes = theMesh->nodes;
+    femTransfer *theTransfer = femMalloc(FEM_MEM_POST, sizeof(femTransfer));
+    int nNodes = theNodes->nNodes, nElem = theMesh->nElem, nLocal = theMesh->nLocalNode;
+    theTransfer->nodes.nNodes = nNodes;
+    theTransfer->nodes.X = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    theTransfer->nodes.Y = femMalloc(FEM_MEM_POST, sizeof(double) * nNodes);
+    memcpy(theTransfer->nodes.X, theNodes->X, sizeof(double) * nNodes);
+    memcpy(theTransfer->nodes.Y, theNodes->Y, sizeof(double) * nNodes);
+    theTransfer->mesh.nLocalNode = nLocal;
+    theTransfer->mesh.nElem = nElem;
+    theTransfer->mesh.elem = femMalloc(FEM_MEM_POST, sizeof(int) * nLocal * nElem);
+    theTransfer->mesh.nodes = &theTransfer->nodes;
+    theTransfer->mesh.topology = NULL;
+    memcpy(theTransfer->mesh.elem, theMesh->elem, sizeof(int) * nLocal * nElem);
+    theTransfer->nFields = nFields;
+    theTransfer->values = femMalloc(FEM_MEM_POST, sizeof(double) * nFields * nNodes);
+    memcpy(theTransfer->values, values, sizeof(double) * nFields * nNodes);
+    theTransfer->locator = femLocatorCreate(&theTransfer->mesh);
+    return theTransfer;
+}
+
+void femTransferFree(femTransfer *theTransfer) {
+    femLocatorFree(theTransfer->locator);
+    femMeshInvalidate(&theTransfer->mesh);
+    femFree(theTransfer->nodes.X); femFree(theTransfer->nodes.Y);
+    femFree(theTransfer->mesh.elem); femFree(theTransfer->values);
+    femFree(theTransfer);
+}
+
+// interpolation in the element containing (x,y), the nearest node outside of the mesh
+void femTransferEvaluate(femTransfer *theTransfer, double x, double y, double *values) {
+    int nLocal = theTransfer->mesh.nLocalNode, nFields = theTransfer->nFields, j, k;
+    const double *V = theTransfer->values;
+    double xsi, eta, phi[4];
+    int iElem = femLocatorFind(theTransfer->locator, x, y, &xsi, &eta);
+    if (iElem != -1) {
+        const int *nodes = &theTransfer->mesh.elem[iElem*nLocal];
+        femLocatorWeights(theTransfer->locator, xsi, eta, phi);
+        for (k = 0; k < nFields; k++) {
+            values[k] = 0.0;
+            for (j = 0; j < nLocal; j++) values[k] += phi[j] * V[nFields*nodes[j]+k]; }
+        return; }
+    int nearest = femLocatorNearest(theTransfer->locator, x, y);
+    for (k = 0; k < nFields; k++) values[k] = (nearest != -1) ? V[nFields*nearest+k] : 0.0;
+}
+
+// the fields at every node of another mesh, nFields values per node
+void femTransferInterpolate(femTransfer *theTransfer, femNodes *theNodes, double *values) {
+    int nFields = theTransfer->nFields;
+    for (int i = 0; i < theNodes->nNodes; i++)
+        femTransferEvaluate(theTransfer, theNodes->X[i], theNodes->Y[i], &values[nFields*i]);
+}
+
+// transferred displacements as the starting point of the next solve of the problem,
+// only the iterative solvers make use of it
+void femTransferWarmStart(femTransfer *theTransfer, femProblem *theProblem) {
+    if (theTransfer->nFields != 2) Error("A warm start needs the two displacements at each node");
+    femTransferInterpolate(theTransfer, theProblem->geometry->theNodes, theProblem->soluce);
+    printf("Transfer: displacements of %d nodes interpolated on %d nodes\n",
+           theTransfer->nodes.nNodes, theProblem->geometry->theNodes->nNodes);
+}
@@ -229,6 +229,7 @@ int glfemGetAction(void)
 static void glfemKeyCallback(GLFWwindow* self,
               int key, int scancode, int action,int mods) 
 {    
+    (void) scancode; (void) mods;
     if (key == GLFW_KEY_RIGHT && action == GLFW_PRESS) {
         GLFEM_ACTION = 1;   }
     if (key == GLFW_KEY_LEFT && action == GLFW_PRESS) {
@@ -352,7 +353,7 @@ void glfemPlotMesh(femMesh *theMesh)
 
 void glfemPlotDomain(femDomain *theDomain)
 {
-    int i,j,*nodes;
+    int j,*nodes;
     femMesh *theMesh = theDomain->mesh;
     int nLocalNode = theMesh->nLocalNode;
     float  xLoc[nLocalNode];
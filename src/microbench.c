@@ -0,0 +1,363 @@
+/*
+*
+*   KERNEL MICROBENCHMARKS : ASSEMBLY, NEUMANN, MATRIX-VECTOR PRODUCTS AND FACTORIZATIONS
+*
+*   Every kernel runs on a synthetic rectangle of n x n cells (no gmsh needed) and is
+*   repeated until it has run for at least BENCH_MINTIME seconds. For each one we report
+*   the time per item (element, edge or row), GFlop/s and GB/s, as fractions of the
+*   peaks measured at start-up, so that compute-bound and bandwidth-bound kernels
+*   can be told apart. Bytes count the data touched by the kernel as if nothing stayed
+*   in the caches : more than 100% of the memory peak means the kernel runs from cache.
+*
+*     ./monMicroBench [--sizes 16,32,64,128] [--quads] [--output microbench.json]
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../headers/fem.h"
+
+#define TRUE 1
+#define FALSE 0
+#define MAXSIZES 8
+
+#define BENCH_MINTIME 0.2
+// beyond these sizes the factorizations take minutes
+#define BENCH_DENSE_MAXSIZE 1200
+#define BENCH_BAND_MAXFLOPS 2e10
+
+typedef struct {
+    double gflops;              // single core, measured by benchPeakFlops
+    double gbytes;              // main memory, measured by benchPeakBandwidth
+} benchMachine;
+
+static benchMachine theMachine;
+static FILE *theOutput = NULL;
+static int firstRecord = TRUE;
+
+
+/*
+*   MACHINE PEAKS
+*/
+
+// independent multiply-add chains that stay in registers
+static void benchPeakFlops(void) {
+    double acc[16], m = 0.999999, c = 1e-7;
+    long nIter = 1 << 20;
+    for (int k = 0; k < 16; k++) acc[k] = 1.0 + k;
+    double best = 0.0;
+    for (int trial = 0; trial < 5; trial++) {
+        double t0 = femProfileTime();
+        for (long it = 0; it < nIter; it++)
+            for (int k = 0; k < 16; k++) acc[k] = acc[k] * m + c;
+        double t = femProfileTime() - t0;
+        best = fmax(best, 2.0 * 16 * nIter / t); }
+    double sum = 0.0;
+    for (int k = 0; k < 16; k++) sum += acc[k];
+    if (sum == 0.0) printf("%e\n", sum);            // keeps the loop alive
+    theMachine.gflops = 1e-9 * best;
+}
+
+// stream triad on arrays much larger than the caches
+static void benchPeakBandwidth(void) {
+    int n = 1 << 23;
+    double *a = malloc(sizeof(double) * n);
+    double *b = malloc(sizeof(double) * n);
+    double *c = malloc(sizeof(double) * n);
+    for (int i = 0; i < n; i++) { a[i] = 0.0; b[i] = 1.0; c[i] = 2.0; }
+    double best = 0.0;
+    for (int trial = 0; trial < 5; trial++) {
+        double t0 = femProfileTime();
+        for (int i = 0; i < n; i++) a[i] = b[i] + 3.0 * c[i];
+        double t = femProfileTime() - t0;
+        best = fmax(best, 3.0 * sizeof(double) * n / t); }
+    if (a[n/2] != 7.0) printf("%e\n", a[n/2]);
+    free(a); free(b); free(c);
+    theMachine.gbytes = 1e-9 * best;
+}
+
+
+/*
+*   SYNTHETIC MESHES
+*/
+
+// unit square of n x n cells split in triangles (or kept as quads), every horizontal
+// edge of the grid is an edge of the "Loaded" domain so that the Neumann kernel has n(n+1) edges
+static femGeo *benchMeshRectangle(int n, int quads) {
+    femGeo *theGeometry = geoCreate();
+    int i, j, nx = n+1;
+
+    femNodes *theNodes = femArenaAlloc(theGeometry->arena, sizeof(femNodes));
+    theNodes->nNodes = nx*nx;
+    theNodes->X = femArenaAlloc(theGeometry->arena, sizeof(double) * theNodes->nNodes);
+    theNodes->Y = femArenaAlloc(theGeometry->arena, sizeof(double) * theNodes->nNodes);
+    for (j = 0; j < nx; j++)
+        for (i = 0; i < nx; i++) {
+            theNodes->X[j*nx+i] = (double) i / n;
+            theNodes->Y[j*nx+i] = (double) j / n; }
+    theGeometry->theNodes = theNodes;
+
+    femMesh *theElements = femArenaAlloc(theGeometry->arena, sizeof(femMesh));
+    theElements->nodes = theNodes;
+    theElements->topology = NULL;
+    theElements->nLocalNode = quads ? 4 : 3;
+    theElements->nElem = quads ? n*n : 2*n*n;
+    theElements->elem = femArenaAlloc(theGeometry->arena, sizeof(int) * theElements->nLocalNode * theElements->nElem);
+    int *elem = theElements->elem;
+    for (j = 0; j < n; j++)
+        for (i = 0; i < n; i++) {
+            int n0 = j*nx+i, n1 = n0+1, n2 = n0+nx+1, n3 = n0+nx;
+            if (quads) {
+                *elem++ = n0; *elem++ = n1; *elem++ = n2; *elem++ = n3; }
+            else {
+                *elem++ = n0; *elem++ = n1; *elem++ = n2;
+                *elem++ = n0; *elem++ = n2; *elem++ = n3; }}
+    theGeometry->theElements = theElements;
+    theGeometry->elementType = quads ? FEM_QUAD : FEM_TRIANGLE;
+
+    femMesh *theEdges = femArenaAlloc(theGeometry->arena, sizeof(femMesh));
+    theEdges->nodes = theNodes;
+    theEdges->topology = NULL;
+    theEdges->nLocalNode = 2;
+    theEdges->nElem = n*nx;
+    theEdges->elem = femArenaAlloc(theGeometry->arena, sizeof(int) * 2 * theEdges->nElem);
+    for (j = 0; j < nx; j++)
+        for (i = 0; i < n; i++) {
+            theEdges->elem[2*(j*n+i)]   = j*nx+i;
+            theEdges->elem[2*(j*n+i)+1] = j*nx+i+1; }
+    theGeometry->theEdges = theEdges;
+
+    theGeometry->nDomains = 2;
+    theGeometry->theDomains = femArenaAlloc(theGeometry->arena, sizeof(femDomain*) * 2);
+    for (int iDomain = 0; iDomain < 2; iDomain++) {
+        femDomain *theDomain = femArenaAlloc(theGeometry->arena, sizeof(femDomain));
+        theDomain->mesh = theEdges;
+        theDomain->nElem = (iDomain == 0) ? n : theEdges->nElem;
+        theDomain->elem = femArenaAlloc(theGeometry->arena, sizeof(int) * theDomain->nElem);
+        for (i = 0; i < theDomain->nElem; i++) theDomain->elem[i] = i;
+        sprintf(theDomain->name, "%s", (iDomain == 0) ? "Bottom" : "Loaded");
+        theGeometry->theDomains[iDomain] = theDomain; }
+    return theGeometry;
+}
+
+
+/*
+*   REPORTING
+*/
+
+static void benchReport(const char *kernel, int n, const char *unit, double nItems,
+                        double seconds, double flops, double bytes) {
+    double gflops = 1e-9 * flops / seconds;
+    double gbytes = 1e-9 * bytes / seconds;
+    double intensity = flops / bytes;
+    double balance = theMachine.gflops / theMachine.gbytes;
+    const char *bound = (intensity > balance) ? "compute" : "memory";
+    printf("  %-14s %5d %10.0f %-8s %12.2f %9.3f %6.1f%% %9.3f %6.1f%% %7.2f  %s\n",
+           kernel, n, nItems, unit, 1e9 * seconds / nItems, gflops, 100.0 * gflops / theMachine.gflops,
+           gbytes, 100.0 * gbytes / theMachine.gbytes, intensity, bound);
+    if (theOutput) {
+        fprintf(theOutput, "%s    {\"kernel\": \"%s\", \"n\": %d, \"unit\": \"%s\", \"items\": %.0f, "
+                "\"ns_per_item\": %.3f, \"gflops\": %.4f, \"gbytes\": %.4f, \"intensity\": %.4f, \"bound\": \"%s\"}",
+                firstRecord ? "" : ",\n", kernel, n, unit, nItems, 1e9 * seconds / nItems,
+                gflops, gbytes, intensity, bound);
+        firstRecord = FALSE; }
+}
+
+static void benchSkipped(const char *kernel, int n) {
+    printf("  %-14s %5d    skipped\n", kernel, n);
+}
+
+
+/*
+*   KERNELS
+*/
+
+static void benchMeshKernels(int n, int quads) {
+    femGeo *theGeometry = benchMeshRectangle(n, quads);
+    femProblem *theProblem = femElasticityCreateSolver(theGeometry, 68e9, 0.32, 2.71e3, -9.81, PLANAR_STRESS,
+                                                       FEM_BAND, FEM_YNUM);
+    femElasticityAddBoundaryCondition(theProblem, "Bottom", DIRICHLET_X, 0.0);
+    femElasticityAddBoundaryCondition(theProblem, "Bottom", DIRICHLET_Y, 0.0);
+    femElasticityAddBoundaryCondition(theProblem, "Loaded", NEUMANN_Y, 1e6);
+    femBandSystem *theSystem = theProblem->bandSystem;
+    int nElem = theGeometry->theElements->nElem;
+    int nEdges = theGeometry->theEdges->nElem;
+    int nLocal = theGeometry->theElements->nLocalNode;
+    int nLoc = 2*nLocal;
+    int size = theSystem->size, band = theSystem->band;
+    double elementFlops = femElasticityElementFlops(theProblem);
+    double elementBytes = nLocal * (sizeof(int) + 2*sizeof(double)) + (nLoc*nLoc + nLoc) * sizeof(double);
+    double Aloc[64], Bloc[8];
+    int map[4], nRep;
+    double t0, t;
+
+    // element stiffness alone, without the scatter into the system, jacobians recomputed
+    femElasticitySetFactorCache(theProblem, FALSE);
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        for (int iElem = 0; iElem < nElem; iElem++)
+            femElasticityElementMatrix(theProblem, iElem, Aloc, Bloc, map);
+    benchReport("stiffness", n, "element", nElem, t / nRep, nElem * elementFlops, nElem * elementBytes);
+
+    // the cache of the jacobians and gradients, then the stiffness reading it, as the passes below do
+    int nInteg = theProblem->rule->n;
+    double factorBytes = nInteg * (1 + 2*nLocal) * sizeof(double);
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++) {
+        femElasticitySetFactorCache(theProblem, FALSE);
+        femElasticitySetFactorCache(theProblem, TRUE);
+        femElasticityFactors(theProblem); }
+    benchReport("factors", n, "element", nElem, t / nRep, nElem * nInteg * (16.0*nLocal + 10.0),
+                nElem * (nLocal * (sizeof(int) + 2*sizeof(double)) + factorBytes));
+    elementFlops = femElasticityElementFlops(theProblem);
+    elementBytes = nLocal * sizeof(int) + factorBytes + (nLoc*nLoc + nLoc) * sizeof(double);
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        for (int iElem = 0; iElem < nElem; iElem++)
+            femElasticityElementMatrix(theProblem, iElem, Aloc, Bloc, map);
+    benchReport("stiffness-fac", n, "element", nElem, t / nRep, nElem * elementFlops, nElem * elementBytes);
+
+    // the same with the scatter into the upper band
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        femElasticityAssembleElements(theProblem);
+    benchReport("assembly", n, "element", nElem, t / nRep,
+                nElem * (elementFlops + nLoc*(nLoc+1)/2), nElem * (elementBytes + nLoc*(nLoc+1) * sizeof(double)));
+
+    // Neumann integration over every horizontal edge
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        femElasticityAssembleNeumann(theProblem);
+    benchReport("neumann", n, "edge", nEdges, t / nRep, nEdges * (8.0 + 2 * 10.0),
+                nEdges * 2 * (sizeof(int) + 4*sizeof(double)));
+
+    // element by element product (the residual computation) and assembled band product
+    double *x = malloc(sizeof(double) * size);
+    double *y = malloc(sizeof(double) * size);
+    for (int i = 0; i < size; i++) theProblem->soluce[i] = x[i] = 1e-3 * sin(i);
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        femElasticityForces(theProblem);
+    benchReport("matvec-ebe", n, "element", nElem, t / nRep, nElem * (elementFlops + 2.0*nLoc*nLoc),
+                nElem * (elementBytes + 3.0*nLoc * sizeof(double)));
+
+    femBandSystemInit(theSystem);
+    femElasticityAssembleElements(theProblem);
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        femBandSystemMultiply(theSystem, x, y);
+    benchReport("matvec-band", n, "row", size, t / nRep, 4.0 * size * band,
+                sizeof(double) * ((double) size * band + 3.0*size));
+
+    // band factorization and solve of the constrained system, restored from a copy between runs
+    double factorFlops = (double) size * band * band;
+    if (factorFlops > BENCH_BAND_MAXFLOPS) {
+        benchSkipped("factor-band", n);
+        benchSkipped("solve-band", n); }
+    else {
+        femBandSystemInit(theSystem);
+        femElasticityAssembleElements(theProblem);
+        for (int i = 0; i < size; i++)
+            if (theProblem->constrainedNodes[i] != -1)
+                femBandSystemConstrain(theSystem, 2*theProblem->number[i/2] + i%2, 0.0);
+        size_t length = sizeof(double) * size * (band+1);
+        double *copy = malloc(length);
+        memcpy(copy, theSystem->B, length);
+        for (nRep = 0, t = 0.0; t < BENCH_MINTIME; nRep++) {
+            memcpy(theSystem->B, copy, length);
+            t0 = femProfileTime();
+            femBandSystemFactor(theSystem);
+            t += femProfileTime() - t0; }
+        benchReport("factor-band", n, "row", size, t / nRep, factorFlops, 8.0 * size * band * band);
+        // the solve overwrites the right-hand side, restored outside of the timing
+        double *rhs = malloc(sizeof(double) * size);
+        memcpy(rhs, theSystem->B, sizeof(double) * size);
+        for (nRep = 0, t = 0.0; t < BENCH_MINTIME; nRep++) {
+            memcpy(theSystem->B, rhs, sizeof(double) * size);
+            t0 = femProfileTime();
+            femBandSystemSolve(theSystem);
+            t += femProfileTime() - t0; }
+        benchReport("solve-band", n, "row", size, t / nRep, 4.0 * size * band, 2.0 * sizeof(double) * size * band);
+        free(rhs);
+        free(copy); }
+
+    free(x);
+    free(y);
+    femElasticityFree(theProblem);
+    geoFree(theGeometry);
+}
+
+// dense elimination on a diagonally dominant matrix of the size of the n x n mesh problem
+static void benchDenseKernels(int n) {
+    int size = 2*(n+1)*(n+1);
+    if (size > BENCH_DENSE_MAXSIZE) {
+        benchSkipped("matvec-full", n);
+        benchSkipped("factor-full", n);
+        return; }
+    femFullSystem *theSystem = femFullSystemCreate(size);
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) theSystem->A[i][j] = 1.0 / (1.0 + abs(i-j));
+        theSystem->A[i][i] += size;
+        theSystem->B[i] = 1.0; }
+    double *x = malloc(sizeof(double) * size);
+    double *y = malloc(sizeof(double) * size);
+    for (int i = 0; i < size; i++) x[i] = sin(i);
+    int nRep;
+    double t0, t;
+
+    for (nRep = 0, t0 = femProfileTime(); (t = femProfileTime() - t0) < BENCH_MINTIME; nRep++)
+        femFullSystemMultiply(theSystem, x, y);
+    benchReport("matvec-full", n, "row", size, t / nRep, 2.0 * size * size,
+                sizeof(double) * ((double) size * size + 2.0*size));
+
+    size_t length = sizeof(double) * size * (size+1);
+    double *copy = malloc(length);
+    memcpy(copy, theSystem->B, length);
+    for (nRep = 0, t = 0.0; t < BENCH_MINTIME; nRep++) {
+        memcpy(theSystem->B, copy, length);
+        t0 = femProfileTime();
+        femFullSystemFactor(theSystem);
+        t += femProfileTime() - t0; }
+    benchReport("factor-full", n, "row", size, t / nRep, 2.0/3.0 * size * size * (double) size,
+                16.0/3.0 * size * size * (double) size);
+
+    free(copy);
+    free(x);
+    free(y);
+    femFullSystemFree(theSystem);
+}
+
+int main(int argc, char* argv[]) {
+    int theSizes[MAXSIZES] = {8, 16, 32, 64, 128};
+    int nSizes = 5, quads = FALSE;
+    const char *outputFilePath = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quads") == 0) quads = TRUE;
+        if (strcmp(argv[i], "--output") == 0 && i+1 < argc) outputFilePath = argv[++i];
+        if (strcmp(argv[i], "--sizes") == 0 && i+1 < argc) {
+            char *token = strtok(argv[++i], ",");
+            for (nSizes = 0; token && nSizes < MAXSIZES; token = strtok(NULL, ","))
+                theSizes[nSizes++] = atoi(token); }
+    }
+
+    benchPeakFlops();
+    benchPeakBandwidth();
+    printf("\n MicroBench : %s, peak %.3f GFlop/s (one core), %.3f GB/s, balance %.2f flop/byte\n\n",
+           quads ? "quads" : "triangles", theMachine.gflops, theMachine.gbytes, theMachine.gflops / theMachine.gbytes);
+    printf("  %-14s %5s %10s %-8s %12s %9s %7s %9s %7s %7s  %s\n", "kernel", "n", "items", "unit",
+           "ns/item", "GFlop/s", "peak", "GB/s", "peak", "flop/B", "bound");
+
+    if (outputFilePath) {
+        theOutput = fopen(outputFilePath, "w");
+        if (!theOutput) {
+            printf("Error! Unable to open file at %s\n", outputFilePath);
+            exit(-1); }
+        fprintf(theOutput, "{\n  \"element\": \"%s\",\n  \"peak_gflops\": %.4f,\n  \"peak_gbytes\": %.4f,\n  \"kernels\": [\n",
+                quads ? "quad" : "triangle", theMachine.gflops, theMachine.gbytes); }
+
+    for (int i = 0; i < nSizes; i++) {
+        benchMeshKernels(theSizes[i], quads);
+        benchDenseKernels(theSizes[i]);
+        printf("\n"); }
+
+    if (theOutput) {
+        fprintf(theOutput, "\n  ]\n}\n");
+        fclose(theOutput);
+        printf(" MicroBench : results written to %s\n", outputFilePath); }
+    return EXIT_SUCCESS;
+}
@@ -8,32 +8,208 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "../headers/fem.h"
+#include "../headers/femSweep.h"
+#include "../headers/femSuperelement.h"
+#include "../headers/femStress.h"
+#include "../headers/femAdapt.h"
+#include "../headers/femRefine.h"
+#include "../headers/femMultigrid.h"
+#include "../headers/femMonitor.h"
+#include "../headers/femTransfer.h"
+#include "../headers/femLocator.h"
+#include "../headers/femIntegrals.h"
+#include "../headers/femSymmetry.h"
+#include "../headers/femModal.h"
+#include "../headers/femRunner.h"
+#ifndef FEM_HEADLESS
 #include "../headers/glfem.h"
+#endif
 
 #define TRUE 1
 #define FALSE 0
+#define MAXADAPT 8
 typedef int bool;
 
 
+// generates the carabiner with the size callback of the geometry, cleans it with fixmesh.py and reads it back
+static void carabinerMesh(femGeo *theGeometry, bool open, bool half, const char *rawMeshFilePath, const char *fixedMeshFilePath) {
+    if (open == TRUE) geoMeshGenerateOpen();
+    else if (half == TRUE) geoMeshGenerateHalf();
+    else geoMeshGenerateClosed();
+        
+    geoMeshImport();
+    printf("\n>> Raw mesh summary:\n");
+    printf("\tGlobal Mesh size: %f\n", theGeometry->h);
+    printf("\tNumber of raw nodes: %d", theGeometry->theNodes->nNodes);
+    printf("\tNumber of domains: %d\n", theGeometry->nDomains);
+
+    geoMeshWrite(rawMeshFilePath);
+    printf("\n>> Cleaning up raw mesh data...\n");
+    system(".venv/bin/python src/fixmesh.py data/mesh_raw.txt data/mesh_fixed.txt");
+    printf(">> Done cleaning mesh. New connected mesh at data/mesh_fixed.txt\n");
+
+    geoMeshRead(fixedMeshFilePath);
+    printf("\n>> theGeometry updated with fixed mesh\n");
+}
+
+// elasticity problem on the carabiner : fixed bottom contact surface, vertical force on the top one,
+// and no horizontal displacement on the cuts of the half model
+static femProblem *carabinerProblem(femGeo *theGeometry, bool open, bool half, double E, double nu, double rho, double g,
+                                    double vertical_force, femSolverType solver, femPrecision precision, bool cache, double monitor,
+                                    bool mass, femMultigrid *theMultigrid) {
+    // the carabiner is tall : numbering the nodes along y keeps the band narrow
+    femRenumType renumbering = (solver == FEM_BAND) ? FEM_YNUM : FEM_NO;
+    femProblem *theProblem = femElasticityCreateSolver(theGeometry, E, nu, rho, g, PLANAR_STRESS, solver, renumbering);
+    printf("\n>> theProblem created\n");
+    
+    int numberOfDomains = theProblem->geometry->nDomains;
+    for (int iDom = 0; iDom < numberOfDomains; iDom++) {
+        if (half == TRUE) {
+            char *names[10] = {NULL, NULL, NULL, "Top Symmetry Cut", "Top Contact Surface",
+                               NULL, NULL, NULL, "Bottom Contact Surface", "Bottom Symmetry Cut"};
+            if (iDom >= 10 || names[iDom] == NULL) continue;
+            if (geoGetDomain(names[iDom]) == -1) geoSetDomainName(iDom, names[iDom]);
+            if (iDom == 3 || iDom == 9) femElasticityAddBoundaryCondition(theProblem, names[iDom], DIRICHLET_X, 0.0);
+            if (iDom == 4) femElasticityAddBoundaryCondition(theProblem, names[iDom], NEUMANN_Y, vertical_force);
+            if (iDom == 8) femElasticityAddBoundaryCondition(theProblem, names[iDom], DIRICHLET_Y, 0.0);
+            continue;
+        }
+        if (open == FALSE && iDom == 12) {
+            if (geoGetDomain("Bottom Contact Surface") == -1) geoSetDomainName(iDom, "Bottom Contact Surface");
+            femElasticityAddBoundaryCondition(theProblem, "Bottom Contact Surface", DIRICHLET_Y, 0.0);
+        }
+        if (open == FALSE && iDom == 13) {
+            if (geoGetDomain("Top Contact Surface") == -1) geoSetDomainName(iDom, "Top Contact Surface");
+            femElasticityAddBoundaryCondition(theProblem, "Top Contact Surface", NEUMANN_Y, vertical_force);
+        }
+        if (open == TRUE && iDom == 8) {
+            if (geoGetDomain("Top Contact Surface") == -1) geoSetDomainName(iDom, "Top Contact Surface");
+            femElasticityAddBoundaryCondition(theProblem, "Top Contact Surface", NEUMANN_Y, vertical_force);
+        }
+        if (open == TRUE && iDom == 12) {
+            if (geoGetDomain("Bottom Contact Surface") == -1) geoSetDomainName(iDom, "Bottom Contact Surface");
+            femElasticityAddBoundaryCondition(theProblem, "Bottom Contact Surface", DIRICHLET_Y, 0.0);
+        }
+    }
+    if (theMultigrid != NULL) femMultigridAttach(theMultigrid, theProblem);
+    femElasticitySetPrecision(theProblem, precision);
+    femElasticitySetFactorCache(theProblem, cache);
+    // the mass matrix is assembled with the stiffness, for the modes on the same factorization
+    femElasticitySetMass(theProblem, mass);
+    // telemetry of the iterations, which stop once the load point and the support have settled
+    if (monitor >= 0.0) {
+        femMonitor *theMonitor = femMonitorCreate(theProblem, "Top Contact Surface", "Bottom Contact Surface");
+        femMonitorSetLog(theMonitor, stdout);
+        femMonitorSetTolerance(theMonitor, monitor); }
+    return theProblem;
+}
+
+// area and strain energy density at a batch of points, both integrated in one pass of femIntegrals
+static void carabinerIntegrand(const femIntegrationPoints *points, int nFields, double *values, void *data) {
+    femProblem *theProblem = data;
+    (void) nFields;                 // always two
+    double a = theProblem->A, b = theProblem->B, c = theProblem->C;
+    double *area = values, *energy = &values[points->n];
+    for (int i = 0; i < points->n; i++) {
+        double exx = points->exx[i], eyy = points->eyy[i], exy = points->exy[i];
+        area[i] = 1.0;
+        energy[i] = 0.5 * (a * (exx*exx + eyy*eyy) + 2.0 * b * exx * eyy + 4.0 * c * exy*exy); }
+}
+
+// independent cases "E force solver" of a file, each one a problem of its own on the mesh of the run
+// with its conditions and the force of the case, solved at the same time by femRunnerRun
+static void carabinerScenarios(femProblem *theProblem, const char *filename, const char *resultsFilename, int nWorkers) {
+    FILE *file = fopen(filename, "r");
+    FILE *results = fopen(resultsFilename, "w");
+    if (!file || !results) Error("Cannot open the scenario files");
+    double E, force;
+    char solverName[32];
+    int i,j,nScenarios = 0;
+    while (fscanf(file, "%le %le %31s", &E, &force, solverName) == 3) nScenarios++;
+    if (nScenarios == 0) Error("No scenario 'E force solver' in the file");
+    rewind(file);
+
+    femScenario *theScenarios = femMalloc(FEM_MEM_POST, sizeof(femScenario) * nScenarios);
+    for (i = 0; i < nScenarios; i++) {
+        femScenario *theScenario = &theScenarios[i];
+        if (fscanf(file, "%le %le %31s", &E, &force, solverName) != 3) Error("Cannot read the scenarios");
+        femScenarioInit(theScenario, theProblem->geometry, E, theProblem->nu, theProblem->rho, theProblem->g,
+                        theProblem->planarStrainStress);
+        snprintf(theScenario->name, MAXNAME, "%s %.3e %.3e", solverName, E, force);
+        if (strcmp(solverName, "full") == 0) femScenarioSetSolver(theScenario, FEM_FULL, FEM_NO);
+        else if (strcmp(solverName, "band") == 0) femScenarioSetSolver(theScenario, FEM_BAND, FEM_YNUM);
+        else if (strcmp(solverName, "amg") == 0) femScenarioSetSolver(theScenario, FEM_MULTIGRID, FEM_NO);
+        else Error("Unknown solver in the scenarios : full, band or amg");
+        for (j = 0; j < theProblem->nBoundaryConditions; j++) {
+            femBoundaryCondition *theCondition = theProblem->conditions[j];
+            double value = (theCondition->type == NEUMANN_Y) ? force : theCondition->value;
+            femScenarioAddCondition(theScenario, theCondition->domain->name, theCondition->type, value); }}
+    fclose(file);
+
+    if (nWorkers <= 0) nWorkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    double t0 = femProfileTime();
+    femRunnerRun(theScenarios, nScenarios, nWorkers, femMemoryBudget());
+    int nSolved = 0;
+    for (i = 0; i < nScenarios; i++) {
+        femScenario *theScenario = &theScenarios[i];
+        if (theScenario->status == 1) {
+            fprintf(results, "%s %14.7e\n", theScenario->name, theScenario->uMax);
+            nSolved++; }
+        else fprintf(results, "%s skipped\n", theScenario->name);
+        femScenarioFree(theScenario); }
+    printf(" ==== Scenarios                     : %d of %d solved by %d workers in %.3f s, written to %s \n",
+           nSolved, nScenarios, nWorkers, femProfileTime() - t0, resultsFilename);
+    femFree(theScenarios);
+    fclose(results);
+}
+
+
 int main(int argc, char* argv[]) {
 
     // paths to subfolder main functions if needed
-    const char* meshFilePath = "data/mesh.txt";
     const char* rawMeshFilePath = "data/mesh_raw.txt";
     const char* fixedMeshFilePath = "data/mesh_fixed.txt";
     const char* nodeDisplacementsFilePath = "data/nodal_displacements.txt";
+    const char* nodeStressesFilePath = "data/nodal_stresses.txt";
+    const char* sweepResultsFilePath = "data/sweep_results.txt";
+    const char* probeResultsFilePath = "data/probe_results.txt";
+    const char* mirroredMeshFilePath = "data/mesh_mirrored.txt";
+    const char* modesFilePath = "data/modes.txt";
+    const char* frequenciesFilePath = "data/modal_frequencies.txt";
+    const char* scenarioResultsFilePath = "data/scenario_results.txt";
 
     // runtime argument parser
     bool carabiner_open = FALSE;
+    bool half = FALSE;
     double mesh_size = 0.5;
     double vertical_force = 5e6;
     double deformation_factor = 1e0;
     bool aluminium = TRUE;
+    femSolverType solver = FEM_FULL;
+    femPrecision precision = FEM_DOUBLE;
+    bool profile = FALSE;
+    const char* traceFilePath = NULL;
+    double budget = 0.0;
+    bool cache = TRUE;
+    const char* sweepFilePath = NULL;
+    const char* probeFilePath = NULL;
+    bool condense = FALSE;
+    double adapt = 0.0;
+    bool remesh = FALSE;
+    int multigrid = -1;
+    double monitor = -1.0;
+    int nModes = 0;
+    // the closed carabiner is only held in y : K is singular, the modal analysis factorizes K + M
+    double shift = -1.0;
+    const char* scenarioFilePath = NULL;
+    int nWorkers = 0;
 
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--o") == 0) carabiner_open = TRUE;
+        if (strcmp(argv[i], "--half") == 0) half = TRUE;
         if (strcmp(argv[i], "--rough") == 0) mesh_size = 1.0;
         if (strcmp(argv[i], "--medium") == 0) mesh_size = 0.4;
         if (strcmp(argv[i], "--fine") == 0) mesh_size = 0.2;
@@ -42,16 +218,41 @@ int main(int argc, char* argv[]) {
         if (strcmp(argv[i], "--fweak") == 0) vertical_force = 5e3;
         if (strcmp(argv[i], "--steel") == 0) aluminium = FALSE;
         if (strcmp(argv[i], "--amplify") == 0) deformation_factor = 1e3;
+        if (strcmp(argv[i], "--band") == 0) solver = FEM_BAND;
+        if (strcmp(argv[i], "--multigrid") == 0 && i+1 < argc) { solver = FEM_MULTIGRID; multigrid = atoi(argv[++i]); }
+        if (strcmp(argv[i], "--amg") == 0) solver = FEM_MULTIGRID;
+        if (strcmp(argv[i], "--mixed") == 0) precision = FEM_MIXED;
+        if (strcmp(argv[i], "--monitor") == 0 && i+1 < argc) monitor = atof(argv[++i]);
+        if (strcmp(argv[i], "--profile") == 0) profile = TRUE;
+        if (strcmp(argv[i], "--trace") == 0 && i+1 < argc) { profile = TRUE; traceFilePath = argv[++i]; }
+        if (strcmp(argv[i], "--budget") == 0 && i+1 < argc) budget = atof(argv[++i]);
+        if (strcmp(argv[i], "--nocache") == 0) cache = FALSE;
+        if (strcmp(argv[i], "--sweep") == 0 && i+1 < argc) sweepFilePath = argv[++i];
+        if (strcmp(argv[i], "--probe") == 0 && i+1 < argc) probeFilePath = argv[++i];
+        if (strcmp(argv[i], "--condense") == 0) condense = TRUE;
+        if (strcmp(argv[i], "--adapt") == 0 && i+1 < argc) adapt = atof(argv[++i]);
+        if (strcmp(argv[i], "--remesh") == 0) remesh = TRUE;
+        if (strcmp(argv[i], "--modes") == 0 && i+1 < argc) nModes = atoi(argv[++i]);
+        if (strcmp(argv[i], "--shift") == 0 && i+1 < argc) shift = atof(argv[++i]);
+        if (strcmp(argv[i], "--scenarios") == 0 && i+1 < argc) scenarioFilePath = argv[++i];
+        if (strcmp(argv[i], "--workers") == 0 && i+1 < argc) nWorkers = atoi(argv[++i]);
         if (strcmp(argv[i], "--help") == 0) { /* help(); */ exit(0); }
     }
+    if (half && carabiner_open) Error("--half needs the closed carabiner, the open one is not symmetric");
+    if (monitor >= 0.0 && solver != FEM_MULTIGRID) {
+        Warning("--monitor needs an iterative solver (--multigrid or --amg), it is ignored");
+        monitor = -1.0; }
 
     printf("Running parameters:\n");
-    printf("\tCarabiner is %s", (carabiner_open)? "OPEN" : "CLOSED");
+    printf("\tCarabiner is %s", (carabiner_open)? "OPEN" : (half)? "CLOSED (half model)" : "CLOSED");
     printf("\tMesh size: %f \n", mesh_size);
     printf("\tVertical force: %f \n", vertical_force);
     printf("\tDeformation factor: %f \n", deformation_factor);
     printf("\tMaterial: %s", (aluminium)? "Aluminium" : "Steel");
 
+    femProfileEnable(profile, traceFilePath != NULL);
+    femMemorySetBudget((size_t) (budget * 1048576.0));
+
     //
     // PREPROCESSING
     //
@@ -60,23 +261,14 @@ int main(int argc, char* argv[]) {
     femGeo *theGeometry = geoGetGeometry();
     theGeometry->h = mesh_size;
     theGeometry->elementType = FEM_TRIANGLE;
+    carabinerMesh(theGeometry, carabiner_open, half, rawMeshFilePath, fixedMeshFilePath);
 
-    if (carabiner_open == TRUE) geoMeshGenerateOpen();
-    else geoMeshGenerateClosed();
-        
-    geoMeshImport();
-    printf("\n>> Raw mesh summary:\n");
-    printf("\tGlobal Mesh size: %f\n", theGeometry->h);
-    printf("\tNumber of raw nodes: %d", theGeometry->theNodes->nNodes);
-    printf("\tNumber of domains: %d\n", theGeometry->nDomains);
-
-    geoMeshWrite(rawMeshFilePath);
-    printf("\n>> Cleaning up raw mesh data...\n");
-    system(".venv/bin/python src/fixmesh.py data/mesh_raw.txt data/mesh_fixed.txt");
-    printf(">> Done cleaning mesh. New connected mesh at data/mesh_fixed.txt\n");
-
-    geoMeshRead(fixedMeshFilePath);
-    printf("\n>> theGeometry updated with fixed mesh\n");
+    // the gmsh mesh is the coarsest level, the problem is solved on its uniform refinements,
+    // without them the multigrid of the problem is algebraic
+    femMultigrid *theMultigrid = NULL;
+    if (multigrid >= 0) {
+        if (adapt > 0.0) Error("--multigrid cannot be combined with --adapt");
+        theMultigrid = femMultigridCreate(theGeometry, multigrid); }
 
     //
     // DEFINING THE PROBLEM
@@ -87,74 +279,268 @@ int main(int argc, char* argv[]) {
     double rho = (aluminium)? 2.71e3 : 7.85e3;
     double g = -9.81;
 
-    femProblem *theProblem = femElasticityCreate(theGeometry, E, nu, rho, g, PLANAR_STRESS);
-    printf("\n>> theProblem created\n");
-    
-    int numberOfDomains = theProblem->geometry->nDomains;
-    for (int iDom = 0; iDom < numberOfDomains; iDom++) {
-        if (carabiner_open == FALSE && iDom == 12) {
-            geoSetDomainName(iDom, "Bottom Contact Surface");
-            femElasticityAddBoundaryCondition(theProblem, "Bottom Contact Surface", DIRICHLET_Y, 0.0);
-        }
-        if (carabiner_open == FALSE && iDom == 13) {
-            geoSetDomainName(iDom, "Top Contact Surface");
-            femElasticityAddBoundaryCondition(theProblem, "Top Contact Surface", NEUMANN_Y, vertical_force);
-        }
-        if (carabiner_open == TRUE && iDom == 8) {
-            geoSetDomainName(iDom, "Top Contact Surface");
-            femElasticityAddBoundaryCondition(theProblem, "Top Contact Surface", NEUMANN_Y, vertical_force);
-        }
-        if (carabiner_open == TRUE && iDom == 12) {
-            geoSetDomainName(iDom, "Bottom Contact Surface");
-            femElasticityAddBoundaryCondition(theProblem, "Bottom Contact Surface", DIRICHLET_Y, 0.0);
-        }
-    }
-
+    femProblem *theProblem = carabinerProblem(theGeometry, carabiner_open, half, E, nu, rho, g, vertical_force, solver, precision, cache, monitor, nModes > 0, theMultigrid);
     femElasticityPrint(theProblem);
 
     //
     // SOLVING
     //
 
-    int nNodes = theGeometry->theNodes->nNodes;
     printf(">> Solving elasticity problem...\n");
     double *theSoluce = femElasticitySolve(theProblem);
+    // before the nodes are moved by the deformation factor
+    femStress *theStress = femStressCreate(theProblem, 0);
+
+    // adaptive loop until the estimated error meets the target : the marked triangles are bisected and
+    // the previous solution is prolonged on the new nodes, or with --remesh the estimator gives the
+    // size field of a new gmsh mesh and the solution is interpolated on it; either way it is the
+    // starting point of an iterative solver
+    for (int iCycle = 0; adapt > 0.0; iCycle++) {
+        femEstimator *theEstimator = femEstimatorCreate(theStress);
+        printf(">> Adaptive cycle %d : %d nodes, %d elements, estimated error %.2f %%\n", iCycle,
+               theGeometry->theNodes->nNodes, theGeometry->theElements->nElem, 100.0 * theEstimator->eta);
+        if (theEstimator->eta <= adapt || iCycle == MAXADAPT) {
+            femEstimatorFree(theEstimator);
+            break; }
+
+        if (remesh) {
+            femSizeField *theField = femSizeFieldCreate(theEstimator, adapt, mesh_size / 8.0, 1.0);
+            femTransfer *theTransfer = femTransferCreate(theGeometry->theElements, 2, theSoluce);
+            femEstimatorFree(theEstimator);
+            femStressFree(theStress);
+            femElasticityFree(theProblem);
+            geoMeshReset();
+            femSizeFieldUse(theField);
+            carabinerMesh(theGeometry, carabiner_open, half, rawMeshFilePath, fixedMeshFilePath);
+            femSizeFieldFree(theField);
+            theProblem = carabinerProblem(theGeometry, carabiner_open, half, E, nu, rho, g, vertical_force, solver, precision, cache, monitor, nModes > 0, NULL);
+            femTransferWarmStart(theTransfer, theProblem);
+            femTransferFree(theTransfer);
+            theSoluce = femElasticitySolve(theProblem);
+            theStress = femStressCreate(theProblem, 0);
+            continue; }
+
+        int nCoarse = theGeometry->theNodes->nNodes;
+        int *marked = femMalloc(FEM_MEM_POST, sizeof(int) * theGeometry->theElements->nElem);
+        femEstimatorMark(theEstimator, 0.5, marked);
+        double *coarse = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nCoarse);
+        memcpy(coarse, theSoluce, sizeof(double) * 2 * nCoarse);
+        femEstimatorFree(theEstimator);
+        femStressFree(theStress);
+        femElasticityFree(theProblem);
+
+        femRefinement *theRefinement = geoMeshRefineGeo(theGeometry, marked);
+        double *prolonged = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * theRefinement->nNodes);
+        femRefinementProlongate(theRefinement, 2, coarse, prolonged);
+        theProblem = carabinerProblem(theGeometry, carabiner_open, half, E, nu, rho, g, vertical_force, solver, precision, cache, monitor, nModes > 0, NULL);
+        memcpy(theProblem->soluce, prolonged, sizeof(double) * 2 * theRefinement->nNodes);
+        theSoluce = femElasticitySolve(theProblem);
+        theStress = femStressCreate(theProblem, 0);
+        double change = 0.0, uMax = 0.0;
+        for (int i = 0; i < 2 * theRefinement->nNodes; i++) {
+            change = fmax(change, fabs(theSoluce[i] - prolonged[i]));
+            uMax = fmax(uMax, fabs(theSoluce[i])); }
+        printf(">> Displacements changed by %.2f %% on the refined mesh\n", 100.0 * change / uMax);
+        femFree(marked); femFree(coarse); femFree(prolonged);
+        femRefinementFree(theRefinement); }
+
+    int nNodes = theGeometry->theNodes->nNodes;
     printf(">> Solving for forces...\n");
     double *theForces = femElasticityForces(theProblem);
-    double area = femElasticityIntegrate(theProblem, fun);
-
-    femSolutionWrite(nNodes, 2, theSoluce, nodeDisplacementsFilePath);
+    double integrals[2];
+    femIntegrals(theProblem, carabinerIntegrand, theProblem, 2, integrals, 0);
+    double area = integrals[0], energy = integrals[1];
+
+    // with --half, the whole carabiner is mirrored about x = 0 for the output and the viewer,
+    // and the integrals over the half are doubled
+    femGeo *theDisplay = theGeometry;
+    femSymmetry *theSymmetry = NULL;
+    double *displaySoluce = theSoluce, *displayForces = theForces;
+    double *displayStresses = femMalloc(FEM_MEM_POST, sizeof(double) * 6 * nNodes);
+    double symmetry = 1.0;
+    femStressNodal(theStress, displayStresses);
+    if (half) {
+        const double displacementParity[2] = {-1.0, 1.0};
+        const double stressParity[6] = {1.0, 1.0, -1.0, 1.0, 1.0, 1.0};
+        theSymmetry = femSymmetryCreate(theGeometry);
+        theDisplay = theSymmetry->geometry;
+        int nWhole = theSymmetry->nNodes;
+        displaySoluce = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nWhole);
+        displayForces = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nWhole);
+        double *stresses = femMalloc(FEM_MEM_POST, sizeof(double) * 6 * nWhole);
+        femSymmetryMirror(theSymmetry, 2, displacementParity, theSoluce, displaySoluce);
+        femSymmetryMirrorForces(theSymmetry, theForces, displayForces);
+        femSymmetryMirror(theSymmetry, 6, stressParity, displayStresses, stresses);
+        femFree(displayStresses);
+        displayStresses = stresses;
+        geoMeshWriteGeo(theDisplay, mirroredMeshFilePath);
+        symmetry = 2.0; }
+    int nDisplay = theDisplay->theNodes->nNodes;
+
+    femSolutionWrite(nDisplay, 2, displaySoluce, nodeDisplacementsFilePath);
+    femSolutionWrite(nDisplay, 6, displayStresses, nodeStressesFilePath);
+
+    // sensor points "x y" of the file, on the undeformed mesh
+    if (probeFilePath) {
+        FILE *file = fopen(probeFilePath, "r");
+        if (!file) Error("Cannot open the probe file");
+        int nPoints = 0, maxPoints = 1024;
+        double *x = femMalloc(FEM_MEM_POST, sizeof(double) * maxPoints);
+        double *y = femMalloc(FEM_MEM_POST, sizeof(double) * maxPoints);
+        while (fscanf(file, "%le %le", &x[nPoints], &y[nPoints]) == 2) {
+            if (++nPoints < maxPoints) continue;
+            maxPoints *= 2;
+            x = femRealloc(FEM_MEM_POST, x, sizeof(double) * maxPoints);
+            y = femRealloc(FEM_MEM_POST, y, sizeof(double) * maxPoints); }
+        fclose(file);
+        // the half model answers for the mirror image of the points at x < 0
+        double *xProbe = x;
+        if (half) {
+            xProbe = femMalloc(FEM_MEM_POST, sizeof(double) * nPoints);
+            for (int i = 0; i < nPoints; i++) xProbe[i] = fabs(x[i]); }
+        femLocator *theLocator = femLocatorCreate(theGeometry->theElements);
+        double t0 = femProfileTime();
+        femProbe *theProbe = femProbeCreate(theProblem, theLocator, nPoints, xProbe, y);
+        femProbeEvaluate(theProbe);
+        for (int i = 0; half && i < nPoints; i++) {
+            if (x[i] >= 0.0) continue;
+            theProbe->x[i] = x[i];
+            theProbe->U[i] = -theProbe->U[i];
+            theProbe->exy[i] = -theProbe->exy[i];
+            theProbe->sxy[i] = -theProbe->sxy[i]; }
+        if (xProbe != x) femFree(xProbe);
+        printf(" ==== Probes                        : %d points in %.3f ms, written to %s \n", nPoints,
+               1e3 * (femProfileTime() - t0), probeResultsFilePath);
+        femProbeWrite(theProbe, probeResultsFilePath);
+        femProbeFree(theProbe);
+        femLocatorFree(theLocator);
+        femFree(x); femFree(y); }
+
+    // what-if cases "E force" by superposition of the unit load cases, on the factorized system
+    // and the undeformed mesh : the unit cases reassemble their loads on the nodes
+    if (sweepFilePath) {
+        FILE *file = fopen(sweepFilePath, "r");
+        FILE *results = fopen(sweepResultsFilePath, "w");
+        if (!file || !results) Error("Cannot open the sweep files");
+        femSweep *theSweep = femSweepCreate(theProblem);
+        double *work = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nNodes);
+        double *loads = femMalloc(FEM_MEM_POST, sizeof(double) * (theSweep->nLoads + 1));
+        double sweepE, sweepForce, t0 = femProfileTime();
+        int nCases = 0;
+        while (fscanf(file, "%le %le", &sweepE, &sweepForce) == 2) {
+            for (int i = 0; i < theSweep->nLoads; i++) loads[i] = sweepForce;
+            double uMax = femSweepMaxDisplacement(theSweep, loads, rho * g, sweepE, work);
+            fprintf(results, "%14.7e %14.7e %14.7e\n", sweepE, sweepForce, uMax);
+            nCases++; }
+        printf(" ==== Sweep                         : %d cases in %.3f ms, written to %s \n", nCases,
+               1e3 * (femProfileTime() - t0), sweepResultsFilePath);
+        femFree(work); femFree(loads);
+        femSweepFree(theSweep);
+        fclose(file); fclose(results); }
+
+    // the scenarios only read the mesh, which they share : before the nodes are moved
+    if (scenarioFilePath)
+        carabinerScenarios(theProblem, scenarioFilePath, scenarioResultsFilePath, nWorkers);
+
+    // superelement on the contact surfaces : an extra 10% of the force on the top surface
+    // answered on the retained dofs, then recovered on the whole mesh, all on the undeformed mesh
+    if (condense) {
+        char *contactSurfaces[2] = {"Top Contact Surface", "Bottom Contact Surface"};
+        femSuperelement *theSuper = femSuperelementCreate(theProblem, 2, contactSurfaces);
+        double *loads = femMalloc(FEM_MEM_POST, sizeof(double) * (theSuper->nDofs + 1));
+        double *displacements = femMalloc(FEM_MEM_POST, sizeof(double) * (theSuper->nDofs + 1));
+        double *recovered = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nNodes);
+        for (int i = 0; i < theSuper->nDofs; i++) loads[i] = 0.0;
+        femSuperelementTraction(theSuper, "Top Contact Surface", NEUMANN_Y, 0.1 * vertical_force, loads);
+        int nQueries = 1000;
+        double t0 = femProfileTime();
+        for (int k = 0; k < nQueries; k++) femSuperelementSolve(theSuper, loads, displacements);
+        double tQuery = (femProfileTime() - t0) / nQueries;
+        t0 = femProfileTime();
+        femSuperelementRecover(theSuper, loads, recovered);
+        double tRecover = femProfileTime() - t0;
+        double uMax = 0.0;
+        for (int i = 0; i < nNodes; i++)
+            uMax = fmax(uMax, sqrt(recovered[2*i]*recovered[2*i] + recovered[2*i+1]*recovered[2*i+1]));
+        printf(" ==== Condensed query               : %d dofs, %.3f us per query, recovery %.3f ms \n",
+               theSuper->nDofs, 1e6 * tQuery, 1e3 * tRecover);
+        printf(" ==== Maximum displacement (+10%%)   : %14.7e [m] \n", uMax);
+        femFree(loads); femFree(displacements); femFree(recovered);
+        femSuperelementFree(theSuper); }
+
+    // lowest natural frequencies by shift-invert Lanczos on the factorization of K - shift M (that of
+    // the static solve for a shift at zero), the rigid body modes are dropped, the modes are stored
+    // node by node (u1 v1 u2 v2 ...), mirrored like the displacements with --half
+    femModal *theModal = NULL;
+    double *displayModes = NULL;
+    if (nModes > 0) {
+        const double displacementParity[2] = {-1.0, 1.0};
+        theModal = femModalCreate(theProblem, nModes, 1e-8, shift);
+        nModes = theModal->nModes;
+        for (int k = 0; k < nModes; k++)
+            printf(" ==== Natural frequency %2d          : %14.7e [Hz] \n", k+1, theModal->frequencies[k]);
+        displayModes = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nModes * nDisplay);
+        double *mode = femMalloc(FEM_MEM_POST, sizeof(double) * 2 * nDisplay);
+        for (int k = 0; k < nModes; k++) {
+            if (half) femSymmetryMirror(theSymmetry, 2, displacementParity, &theModal->modes[k*2*nNodes], mode);
+            else memcpy(mode, &theModal->modes[k*2*nNodes], sizeof(double) * 2 * nNodes);
+            for (int i = 0; i < nDisplay; i++) {
+                displayModes[i*2*nModes + 2*k]   = mode[2*i];
+                displayModes[i*2*nModes + 2*k+1] = mode[2*i+1]; }}
+        femFree(mode);
+        femSolutionWrite(nModes, 1, theModal->frequencies, frequenciesFilePath);
+        femSolutionWrite(nDisplay, 2 * nModes, displayModes, modesFilePath); }
 
     //
     // POSTPROCESSING
     //
 
-    femNodes *theNodes = theGeometry->theNodes;
-    double *normDisplacement = malloc(theNodes->nNodes * sizeof(double));
-    double *forcesX = malloc(theNodes->nNodes * sizeof(double));
-    double *forcesY = malloc(theNodes->nNodes * sizeof(double));
+    femNodes *theNodes = theDisplay->theNodes;
+    double *normDisplacement = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+    double *forcesX = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+    double *forcesY = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+    double *vonMises = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+#ifndef FEM_HEADLESS
+    // the modes are animated on the undeformed mesh
+    double *restX = NULL, *restY = NULL, *modeX = NULL, *modeY = NULL, *modeNorm = NULL;
+    if (nModes > 0) {
+        restX = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+        restY = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+        modeX = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+        modeY = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+        modeNorm = femMalloc(FEM_MEM_POST, theNodes->nNodes * sizeof(double));
+        memcpy(restX, theNodes->X, theNodes->nNodes * sizeof(double));
+        memcpy(restY, theNodes->Y, theNodes->nNodes * sizeof(double)); }
+#endif
 
     for (int i=0; i<theNodes->nNodes; i++){
-        theNodes->X[i] += theSoluce[2*i]*deformation_factor;
-        theNodes->Y[i] += theSoluce[2*i+1]*deformation_factor;
-        normDisplacement[i] = sqrt(theSoluce[2*i]*theSoluce[2*i] + theSoluce[2*i+1]*theSoluce[2*i+1]);
-        forcesX[i] = theForces[2*i];
-        forcesY[i] = theForces[2*i+1];
+        theNodes->X[i] += displaySoluce[2*i]*deformation_factor;
+        theNodes->Y[i] += displaySoluce[2*i+1]*deformation_factor;
+        normDisplacement[i] = sqrt(displaySoluce[2*i]*displaySoluce[2*i] + displaySoluce[2*i+1]*displaySoluce[2*i+1]);
+        forcesX[i] = displayForces[2*i];
+        forcesY[i] = displayForces[2*i+1];
+        vonMises[i] = displayStresses[6*i+3];
     }
+    // the nodes of the problem have moved (with --half, those of the mirrored copy only)
+    if (theDisplay == theGeometry) femElasticityInvalidateFactors(theProblem);
 
     printf(" ==== Deformation Factor            : %14.7e \n",deformation_factor);
-    printf(" ==== Minimum displacement          : %14.7e [m] \n",femMin(normDisplacement,nNodes));
-    printf(" ==== Maximum displacement          : %14.7e [m] \n",femMax(normDisplacement,nNodes));
+    printf(" ==== Minimum displacement          : %14.7e [m] \n",femMin(normDisplacement,nDisplay));
+    printf(" ==== Maximum displacement          : %14.7e [m] \n",femMax(normDisplacement,nDisplay));
 
     double theGlobalForce[2] = {0, 0};
-    for (int i=0; i<nNodes; i++) {
-        theGlobalForce[0] += theForces[2*i];
-        theGlobalForce[1] += theForces[2*i+1]; }
+    for (int i=0; i<nDisplay; i++) {
+        theGlobalForce[0] += displayForces[2*i];
+        theGlobalForce[1] += displayForces[2*i+1]; }
     printf(" ==== Global horizontal force       : %14.7e [N] \n",theGlobalForce[0]);
     printf(" ==== Global vertical force         : %14.7e [N] \n",theGlobalForce[1]);
-    printf(" ==== Weight                        : %14.7e [N] \n", area * 0.01 * rho * g);
+    printf(" ==== Weight                        : %14.7e [N] \n", symmetry * area * 0.01 * rho * g);
+    printf(" ==== Strain energy                 : %14.7e [J/m] \n", symmetry * energy);
+    printf(" ==== Maximum von Mises stress      : %14.7e [Pa] \n", femStressMaxVonMises(theStress));
+    printf(" ==== Minimum principal stress      : %14.7e [Pa] \n", femMin(theStress->s2, theStress->nElem));
 
-    int mode = 1, domain = 0, freezingButton = FALSE;
+#ifndef FEM_HEADLESS
+    int mode = 1, domain = 0, iMode = -1, freezingButton = FALSE;
     double t, told = 0;
     char theMessage[MAXNAME];
    
@@ -164,27 +550,31 @@ int main(int argc, char* argv[]) {
     do {
         int w,h;
         glfwGetFramebufferSize(window,&w,&h);
-        glfemReshapeWindows(theGeometry->theNodes,w,h);
+        glfemReshapeWindows(theDisplay->theNodes,w,h);
 
+        femProfileBegin(FEM_PHASE_RENDER);
         t = glfwGetTime();  
         if (glfwGetKey(window,'D') == GLFW_PRESS) mode = 0;
         if (glfwGetKey(window,'V') == GLFW_PRESS) mode = 1;
         if (glfwGetKey(window,'X') == GLFW_PRESS) mode = 2;
         if (glfwGetKey(window,'Y') == GLFW_PRESS) mode = 3;
+        if (glfwGetKey(window,'S') == GLFW_PRESS) mode = 4;
         if (glfwGetKey(window,'N') == GLFW_PRESS && freezingButton == FALSE) {
             domain++; freezingButton = TRUE; told = t; }
+        if (glfwGetKey(window,'M') == GLFW_PRESS && freezingButton == FALSE && nModes > 0) {
+            mode = 5; iMode = (iMode + 1) % nModes; freezingButton = TRUE; told = t; }
         if (t - told > 0.5) freezingButton = FALSE;
 
         if (mode == 0) {
-            domain = domain % theGeometry->nDomains;
-            glfemPlotDomain(theGeometry->theDomains[domain]); 
-            sprintf(theMessage, "%s : %d ", theGeometry->theDomains[domain]->name, domain);
+            domain = domain % theDisplay->nDomains;
+            glfemPlotDomain(theDisplay->theDomains[domain]); 
+            sprintf(theMessage, "%s : %d ", theDisplay->theDomains[domain]->name, domain);
             glColor3f(1.0,0.0,0.0); glfemMessage(theMessage);
         }
         if (mode == 1) {
-            glfemPlotField(theGeometry->theElements, normDisplacement);
-            glfemPlotMesh(theGeometry->theElements); 
-            sprintf(theMessage, "Number of elements : %d ", theGeometry->theElements->nElem);
+            glfemPlotField(theDisplay->theElements, normDisplacement);
+            glfemPlotMesh(theDisplay->theElements); 
+            sprintf(theMessage, "Number of elements : %d ", theDisplay->theElements->nElem);
             glColor3f(1.0,0.0,0.0); glfemMessage(theMessage);
             double uMin = femMin(normDisplacement, theNodes->nNodes);
             double uMax = femMax(normDisplacement, theNodes->nNodes);
@@ -192,27 +582,70 @@ int main(int argc, char* argv[]) {
 
         }
         if (mode == 2) {
-            glfemPlotField(theGeometry->theElements, forcesX);
-            glfemPlotMesh(theGeometry->theElements); 
-            sprintf(theMessage, "Number of elements : %d ", theGeometry->theElements->nElem);
+            glfemPlotField(theDisplay->theElements, forcesX);
+            glfemPlotMesh(theDisplay->theElements); 
+            sprintf(theMessage, "Number of elements : %d ", theDisplay->theElements->nElem);
             glColor3f(1.0,0.0,0.0); glfemMessage(theMessage);
         }
         if (mode == 3) {
-            glfemPlotField(theGeometry->theElements, forcesY);
-            glfemPlotMesh(theGeometry->theElements); 
-            sprintf(theMessage, "Number of elements : %d ", theGeometry->theElements->nElem);
+            glfemPlotField(theDisplay->theElements, forcesY);
+            glfemPlotMesh(theDisplay->theElements); 
+            sprintf(theMessage, "Number of elements : %d ", theDisplay->theElements->nElem);
+            glColor3f(1.0,0.0,0.0); glfemMessage(theMessage);
+        }
+        if (mode == 4) {
+            glfemPlotField(theDisplay->theElements, vonMises);
+            glfemPlotMesh(theDisplay->theElements); 
+            sprintf(theMessage, "Von Mises stress [Pa] ");
+            glColor3f(1.0,0.0,0.0); glfemMessage(theMessage);
+            glfemDrawColorBar(femMin(vonMises, nDisplay), femMax(vonMises, nDisplay));
+        }
+        if (mode == 5) {
+            // oscillation of the mode at 1 Hz, its largest displacement a tenth of the height
+            double height = femMax(restY, nDisplay) - femMin(restY, nDisplay), amplitude = 0.0;
+            for (int i = 0; i < nDisplay; i++) {
+                double u = displayModes[i*2*nModes + 2*iMode], v = displayModes[i*2*nModes + 2*iMode+1];
+                modeNorm[i] = sqrt(u*u + v*v);
+                amplitude = fmax(amplitude, modeNorm[i]); }
+            double scale = 0.1 * height / amplitude * sin(2.0 * M_PI * t);
+            for (int i = 0; i < nDisplay; i++) {
+                modeX[i] = restX[i] + scale * displayModes[i*2*nModes + 2*iMode];
+                modeY[i] = restY[i] + scale * displayModes[i*2*nModes + 2*iMode+1]; }
+            double *X = theNodes->X, *Y = theNodes->Y;
+            theNodes->X = modeX; theNodes->Y = modeY;
+            glfemPlotField(theDisplay->theElements, modeNorm);
+            glfemPlotMesh(theDisplay->theElements);
+            theNodes->X = X; theNodes->Y = Y;
+            sprintf(theMessage, "Mode %d : %.2f Hz ", iMode + 1, theModal->frequencies[iMode]);
             glColor3f(1.0,0.0,0.0); glfemMessage(theMessage);
         }
 
         glfwSwapBuffers(window);
+        femProfileEnd(FEM_PHASE_RENDER);
         glfwPollEvents();
 
     } while( glfwGetKey(window,GLFW_KEY_ESCAPE) != GLFW_PRESS &&
              glfwWindowShouldClose(window) != 1 );
-
-    free(normDisplacement); free(forcesX); free(forcesY);
+    glfwTerminate();
+    if (nModes > 0) {
+        femFree(restX); femFree(restY); femFree(modeX); femFree(modeY); femFree(modeNorm); }
+#endif
+
+    femProfileReport(stdout);
+    if (traceFilePath) femProfileWriteTrace(traceFilePath);
+
+    femFree(normDisplacement); femFree(forcesX); femFree(forcesY); femFree(vonMises);
+    femFree(displayStresses);
+    if (theModal) {
+        femFree(displayModes);
+        femModalFree(theModal); }
+    if (theSymmetry) {
+        femFree(displaySoluce); femFree(displayForces);
+        femSymmetryFree(theSymmetry); }
+    femStressFree(theStress);
     femElasticityFree(theProblem); 
-    geoFinalize(); glfwTerminate(); 
+    geoFinalize();
+    femMemoryReport(stdout);
     exit(EXIT_SUCCESS);
     return 0;
 }
@@ -221,6 +654,7 @@ void help(void) {
     printf("Acceptable flags: \n");
     printf("\tGeometry options:\n");
     printf("\t\t--o : simulates an opened carabiner\n");
+    printf("\t\t--half : solves the right half of the closed carabiner, mirrored for the output and the viewer\n");
     printf("\t\tDefault is closed\n");
     printf("\tMesh options:\n");
     printf("\t\t--rough : sets global mesh size to 1.0\n");
@@ -238,4 +672,34 @@ void help(void) {
     printf("\tVisualisation options:\n");
     printf("\t\t--amplify : sets displacement amplification factor to 1e3\n");
     printf("\t\tDefault is 1\n");
+    printf("\tSolver options:\n");
+    printf("\t\t--band : band solver on nodes renumbered along y\n");
+    printf("\t\t--multigrid L : CG with a multigrid preconditioner on L bisections of the mesh (2 levels halve h)\n");
+    printf("\t\t--amg : CG with a smoothed aggregation multigrid preconditioner on the mesh itself\n");
+    printf("\t\t--mixed : single precision factorization refined to double accuracy (full and band solvers)\n");
+    printf("\t\t--monitor tol : with --multigrid or --amg, prints each iteration and stops once the displacement\n");
+    printf("\t\t                of the load point and the support reaction change by less than tol (0 : never)\n");
+    printf("\t\tDefault is the full system\n");
+    printf("\tAdaptivity options:\n");
+    printf("\t\t--adapt eta : refines the triangles of largest estimated error until a relative error eta (e.g. 0.05)\n");
+    printf("\t\t--remesh : with --adapt, a new gmsh mesh from the size field instead of bisections\n");
+    printf("\tProfiling options:\n");
+    printf("\t\t--profile : prints wall time, allocations and flops of each phase at exit\n");
+    printf("\t\t--trace file.json : same, and writes a Chrome trace of every phase\n");
+    printf("\tSweep options:\n");
+    printf("\t\t--sweep cases.txt : lines 'E force' solved by superposition, umax in data/sweep_results.txt\n");
+    printf("\t\t--condense : superelement on the contact surfaces, timing of a load query\n");
+    printf("\t\t--scenarios cases.txt : lines 'E force solver' (full, band or amg), each solved on its own by a\n");
+    printf("\t\t                        pool of workers sharing the mesh, umax in data/scenario_results.txt\n");
+    printf("\t\t--workers n : threads of --scenarios, default the number of processors\n");
+    printf("\t\t--probe points.txt : lines 'x y', displacements, strains and stresses in data/probe_results.txt\n");
+    printf("\tModal options:\n");
+    printf("\t\t--modes k : k lowest natural frequencies in data/modal_frequencies.txt, modes in data/modes.txt\n");
+    printf("\t\t            (key M in the viewer cycles through them, only the symmetric ones with --half)\n");
+    printf("\t\t--shift s : factorizes K - s M for the modes [rad2/s2], below the lowest eigenvalue, default -1\n");
+    printf("\t\t            (0 reuses the static factorization when the conditions hold the model in x and y)\n");
+    printf("\tMemory options:\n");
+    printf("\t\t--budget MB : refuses (or moves to the band solver) a system that does not fit\n");
+    printf("\t\tDefault is the physical memory\n");
+    printf("\t\t--nocache : recomputes the element jacobians and gradients in each pass instead of keeping them\n");
 }
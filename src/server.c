@@ -0,0 +1,414 @@
+/*
+*
+*   SOLVER DAEMON : KEEPS MESHES AND FACTORIZED SYSTEMS WARM BETWEEN REQUESTS
+*
+*   One request per line, on stdin/stdout or on a local unix socket (--socket path).
+*
+*     mesh <name> <file>                       read a mesh file and keep it
+*     domain <mesh> <index> <name>             name a domain of a mesh
+*     solve <mesh> [E=] [nu=] [rho=] [g=] [case=stress|strain|axisym] [output=summary|displacements]
+*           ; dirichlet <x|y> <value> <domain> ; neumann <x|y> <value> <domain> ; ...
+*     stats                                    list what is kept in memory
+*     quit                                     close the connection (shutdown stops the daemon)
+*
+*   The factorization is keyed on (mesh, E, nu, case, dirichlet conditions) : a solve that
+*   only changes the neumann loads, rho or g reuses it and costs a couple of substitutions.
+*
+*   The library stops the program on a malformed mesh or a system above the memory budget
+*   (--budget MB) : both are checked here first and answered with an error line.
+*
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../headers/fem.h"
+#include "../headers/femRunner.h"
+
+#define MAXMESHES 16
+#define MAXSYSTEMS 8
+#define MAXLINE 4096
+
+typedef struct {
+    char name[MAXNAME];
+    femGeo *geometry;
+} femServerMesh;
+
+typedef struct {
+    femServerMesh *mesh;
+    double E, nu;
+    femElasticCase iCase;
+    int nDirichlet;
+    femScenarioCondition dirichlet[MAXSCENARIOBC];
+    femProblem *problem;
+    long lastUse;
+} femServerSystem;
+
+static femServerMesh theMeshes[MAXMESHES];
+static int nMeshes = 0;
+static femServerSystem theSystems[MAXSYSTEMS];
+static int nSystems = 0;
+static long theClock = 0;
+static int shutdownRequested = FALSE;
+
+
+static double serverTime(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static femServerMesh *serverFindMesh(char *name) {
+    for (int i = 0; i < nMeshes; i++)
+        if (strcmp(theMeshes[i].name, name) == 0) return &theMeshes[i];
+    return NULL;
+}
+
+// frees the least recently used system
+static void serverEvict(void) {
+    int iOldest = 0;
+    for (int i = 1; i < nSystems; i++)
+        if (theSystems[i].lastUse < theSystems[iOldest].lastUse) iOldest = i;
+    femElasticityFree(theSystems[iOldest].problem);
+    theSystems[iOldest] = theSystems[--nSystems];
+}
+
+static void serverDropSystems(femServerMesh *theMesh) {
+    for (int i = 0; i < nSystems; i++) {
+        if (theSystems[i].mesh != theMesh) continue;
+        femElasticityFree(theSystems[i].problem);
+        theSystems[i--] = theSystems[--nSystems]; }
+}
+
+static int serverSameDirichlet(femServerSystem *theSystem, femScenarioCondition *dirichlet, int nDirichlet) {
+    if (theSystem->nDirichlet != nDirichlet) return FALSE;
+    for (int i = 0; i < nDirichlet; i++) {
+        if (theSystem->dirichlet[i].type != dirichlet[i].type ||
+            theSystem->dirichlet[i].value != dirichlet[i].value ||
+            strcmp(theSystem->dirichlet[i].domain, dirichlet[i].domain) != 0) return FALSE; }
+    return TRUE;
+}
+
+// returns the cached system for this key, or builds it (evicting the least recently used ones
+// to make room), NULL with an error line when it cannot fit in the memory budget
+static femServerSystem *serverGetSystem(FILE *out, femServerMesh *theMesh, double E, double nu, femElasticCase iCase,
+                                        femScenarioCondition *dirichlet, int nDirichlet, int *cached) {
+    for (int i = 0; i < nSystems; i++) {
+        femServerSystem *theSystem = &theSystems[i];
+        if (theSystem->mesh == theMesh && theSystem->E == E && theSystem->nu == nu && theSystem->iCase == iCase
+                && serverSameDirichlet(theSystem, dirichlet, nDirichlet)) {
+            theSystem->lastUse = ++theClock;
+            *cached = TRUE;
+            return theSystem; }}
+
+    femGeo *theGeometry = theMesh->geometry;
+    double width  = femMax(theGeometry->theNodes->X, theGeometry->theNodes->nNodes) - femMin(theGeometry->theNodes->X, theGeometry->theNodes->nNodes);
+    double height = femMax(theGeometry->theNodes->Y, theGeometry->theNodes->nNodes) - femMin(theGeometry->theNodes->Y, theGeometry->theNodes->nNodes);
+    femRenumType renumType = (height > width) ? FEM_YNUM : FEM_XNUM;
+
+    // femElasticityCreateSolver exits on a system above the budget : the prediction is made here
+    femScenario theScenario;
+    femScenarioInit(&theScenario, theGeometry, E, nu, 0.0, 0.0, iCase);
+    femScenarioSetSolver(&theScenario, FEM_BAND, renumType);
+    size_t bytes = femScenarioMemory(&theScenario);
+    if (bytes <= femMemoryBudget())
+        while (nSystems > 0 && !femMemoryFits(bytes)) serverEvict();
+    if (!femMemoryFits(bytes)) {
+        fprintf(out, "error the system needs %.1f MB, more than the memory budget (%.1f MB, %.1f MB in use)\n",
+                bytes / 1048576.0, femMemoryBudget() / 1048576.0, femMemoryCurrent() / 1048576.0);
+        return NULL; }
+
+    if (nSystems == MAXSYSTEMS) serverEvict();
+    femServerSystem *theSystem = &theSystems[nSystems++];
+
+    theSystem->mesh = theMesh;
+    theSystem->E = E;
+    theSystem->nu = nu;
+    theSystem->iCase = iCase;
+    theSystem->nDirichlet = nDirichlet;
+    memcpy(theSystem->dirichlet, dirichlet, sizeof(femScenarioCondition) * nDirichlet);
+    theSystem->problem = femElasticityCreateSolver(theGeometry, E, nu, 0.0, 0.0, iCase, FEM_BAND, renumType);
+    for (int i = 0; i < nDirichlet; i++)
+        femElasticityAddBoundaryCondition(theSystem->problem, dirichlet[i].domain, dirichlet[i].type, dirichlet[i].value);
+    femElasticityFactorize(theSystem->problem);
+    theSystem->lastUse = ++theClock;
+    *cached = FALSE;
+    return theSystem;
+}
+
+
+/*
+*   REQUEST HANDLERS
+*/
+
+// walks through a mesh file as geoMeshReadGeo reads it, without keeping anything :
+// returns what is wrong with it, NULL when it can be read
+static const char *serverScanMesh(FILE *file) {
+    int nNodes, nEdges, nElem, nDomains, nLocalNode, trash, node[4];
+    double x, y;
+    char elementType[MAXNAME], name[MAXNAME];
+    if (fscanf(file, "Number of nodes %d \n", &nNodes) != 1 || nNodes <= 0) return "no node";
+    for (int i = 0; i < nNodes; i++)
+        if (fscanf(file, "%d : %le %le \n", &trash, &x, &y) != 3) return "truncated node list";
+    if (fscanf(file, "Number of edges %d \n", &nEdges) != 1 || nEdges < 0) return "no edge count";
+    for (int i = 0; i < nEdges; i++) {
+        if (fscanf(file, "%d : %d %d \n", &trash, &node[0], &node[1]) != 3) return "truncated edge list";
+        if (node[0] < 0 || node[0] >= nNodes || node[1] < 0 || node[1] >= nNodes) return "edge with an illegal node"; }
+    if (fscanf(file, "Number of %255s %d \n", elementType, &nElem) != 2 || nElem <= 0) return "no element";
+    if      (strcasecmp(elementType, "triangles") == 0) nLocalNode = 3;
+    else if (strcasecmp(elementType, "quads") == 0)     nLocalNode = 4;
+    else return "unknown element type";
+    for (int i = 0; i < nElem; i++) {
+        if (fscanf(file, "%d :", &trash) != 1) return "truncated element list";
+        for (int j = 0; j < nLocalNode; j++) {
+            if (fscanf(file, "%d", &node[j]) != 1) return "truncated element list";
+            if (node[j] < 0 || node[j] >= nNodes) return "element with an illegal node"; }}
+    if (fscanf(file, " Number of domains %d \n", &nDomains) != 1 || nDomains < 0) return "no domain count";
+    for (int iDomain = 0; iDomain < nDomains; iDomain++) {
+        if (fscanf(file, " Domain : %d \n", &trash) != 1 || fscanf(file, " Name : %255[^\n]\n", name) != 1
+                || fscanf(file, " Number of elements : %d \n", &nElem) != 1 || nElem < 0) return "truncated domain";
+        for (int i = 0; i < nElem; i++) {
+            if (fscanf(file, "%d", &node[0]) != 1) return "truncated domain";
+            if (node[0] < 0 || node[0] >= nEdges) return "domain with an illegal edge"; }}
+    return NULL;
+}
+
+static void serverMesh(FILE *out, char *args) {
+    char name[MAXNAME], filename[MAXNAME];
+    if (sscanf(args, "%255s %255s", name, filename) != 2) {
+        fprintf(out, "error usage : mesh <name> <file>\n"); return; }
+    // geoMeshReadGeo exits on a malformed file : it is checked first, a mesh it replaces is kept on error
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        fprintf(out, "error cannot open %s\n", filename); return; }
+    const char *problem = serverScanMesh(file);
+    fclose(file);
+    if (problem) {
+        fprintf(out, "error cannot read %s : %s\n", filename, problem); return; }
+
+    femServerMesh *theMesh = serverFindMesh(name);
+    if (theMesh) {
+        serverDropSystems(theMesh);
+        geoFinalizeGeo(theMesh->geometry); }
+    else {
+        if (nMeshes == MAXMESHES) {
+            fprintf(out, "error too many meshes\n"); return; }
+        theMesh = &theMeshes[nMeshes++];
+        snprintf(theMesh->name, MAXNAME, "%s", name);
+        theMesh->geometry = geoCreate(); }
+
+    double t0 = serverTime();
+    geoMeshReadGeo(theMesh->geometry, filename);
+    fprintf(out, "ok mesh %s nodes=%d elements=%d domains=%d time=%.3fms\n", name,
+            theMesh->geometry->theNodes->nNodes, theMesh->geometry->theElements->nElem,
+            theMesh->geometry->nDomains, 1e3 * (serverTime() - t0));
+}
+
+static void serverDomain(FILE *out, char *args) {
+    char name[MAXNAME], domain[MAXNAME];
+    int iDomain, n = 0;
+    if (sscanf(args, "%255s %d %n", name, &iDomain, &n) != 2 || n == 0) {
+        fprintf(out, "error usage : domain <mesh> <index> <name>\n"); return; }
+    snprintf(domain, MAXNAME, "%s", args + n);
+    trim(domain);
+    femServerMesh *theMesh = serverFindMesh(name);
+    if (!theMesh) {
+        fprintf(out, "error unknown mesh %s\n", name); return; }
+    if (iDomain < 0 || iDomain >= theMesh->geometry->nDomains) {
+        fprintf(out, "error illegal domain number %d\n", iDomain); return; }
+    int iOther = geoGetDomainGeo(theMesh->geometry, domain);
+    if (iOther != -1 && iOther != iDomain) {
+        fprintf(out, "error name already used by domain %d\n", iOther); return; }
+    serverDropSystems(theMesh);
+    snprintf(theMesh->geometry->theDomains[iDomain]->name, MAXNAME, "%s", domain);
+    fprintf(out, "ok domain %d %s\n", iDomain, domain);
+}
+
+// parses "<dirichlet|neumann> <x|y> <value> <domain name>"
+static int serverCondition(FILE *out, femGeo *theGeometry, char *segment, femScenarioCondition *theCondition, int *isDirichlet) {
+    char kind[32], axis[8];
+    double value;
+    int n = 0;
+    if (sscanf(segment, " %31s %7s %lf %n", kind, axis, &value, &n) != 3 || n == 0) {
+        fprintf(out, "error cannot parse condition '%s'\n", segment); return FALSE; }
+    int y = (strcasecmp(axis, "y") == 0);
+    if (!y && strcasecmp(axis, "x") != 0) {
+        fprintf(out, "error axis must be x or y\n"); return FALSE; }
+    if (strcasecmp(kind, "dirichlet") == 0) {
+        *isDirichlet = TRUE;
+        theCondition->type = y ? DIRICHLET_Y : DIRICHLET_X; }
+    else if (strcasecmp(kind, "neumann") == 0) {
+        *isDirichlet = FALSE;
+        theCondition->type = y ? NEUMANN_Y : NEUMANN_X; }
+    else {
+        fprintf(out, "error unknown condition %s\n", kind); return FALSE; }
+    theCondition->value = value;
+    snprintf(theCondition->domain, MAXNAME, "%s", segment + n);
+    trim(theCondition->domain);
+    if (geoGetDomainGeo(theGeometry, theCondition->domain) == -1) {
+        fprintf(out, "error undefined domain '%s'\n", theCondition->domain); return FALSE; }
+    return TRUE;
+}
+
+static void serverSolve(FILE *out, char *line) {
+    double t0 = serverTime();
+    char *segment = line;
+    char *rest = strchr(line, ';');
+    if (rest) *rest++ = '\0';
+    char name[MAXNAME];
+    int n = 0;
+    if (sscanf(segment, "%255s %n", name, &n) != 1) {
+        fprintf(out, "error usage : solve <mesh> [key=value ...] ; <conditions>\n"); return; }
+    femServerMesh *theMesh = serverFindMesh(name);
+    if (!theMesh) {
+        fprintf(out, "error unknown mesh %s\n", name); return; }
+
+    double E = 68e9, nu = 0.32, rho = 2.71e3, g = -9.81;
+    femElasticCase iCase = PLANAR_STRESS;
+    int displacements = FALSE;
+    char *option = strtok(segment + n, " \t");
+    while (option) {
+        char value[MAXNAME];
+        if      (sscanf(option, "E=%lf", &E) == 1) ;
+        else if (sscanf(option, "nu=%lf", &nu) == 1) ;
+        else if (sscanf(option, "rho=%lf", &rho) == 1) ;
+        else if (sscanf(option, "g=%lf", &g) == 1) ;
+        else if (sscanf(option, "case=%255s", value) == 1 && strcmp(value, "stress") == 0) iCase = PLANAR_STRESS;
+        else if (sscanf(option, "case=%255s", value) == 1 && strcmp(value, "strain") == 0) iCase = PLANAR_STRAIN;
+        else if (sscanf(option, "case=%255s", value) == 1 && strcmp(value, "axisym") == 0) iCase = AXISYM;
+        else if (strcmp(option, "output=summary") == 0) displacements = FALSE;
+        else if (strcmp(option, "output=displacements") == 0) displacements = TRUE;
+        else {
+            fprintf(out, "error unknown option %s\n", option); return; }
+        option = strtok(NULL, " \t"); }
+
+    // each remaining segment is one boundary condition
+    femScenarioCondition dirichlet[MAXSCENARIOBC], neumann[MAXSCENARIOBC];
+    int nDirichlet = 0, nNeumann = 0;
+    while (rest) {
+        char *next = strchr(rest, ';');
+        if (next) *next = '\0';
+        femScenarioCondition theCondition;
+        int isDirichlet;
+        if (!serverCondition(out, theMesh->geometry, rest, &theCondition, &isDirichlet)) return;
+        if ((isDirichlet ? nDirichlet : nNeumann) == MAXSCENARIOBC) {
+            fprintf(out, "error too many conditions\n"); return; }
+        if (isDirichlet) dirichlet[nDirichlet++] = theCondition;
+        else neumann[nNeumann++] = theCondition;
+        if (!next) break;
+        rest = next + 1; }
+    if (nDirichlet == 0) {
+        fprintf(out, "error at least one dirichlet condition is needed\n"); return; }
+
+    int cached;
+    femServerSystem *theSystem = serverGetSystem(out, theMesh, E, nu, iCase, dirichlet, nDirichlet, &cached);
+    if (!theSystem) return;
+    femProblem *theProblem = theSystem->problem;
+
+    // only the loads change : drop the neumann conditions of the previous request, their slots are reused
+    theProblem->nBoundaryConditions = theSystem->nDirichlet;
+    for (int i = 0; i < nNeumann; i++)
+        femElasticityAddBoundaryCondition(theProblem, neumann[i].domain, neumann[i].type, neumann[i].value);
+    theProblem->rho = rho;
+    theProblem->g = g;
+
+    double *theSoluce = femElasticitySolveFactorized(theProblem);
+    double *theForces = femElasticityForces(theProblem);
+    int nNodes = theMesh->geometry->theNodes->nNodes;
+    double uMax = 0.0, force[2] = {0.0, 0.0};
+    for (int i = 0; i < nNodes; i++) {
+        uMax = fmax(uMax, sqrt(theSoluce[2*i]*theSoluce[2*i] + theSoluce[2*i+1]*theSoluce[2*i+1]));
+        force[0] += theForces[2*i];
+        force[1] += theForces[2*i+1]; }
+
+    fprintf(out, "ok solve %s umax=%.7e fx=%.7e fy=%.7e time=%.3fms\n", cached ? "cached" : "factorized",
+            uMax, force[0], force[1], 1e3 * (serverTime() - t0));
+    if (displacements) {
+        fprintf(out, "nodes %d\n", nNodes);
+        for (int i = 0; i < nNodes; i++)
+            fprintf(out, "%.18le %.18le\n", theSoluce[2*i], theSoluce[2*i+1]); }
+}
+
+static void serverStats(FILE *out) {
+    fprintf(out, "ok stats meshes=%d systems=%d memory=%zu peak=%zu\n", nMeshes, nSystems,
+            femMemoryCurrent(), femMemoryPeak());
+    for (int i = 0; i < nMeshes; i++)
+        fprintf(out, "mesh %s nodes=%d\n", theMeshes[i].name, theMeshes[i].geometry->theNodes->nNodes);
+    for (int i = 0; i < nSystems; i++) {
+        femBandSystem *theBand = theSystems[i].problem->bandSystem;
+        fprintf(out, "system %s E=%.7e nu=%.7e dirichlet=%d size=%d band=%d bytes=%zu\n", theSystems[i].mesh->name,
+                theSystems[i].E, theSystems[i].nu, theSystems[i].nDirichlet, theBand->size, theBand->band,
+                femSystemMemory(FEM_BAND, theBand->size, theBand->band)); }
+}
+
+static void serverServe(FILE *in, FILE *out) {
+    char line[MAXLINE];
+    while (!shutdownRequested && fgets(line, MAXLINE, in)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char command[32];
+        int n = 0;
+        if (sscanf(line, "%31s %n", command, &n) != 1) continue;
+        if (n == 0) n = strlen(line);
+        if      (strcmp(command, "mesh") == 0)     serverMesh(out, line + n);
+        else if (strcmp(command, "domain") == 0)   serverDomain(out, line + n);
+        else if (strcmp(command, "solve") == 0)    serverSolve(out, line + n);
+        else if (strcmp(command, "stats") == 0)    serverStats(out);
+        else if (strcmp(command, "quit") == 0)     break;
+        else if (strcmp(command, "shutdown") == 0) shutdownRequested = TRUE;
+        else fprintf(out, "error unknown command %s\n", command);
+        fflush(out); }
+}
+
+static void serverSocket(const char *path) {
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) Error("Cannot create the socket");
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    unlink(path);
+    if (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0) Error("Cannot bind the socket");
+    if (listen(listener, 4) != 0) Error("Cannot listen on the socket");
+    printf(">> Listening on %s\n", path);
+
+    while (!shutdownRequested) {
+        int client = accept(listener, NULL, NULL);
+        if (client < 0) continue;
+        FILE *in  = fdopen(client, "r");
+        FILE *out = fdopen(dup(client), "w");
+        serverServe(in, out);
+        fclose(out);
+        fclose(in); }
+    close(listener);
+    unlink(path);
+}
+
+int main(int argc, char* argv[]) {
+    const char *socketPath = NULL;
+    double budget = 0.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i+1 < argc) socketPath = argv[++i];
+        if (strcmp(argv[i], "--budget") == 0 && i+1 < argc) budget = atof(argv[++i]);
+        if (strcmp(argv[i], "--help") == 0) {
+            printf("usage : %s [--socket path] [--budget MB]   (requests on stdin otherwise)\n", argv[0]);
+            exit(0); }
+    }
+    femMemorySetBudget((size_t) (budget * 1048576.0));
+
+    if (socketPath) serverSocket(socketPath);
+    else {
+        // replies keep the original stdout, the library logs (printf) go to stderr
+        FILE *out = fdopen(dup(STDOUT_FILENO), "w");
+        if (!out || dup2(STDERR_FILENO, STDOUT_FILENO) == -1) Error("Cannot redirect the library logs");
+        serverServe(stdin, out);
+        fclose(out); }
+
+    for (int i = 0; i < nSystems; i++) femElasticityFree(theSystems[i].problem);
+    for (int i = 0; i < nMeshes; i++) geoFree(theMeshes[i].geometry);
+    return 0;
+}